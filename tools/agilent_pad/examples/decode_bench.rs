@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  decode_bench.rs - Record decoding benchmark for Agilent PAD files.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+use clap::Parser;
+
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    /// The PAD file whose record table will be decoded.
+    pad_file: String,
+
+    /// The minimum number of records to decode with each decoder.
+    #[arg(long, default_value_t = 10_000_000)]
+    records: usize,
+}
+
+fn checksum(record: &Record) -> u64 {
+    record
+        .timestamp_ns
+        .wrapping_add(record.data_offset)
+        .wrapping_add(record.flags.into())
+}
+
+fn report(name: &str, elapsed: Duration, records: usize, sum: u64) {
+    let ns_per_record = elapsed.as_nanos() as f64 / records as f64;
+    println!(
+        "{:>14}: {:8.3} ns/record, {:9.2} Mrecords/s (checksum 0x{:016x})",
+        name,
+        ns_per_record,
+        1e3 / ns_per_record,
+        sum
+    );
+}
+
+fn main() {
+    let args = Args::parse();
+
+    let pad_file = match MappedPadFile::from_filename(&args.pad_file) {
+        Ok(pf) => pf,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &args.pad_file, error);
+            return;
+        }
+    };
+
+    /* Only decode valid records, so the nom path doesn't see the null terminator. */
+    let record_count: usize = pad_file.probe_record_count().try_into().unwrap();
+    let table = &pad_file.record_table()[..record_count * 40];
+    if record_count == 0 {
+        eprintln!("Error: No records in {:?}", &args.pad_file);
+        return;
+    }
+
+    let iterations = args.records.div_ceil(record_count);
+    let total = iterations * record_count;
+    println!(
+        "Decoding {} records {} times ({} records total).",
+        record_count, iterations, total
+    );
+
+    let mut nom_records: Vec<Record> = Vec::with_capacity(record_count);
+    let mut fixed_records: Vec<Record> = Vec::with_capacity(record_count);
+    for raw in table.chunks_exact(40) {
+        nom_records.push(Record::from_slice(raw).unwrap());
+    }
+    decode_records(table, &mut fixed_records);
+    assert_eq!(nom_records, fixed_records, "decoder mismatch");
+
+    let start = Instant::now();
+    let mut sum: u64 = 0;
+    for _ in 0..iterations {
+        for raw in black_box(table).chunks_exact(40) {
+            sum = sum.wrapping_add(checksum(&Record::from_slice(raw).unwrap()));
+        }
+    }
+    report("nom", start.elapsed(), total, sum);
+
+    let start = Instant::now();
+    let mut sum: u64 = 0;
+    for _ in 0..iterations {
+        for raw_record in RawRecord::slice_from_bytes(black_box(table)) {
+            sum = sum.wrapping_add(checksum(&raw_record.to_record()));
+        }
+    }
+    report("fixed-offset", start.elapsed(), total, sum);
+
+    let start = Instant::now();
+    let mut sum: u64 = 0;
+    for _ in 0..iterations {
+        fixed_records.clear();
+        decode_records(black_box(table), &mut fixed_records);
+        sum = fixed_records
+            .iter()
+            .fold(sum, |acc, r| acc.wrapping_add(checksum(r)));
+    }
+    report("decode_records", start.elapsed(), total, sum);
+
+    let start = Instant::now();
+    let mut sum: u64 = 0;
+    for _ in 0..iterations {
+        for raw_record in RawRecord::slice_from_bytes(black_box(table)) {
+            sum = sum.wrapping_add(raw_record.flags().into());
+        }
+    }
+    report("flags only", start.elapsed(), total, sum);
+
+    /* Look at each record's frame header the way a filter would, without copying it. */
+    let start = Instant::now();
+    let mut sum: u64 = 0;
+    for _ in 0..iterations {
+        for record_view in black_box(&pad_file).records(..).map_while(Result::ok) {
+            let field: u64 = match record_view.frame() {
+                Some(frame::Frame::Tlp(tlp_frame)) => match tlp_frame.tlp() {
+                    Some(tlp) => tlp.transaction_id().unwrap_or(0).into(),
+                    None => 0,
+                },
+                Some(frame::Frame::Dllp(dllp_frame)) => dllp_frame.dllp().dllp_type().into(),
+                Some(frame::Frame::OrderedSet(os)) => os.kind() as u64,
+                _ => 0,
+            };
+            sum = sum.wrapping_add(field);
+        }
+    }
+    report("frames", start.elapsed(), total, sum);
+}
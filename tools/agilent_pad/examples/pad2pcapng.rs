@@ -18,10 +18,9 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-use std::cmp::Ordering;
 use std::fs::File;
 use std::io::prelude::*;
-use std::io::BufWriter;
+use std::io::{BufReader, BufWriter, Stdin};
 
 use clap::Parser;
 
@@ -30,234 +29,143 @@ use agilent_pad::*;
 #[derive(Parser, Debug)]
 #[command(author, version, about, long_about = None)]
 struct Args {
-    /// The PAD file to read.
+    /// The PAD file to read, or "-" to read it from standard input.
     pad_file: String,
 
     /// The pcapng file to write.
     pcapng_file: String,
+
+    /// Read the PAD file on a background prefetching thread instead of memory-mapping it.
+    #[arg(long)]
+    prefetch: bool,
 }
 
-fn main() {
-    let args = Args::parse();
+enum PadSource {
+    Mapped(MappedPadFile),
+    Prefetched(PadFile),
+    Streamed(PadStream<BufReader<Stdin>>),
+}
 
-    let mut pad_file = match PadFile::from_filename(&args.pad_file) {
-        Ok(pf) => pf,
-        Err(error) => {
-            eprintln!("Error opening file {:?}: {:?}", &args.pad_file, error);
-            return;
+impl PadSource {
+    fn open(filename: &str, prefetch: bool) -> Result<Self, std::io::Error> {
+        if filename == "-" {
+            return Ok(Self::Streamed(PadStream::new(BufReader::with_capacity(
+                1024 * 1024,
+                std::io::stdin(),
+            ))?));
         }
-    };
 
-    let header = pad_file.header;
-    println!("{:?}", header);
-
-    // Only PAD files from PCIe analyzer modules are supported.
-    if !matches!(
-        header.module_type.as_str(),
-        "AGT_MODULE_ONEPORT_PCIEXPRESS_X8"
-            | "AGT_MODULE_ONEPORT_PCIEXPRESS_X16"
-            | "AGT_MODULE_ONEPORT_PCIEXPRESS_GEN2"
-            | "AGT_MODULE_ONEPORT_PCIEXPRESS_GEN2_X16"
-            | "AGT_MODULE_ONEPORT_PCIEXPRESS_MRIOV_X8"
-            | "AGT_MODULE_ONEPORT_PCIEXPRESS_MRIOV_X16"
-    ) {
-        eprintln!("Error: Unsupported module type: {}", header.module_type);
-        return;
+        match prefetch {
+            true => Ok(Self::Prefetched(PadFile::from_filename(filename)?)),
+            false => Ok(Self::Mapped(MappedPadFile::from_filename(filename)?)),
+        }
     }
 
-    let mut pcapng_writer = match File::create(&args.pcapng_file) {
-        Ok(f) => BufWriter::new(f),
-        Err(error) => {
-            eprintln!("Error opening file {:?}: {:?}", &args.pcapng_file, error);
-            return;
+    fn header(&self) -> &PadHeader {
+        match self {
+            Self::Mapped(pad_file) => &pad_file.header,
+            Self::Prefetched(pad_file) => &pad_file.header,
+            Self::Streamed(pad_stream) => &pad_stream.header,
         }
-    };
-
-    // Section Header Block
-    {
-        pcapng_writer
-            .write_all(&0x0a0d0d0a_u32.to_le_bytes())
-            .unwrap();
-
-        let mut sh_data: Vec<u8> = Vec::new();
-        sh_data.append(&mut 0x1a2b3c4d_u32.to_le_bytes().to_vec());
-        sh_data.append(&mut 0x0001_u16.to_le_bytes().to_vec());
-        sh_data.append(&mut 0x0000_u16.to_le_bytes().to_vec());
-        sh_data.append(&mut (-1_i64).to_le_bytes().to_vec());
-
-        let sh_len: u32 = <usize as TryInto<u32>>::try_into(sh_data.len()).unwrap() + 4 * 3;
-        pcapng_writer.write_all(&sh_len.to_le_bytes()).unwrap();
-        pcapng_writer.write_all(&sh_data).unwrap();
-        pcapng_writer.write_all(&sh_len.to_le_bytes()).unwrap();
     }
 
-    // Interface Description Block
+    fn write_records<W>(&mut self, writer: &mut W) -> Result<(), std::io::Error>
+    where
+        W: Write,
     {
-        pcapng_writer
-            .write_all(&0x00000001_u32.to_le_bytes())
-            .unwrap();
-
-        let mut if_data: Vec<u8> = Vec::new();
-        if_data.append(&mut (147 + 11_u16).to_le_bytes().to_vec());
-        if_data.append(&mut 0x0000_u16.to_le_bytes().to_vec());
-        if_data.append(&mut 0_u32.to_le_bytes().to_vec());
-
-        // Options
-        let mut if_name = header.port_id.clone().into_bytes();
-        if_data.append(&mut 2_u16.to_le_bytes().to_vec());
-        if_data.append(
-            &mut <usize as TryInto<u16>>::try_into(if_name.len())
-                .unwrap()
-                .to_le_bytes()
-                .to_vec(),
-        );
-        if_data.append(&mut if_name);
-        let padding_count = if if_data.len() % 4 != 0 {
-            4 - (if_data.len() % 4)
-        } else {
-            0
-        };
-        if_data.resize(if_data.len() + padding_count, 0);
-
         /*
-        if_data.append(&mut (8 as u16).to_le_bytes().to_vec());
-        if_data.append(&mut (8 as u16).to_le_bytes().to_vec());
-        if_data.append(&mut (2e9 as u64).to_le_bytes().to_vec());
-        */
-
-        if_data.append(&mut 9_u16.to_le_bytes().to_vec());
-        if_data.append(&mut 1_u16.to_le_bytes().to_vec());
-        if_data.append(&mut 9_u32.to_le_bytes().to_vec());
-
-        let mut if_hardware = header.module_type.clone().into_bytes();
-        if_data.append(&mut 15_u16.to_le_bytes().to_vec());
-        if_data.append(
-            &mut <usize as TryInto<u16>>::try_into(if_hardware.len())
-                .unwrap()
-                .to_le_bytes()
-                .to_vec(),
-        );
-        if_data.append(&mut if_hardware);
-        let padding_count = if if_data.len() % 4 != 0 {
-            4 - (if_data.len() % 4)
-        } else {
-            0
+         * The sequential readers can't be stopped from their callback, so the
+         * first write error is kept and the remaining records are skipped.
+         */
+        let mut block_data: Vec<u8> = Vec::with_capacity(4 * 1024);
+        let mut write_result: Result<(), std::io::Error> = Ok(());
+        let mut write_record = |header: &PadHeader, record_view: &RecordView| {
+            if write_result.is_ok() {
+                block_data.clear();
+                append_record(&mut block_data, header, record_view);
+                write_result = writer.write_all(&block_data);
+            }
         };
-        if_data.resize(if_data.len() + padding_count, 0);
 
-        if_data.append(&mut 0_u16.to_le_bytes().to_vec());
-        if_data.append(&mut 0_u16.to_le_bytes().to_vec());
+        let result = match self {
+            Self::Mapped(pad_file) => {
+                let header = &pad_file.header;
+                pad_file.par_for_each_chunk(
+                    ..,
+                    par::PAR_CHUNK_LEN,
+                    |_, records| {
+                        let mut blocks: Vec<u8> = Vec::new();
+                        for record_view in records {
+                            append_record(&mut blocks, header, &record_view?);
+                        }
+                        Ok(blocks)
+                    },
+                    |_, blocks| writer.write_all(&blocks),
+                )
+            }
+            Self::Prefetched(pad_file) => pad_file
+                .prefetch_reader(.., COALESCED_BATCH_LEN, PREFETCH_DEPTH)?
+                .for_each_record(|record_view| write_record(&pad_file.header, record_view)),
+            Self::Streamed(pad_stream) => {
+                let header = pad_stream.header.clone();
+                pad_stream.for_each_record(|record_view| write_record(&header, record_view))
+            }
+        };
 
-        let if_len: u32 = <usize as TryInto<u32>>::try_into(if_data.len()).unwrap() + 4 * 3;
-        pcapng_writer.write_all(&if_len.to_le_bytes()).unwrap();
-        pcapng_writer.write_all(&if_data).unwrap();
-        pcapng_writer.write_all(&if_len.to_le_bytes()).unwrap();
+        result.and(write_result)
     }
+}
 
-    for record in pad_file.records {
-        assert_eq!(record.count, 1, "record \"count\" field is not equal to 1");
-
-        let mut record_data = pad_file.record_reader.get_all_data_for_record(&record);
+fn append_record(buf: &mut Vec<u8>, header: &PadHeader, record_view: &RecordView) {
+    let record = &record_view.record;
 
-        // Enhanced Packet Block
-        {
-            pcapng_writer
-                .write_all(&0x00000006_u32.to_le_bytes())
-                .unwrap();
+    assert_eq!(record.count, 1, "record \"count\" field is not equal to 1");
 
-            let mut block_data: Vec<u8> = Vec::with_capacity(4 * 1024);
-            block_data.append(&mut 0_u32.to_le_bytes().to_vec());
-            block_data.append(
-                &mut <u64 as TryInto<u32>>::try_into(record.timestamp_ns.checked_shr(32).unwrap())
-                    .unwrap()
-                    .to_le_bytes()
-                    .to_vec(),
-            );
-            block_data.append(
-                &mut <u64 as TryInto<u32>>::try_into(record.timestamp_ns & ((1 << 32) - 1))
-                    .unwrap()
-                    .to_le_bytes()
-                    .to_vec(),
-            );
-            let record_data_len =
-                4 + 8 + 2 + 2 + 4 + <usize as TryInto<u32>>::try_into(record_data.len()).unwrap();
-            block_data.append(&mut record_data_len.to_le_bytes().to_vec());
-            block_data.append(&mut record_data_len.to_le_bytes().to_vec());
+    pcapng::append_enhanced_packet(
+        buf,
+        0,
+        record_view,
+        pcapng::trigger_comment(header, record).as_deref(),
+    );
+}
 
-            // Record metadata
-            block_data.append(&mut record.number.to_le_bytes().to_vec());
-            block_data.append(&mut record.timestamp_ns.to_le_bytes().to_vec());
-            block_data.append(&mut record.lfsr.to_le_bytes().to_vec());
-            let value: u16 = if record.extra_metadata_present {
-                0x8000
-            } else {
-                0
-            } | record.metadata_offset;
-            block_data.append(&mut value.to_le_bytes().to_vec());
-            block_data.append(&mut record.flags.to_le_bytes().to_vec());
+fn main() {
+    let args = Args::parse();
 
-            // Record data
-            block_data.append(&mut record_data);
-            let padding_count = if block_data.len() % 4 != 0 {
-                4 - (block_data.len() % 4)
-            } else {
-                0
-            };
-            block_data.resize(block_data.len() + padding_count, 0);
+    let mut pad_source = match PadSource::open(&args.pad_file, args.prefetch) {
+        Ok(ps) => ps,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &args.pad_file, error);
+            std::process::exit(1);
+        }
+    };
 
-            if (record.number == header.trigger_record_number)
-                || (record.number == header.first_record_number
-                    && header.trigger_record_number < header.first_record_number)
-                || (record.number == header.last_record_number
-                    && header.trigger_record_number > header.last_record_number)
-            {
-                let mut packet_comment =
-                    match header.timestamps_ns.trigger.cmp(&record.timestamp_ns) {
-                        Ordering::Less => {
-                            let difference_ns = record.timestamp_ns - header.timestamps_ns.trigger;
-                            let ts_ns_int = difference_ns / 1000000000;
-                            let ts_ns_frac = difference_ns % 1000000000;
-                            format!(
-                                "Triggered {}.{:09}s before this record.",
-                                ts_ns_int, ts_ns_frac
-                            )
-                        }
-                        Ordering::Equal => "Triggered on this record.".to_string(),
-                        Ordering::Greater => {
-                            let difference_ns = header.timestamps_ns.trigger - record.timestamp_ns;
-                            let ts_ns_int = difference_ns / 1000000000;
-                            let ts_ns_frac = difference_ns % 1000000000;
-                            format!(
-                                "Triggered {}.{:09}s after this record.",
-                                ts_ns_int, ts_ns_frac
-                            )
-                        }
-                    }
-                    .into_bytes();
-                block_data.append(&mut 1_u16.to_le_bytes().to_vec());
-                block_data.append(
-                    &mut <usize as TryInto<u16>>::try_into(packet_comment.len())
-                        .unwrap()
-                        .to_le_bytes()
-                        .to_vec(),
-                );
-                block_data.append(&mut packet_comment);
-                let padding_count = if block_data.len() % 4 != 0 {
-                    4 - (block_data.len() % 4)
-                } else {
-                    0
-                };
-                block_data.resize(block_data.len() + padding_count, 0);
+    let header = pad_source.header();
+    println!("{:?}", header);
 
-                block_data.append(&mut 0_u16.to_le_bytes().to_vec());
-                block_data.append(&mut 0_u16.to_le_bytes().to_vec());
-            }
+    if !header.is_pcie_module() {
+        eprintln!("Error: Unsupported module type: {}", header.module_type);
+        std::process::exit(1);
+    }
 
-            let block_len: u32 =
-                <usize as TryInto<u32>>::try_into(block_data.len()).unwrap() + 4 * 3;
-            pcapng_writer.write_all(&block_len.to_le_bytes()).unwrap();
-            pcapng_writer.write_all(&block_data).unwrap();
-            pcapng_writer.write_all(&block_len.to_le_bytes()).unwrap();
+    let mut pcapng_writer = match File::create(&args.pcapng_file) {
+        Ok(f) => BufWriter::new(f),
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &args.pcapng_file, error);
+            std::process::exit(1);
         }
+    };
+
+    let result = pcapng::write_section_header(&mut pcapng_writer)
+        .and_then(|_| pcapng::write_interface_description(&mut pcapng_writer, header))
+        .and_then(|_| pad_source.write_records(&mut pcapng_writer))
+        .and_then(|_| pcapng_writer.flush());
+    if let Err(error) = result {
+        eprintln!("Error converting file {:?}: {:?}", &args.pad_file, error);
+
+        /* Don't leave a truncated pcapng file behind that looks like a complete one. */
+        drop(pcapng_writer);
+        let _ = std::fs::remove_file(&args.pcapng_file);
+        std::process::exit(1);
     }
 }
@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  padbatch.rs - Convert and summarize many Agilent PAD files at once.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::BufWriter;
+use std::path::{Path, PathBuf};
+
+use clap::Parser;
+
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    /// The PAD files to convert, or directories to search for PAD files.
+    inputs: Vec<PathBuf>,
+
+    /// The directory to write the pcapng files to.
+    #[arg(short, long)]
+    output_dir: PathBuf,
+
+    /// The maximum number of records in each unit of work.
+    #[arg(long, default_value_t = par::PAR_CHUNK_LEN)]
+    chunk_len: usize,
+
+    /// The number of worker threads. Defaults to the number of available cores.
+    #[arg(long)]
+    threads: Option<usize>,
+}
+
+#[derive(Debug, Default)]
+struct Summary {
+    records: usize,
+    upstream: usize,
+    symbol_errors: usize,
+    disparity_errors: usize,
+}
+
+impl Summary {
+    fn add(&mut self, other: &Summary) {
+        self.records += other.records;
+        self.upstream += other.upstream;
+        self.symbol_errors += other.symbol_errors;
+        self.disparity_errors += other.disparity_errors;
+    }
+}
+
+/*
+ * Finds the PAD files under path, along with where their outputs go relative to
+ * the output directory: the file's own name for a file given directly, or its
+ * path relative to path for a file found in a directory, so files with the same
+ * name in different subdirectories don't overwrite each other's output.
+ */
+fn find_pad_files(path: &Path, pad_files: &mut Vec<(PathBuf, PathBuf)>) {
+    if !path.is_dir() {
+        let name = PathBuf::from(path.file_name().unwrap_or(path.as_os_str()));
+        pad_files.push((path.to_path_buf(), name.with_extension("pcapng")));
+        return;
+    }
+
+    find_pad_files_in(path, path, pad_files);
+}
+
+fn find_pad_files_in(root: &Path, path: &Path, pad_files: &mut Vec<(PathBuf, PathBuf)>) {
+    let mut entries: Vec<PathBuf> = match std::fs::read_dir(path) {
+        Ok(entries) => entries.filter_map(|e| e.ok()).map(|e| e.path()).collect(),
+        Err(error) => {
+            eprintln!("Error reading directory {:?}: {:?}", path, error);
+            return;
+        }
+    };
+    entries.sort();
+
+    for entry in entries {
+        if entry.is_dir() {
+            find_pad_files_in(root, &entry, pad_files);
+        } else if entry.extension().is_some_and(|ext| ext == "pad") {
+            let relative = entry.strip_prefix(root).unwrap().with_extension("pcapng");
+            pad_files.push((entry, relative));
+        }
+    }
+}
+
+fn open_output(path: &Path, header: &PadHeader) -> Result<BufWriter<File>, std::io::Error> {
+    if let Some(parent) = path.parent() {
+        std::fs::create_dir_all(parent)?;
+    }
+
+    let mut writer = BufWriter::new(File::create(path)?);
+    pcapng::write_section_header(&mut writer)?;
+    pcapng::write_interface_description(&mut writer, header)?;
+
+    Ok(writer)
+}
+
+fn main() {
+    let args = Args::parse();
+
+    let mut paths = Vec::new();
+    for input in args.inputs.iter() {
+        find_pad_files(input, &mut paths);
+    }
+
+    /* Inputs given separately can still map to the same output. */
+    let mut outputs: HashMap<&Path, &Path> = HashMap::new();
+    for (path, output) in paths.iter() {
+        if let Some(other) = outputs.insert(output, path) {
+            eprintln!(
+                "Error: {:?} and {:?} would both be written to {:?}",
+                other,
+                path,
+                args.output_dir.join(output)
+            );
+            std::process::exit(1);
+        }
+    }
+
+    /* A file that can't be converted is reported and the others carry on. */
+    let mut failed = false;
+    let mut names = Vec::new();
+    let mut output_paths = Vec::new();
+    let mut pad_files = Vec::new();
+    let mut writers = Vec::new();
+    for (path, output) in paths {
+        let pad_file = match MappedPadFile::from_filename(&path.to_string_lossy()) {
+            Ok(pf) => pf,
+            Err(error) => {
+                eprintln!("Error opening file {:?}: {:?}", &path, error);
+                failed = true;
+                continue;
+            }
+        };
+
+        if !pad_file.header.is_pcie_module() {
+            eprintln!(
+                "Skipping {:?}: Unsupported module type: {}",
+                &path, pad_file.header.module_type
+            );
+            continue;
+        }
+
+        let output_path = args.output_dir.join(output);
+        let writer = match open_output(&output_path, &pad_file.header) {
+            Ok(w) => w,
+            Err(error) => {
+                eprintln!("Error opening file {:?}: {:?}", &output_path, error);
+                failed = true;
+                continue;
+            }
+        };
+
+        names.push(path);
+        output_paths.push(output_path);
+        pad_files.push(pad_file);
+        writers.push(writer);
+    }
+
+    let mut summaries: Vec<Summary> = pad_files.iter().map(|_| Default::default()).collect();
+    let mut errors: Vec<Option<std::io::Error>> = pad_files.iter().map(|_| None).collect();
+    batch::for_each_chunk(
+        &pad_files,
+        args.chunk_len,
+        args.threads.unwrap_or_else(par::default_threads),
+        |file, _, records| {
+            let header = &pad_files[file].header;
+            let mut summary = Summary::default();
+            let mut blocks: Vec<u8> = Vec::new();
+
+            for record_view in records {
+                let record_view = record_view?;
+                let record = &record_view.record;
+
+                assert_eq!(record.count, 1, "record \"count\" field is not equal to 1");
+
+                summary.records += 1;
+                summary.upstream += usize::from(record.flags & FLAG_UPSTREAM != 0);
+                summary.symbol_errors += usize::from(record.flags & FLAG_SYMBOL_ERROR != 0);
+                summary.disparity_errors += usize::from(record.flags & FLAG_DISPARITY_ERROR != 0);
+
+                pcapng::append_enhanced_packet(
+                    &mut blocks,
+                    0,
+                    &record_view,
+                    pcapng::trigger_comment(header, record).as_deref(),
+                );
+            }
+
+            Ok((summary, blocks))
+        },
+        |file, _, result: Result<(Summary, Vec<u8>), std::io::Error>| {
+            if errors[file].is_some() {
+                return;
+            }
+            match result {
+                Ok((summary, blocks)) => {
+                    errors[file] = writers[file].write_all(&blocks).err();
+                    summaries[file].add(&summary);
+                }
+                Err(error) => errors[file] = Some(error),
+            }
+        },
+    );
+
+    for (((name, output_path), mut writer), (summary, error)) in names
+        .iter()
+        .zip(output_paths.iter())
+        .zip(writers)
+        .zip(summaries.iter().zip(errors))
+    {
+        if let Some(error) = error.or_else(|| writer.flush().err()) {
+            eprintln!("Error converting file {:?}: {:?}", name, error);
+
+            /* Don't leave a truncated pcapng file behind that looks like a complete one. */
+            drop(writer);
+            let _ = std::fs::remove_file(output_path);
+            failed = true;
+            continue;
+        }
+
+        println!(
+            "{}: {} records ({} US, {} DS), {} symbol errors, {} disparity errors",
+            name.display(),
+            summary.records,
+            summary.upstream,
+            summary.records - summary.upstream,
+            summary.symbol_errors,
+            summary.disparity_errors,
+        );
+    }
+    if failed {
+        std::process::exit(1);
+    }
+}
@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  padc.rs - Convert PAD files to and read columnar .padc archives.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fmt::Write as _;
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::BufWriter;
+
+use clap::{Parser, Subcommand};
+
+use agilent_pad::columnar::*;
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    #[command(subcommand)]
+    command: Command,
+}
+
+#[derive(Subcommand, Debug)]
+enum Command {
+    /// Convert a PAD file into a columnar .padc archive.
+    Convert {
+        /// The PAD file to read.
+        pad_file: String,
+
+        /// The .padc file to write.
+        padc_file: String,
+
+        /// The number of records in each chunk.
+        #[arg(long, default_value_t = DEFAULT_CHUNK_LEN)]
+        chunk_len: usize,
+
+        /// The Zstandard compression level.
+        #[arg(long, default_value_t = DEFAULT_LEVEL)]
+        level: i32,
+    },
+
+    /// Print the header, chunks, and column sizes of a .padc file.
+    Info {
+        /// The .padc file to read.
+        padc_file: String,
+    },
+
+    /// Print one column of a .padc file, without decompressing the others.
+    Column {
+        /// The .padc file to read.
+        padc_file: String,
+
+        /// The column to print, e.g. "timestamp_ns", "kind", or "headers".
+        column: String,
+    },
+
+    /// Check that a .padc file holds exactly the records of a PAD file.
+    Verify {
+        /// The .padc file to read.
+        padc_file: String,
+
+        /// The PAD file it was converted from.
+        pad_file: String,
+    },
+
+    /// Convert a .padc file back into a PCAP-NG file.
+    Export {
+        /// The .padc file to read.
+        padc_file: String,
+
+        /// The PCAP-NG file to write.
+        pcapng_file: String,
+    },
+}
+
+fn open_padc(padc_file: &str) -> PadcFile {
+    match PadcFile::from_filename(padc_file) {
+        Ok(padc) => padc,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", padc_file, error);
+            std::process::exit(1);
+        }
+    }
+}
+
+fn open_pad(pad_file: &str) -> MappedPadFile {
+    match MappedPadFile::from_filename(pad_file) {
+        Ok(pf) => pf,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", pad_file, error);
+            std::process::exit(1);
+        }
+    }
+}
+
+fn read_or_exit<T>(filename: &str, result: Result<T, std::io::Error>) -> T {
+    match result {
+        Ok(value) => value,
+        Err(error) => {
+            eprintln!("Error reading file {:?}: {:?}", filename, error);
+            std::process::exit(1);
+        }
+    }
+}
+
+fn print_column_sizes(padc: &PadcFile) {
+    println!("{:>16} {:>14} {:>14}", "Column", "Compressed", "Encoded");
+    for column in COLUMNS {
+        let (compressed, len) = padc.chunks().iter().fold((0, 0), |(c, l), chunk| {
+            let stats = chunk.column(column);
+            (
+                c + <u32 as Into<u64>>::into(stats.compressed_len),
+                l + <u32 as Into<u64>>::into(stats.len),
+            )
+        });
+        println!("{:>16} {:>14} {:>14}", column.name(), compressed, len);
+    }
+}
+
+fn create_or_exit(filename: &str) -> BufWriter<File> {
+    match File::create(filename) {
+        Ok(f) => BufWriter::new(f),
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", filename, error);
+            std::process::exit(1);
+        }
+    }
+}
+
+fn convert(pad_file: &str, padc_file: &str, chunk_len: usize, level: i32) {
+    let pf = open_pad(pad_file);
+
+    let mut writer = create_or_exit(padc_file);
+
+    let result = write_padc(&mut writer, &pf, chunk_len, level).and_then(|_| writer.flush());
+    drop(writer);
+    if let Err(error) = result {
+        eprintln!("Error converting file {:?}: {:?}", pad_file, error);
+        let _ = std::fs::remove_file(padc_file);
+        std::process::exit(1);
+    }
+
+    let padc = open_padc(padc_file);
+    let padc_len = std::fs::metadata(padc_file).map(|m| m.len()).unwrap_or(0);
+    println!(
+        "Wrote {} records in {} chunks: {} bytes -> {} bytes ({:.2}%)",
+        padc.record_count,
+        padc.chunks().len(),
+        pf.file_len(),
+        padc_len,
+        100.0 * padc_len as f64 / pf.file_len().max(1) as f64
+    );
+    print_column_sizes(&padc);
+}
+
+fn print_info(padc_file: &str) {
+    let padc = open_padc(padc_file);
+
+    match padc.pad_header() {
+        Ok(header) => println!("{:?}", header),
+        Err(error) => eprintln!("Error reading PAD header: {:?}", error),
+    }
+    println!(
+        "Records: {} (first: {}), chunk length: {}",
+        padc.record_count, padc.first_record_number, padc.chunk_len
+    );
+    for (i, chunk) in padc.chunks().iter().enumerate() {
+        let timestamps = chunk.column(Column::TimestampNs);
+        println!(
+            "Chunk {}: records {}..={}, timestamps {}..={}",
+            i,
+            chunk.record_range().start(),
+            chunk.record_range().end(),
+            timestamps.min,
+            timestamps.max
+        );
+    }
+    print_column_sizes(&padc);
+}
+
+fn print_column(padc_file: &str, column: &str) {
+    let column = match Column::from_name(column) {
+        Some(column) => column,
+        None => {
+            let names: Vec<&str> = COLUMNS.iter().map(|c| c.name()).collect();
+            eprintln!(
+                "Error: Unknown column {:?} (expected one of: {})",
+                column,
+                names.join(", ")
+            );
+            std::process::exit(1);
+        }
+    };
+
+    let padc = open_padc(padc_file);
+
+    let mut writer = BufWriter::new(std::io::stdout().lock());
+    let mut line = String::new();
+    for (i, chunk) in padc.chunks().iter().enumerate() {
+        let first_record_number = chunk.first_record_number;
+        let result = match column.is_byte_stream() {
+            true => padc.byte_column(i, column).map(|data| {
+                for (number, bytes) in (first_record_number..).zip(data.iter()) {
+                    line.clear();
+                    write!(line, "{} ", number).unwrap();
+                    for b in bytes.iter() {
+                        write!(line, "{:02x}", b).unwrap();
+                    }
+                    writeln!(writer, "{}", line).unwrap();
+                }
+            }),
+            false => padc.values(i, column).map(|values| {
+                for (number, value) in (first_record_number..).zip(values) {
+                    writeln!(writer, "{} {}", number, value).unwrap();
+                }
+            }),
+        };
+        read_or_exit(padc_file, result);
+    }
+    writer.flush().unwrap();
+}
+
+/*
+ * Compares every record of the archive with the PAD file, and exits with an
+ * error unless the header and every record match and neither side has records
+ * the other doesn't.
+ */
+fn verify(padc_file: &str, pad_file: &str) {
+    let padc = open_padc(padc_file);
+    let pf = open_pad(pad_file);
+
+    let mut mismatches: u64 = 0;
+    let mut report = |message: String| {
+        if mismatches < 10 {
+            println!("{}", message);
+        }
+        mismatches += 1;
+    };
+
+    if read_or_exit(padc_file, padc.pad_header_bytes()) != pf.header_bytes() {
+        report("PAD headers differ".to_string());
+    }
+
+    let pad_record_count = pf.probe_record_count();
+    if padc.first_record_number != pf.header.first_record_number
+        || padc.record_count != pad_record_count
+    {
+        println!(
+            "Record counts differ: {} records from {} in {:?}, {} records from {} in {:?}",
+            padc.record_count,
+            padc.first_record_number,
+            padc_file,
+            pad_record_count,
+            pf.header.first_record_number,
+            pad_file
+        );
+        std::process::exit(1);
+    }
+
+    let mut compared: u64 = 0;
+    for (i, chunk) in padc.chunks().iter().enumerate() {
+        let records = read_or_exit(padc_file, padc.records(i));
+
+        let mut pad_records = pf.records(chunk.record_range());
+        for (record, data) in records.iter() {
+            match read_or_exit(pad_file, pad_records.next().transpose()) {
+                Some(record_view)
+                    if *record == record_view.record && data[..] == record_view.all_data()[..] => {}
+                Some(_) => report(format!("Record {} differs", record.number)),
+                None => report(format!(
+                    "Record {} is missing from {:?}",
+                    record.number, pad_file
+                )),
+            }
+            compared += 1;
+        }
+        for record_view in pad_records {
+            let record_view = read_or_exit(pad_file, record_view);
+            report(format!(
+                "Record {} is missing from {:?}",
+                record_view.record.number, padc_file
+            ));
+        }
+    }
+    if compared != padc.record_count.into() {
+        report(format!(
+            "Compared {} records, expected {}",
+            compared, padc.record_count
+        ));
+    }
+
+    match mismatches {
+        0 => println!("All {} records match.", padc.record_count),
+        _ => {
+            println!("{} mismatches.", mismatches);
+            std::process::exit(1);
+        }
+    }
+}
+
+fn export(padc_file: &str, pcapng_file: &str) {
+    let padc = open_padc(padc_file);
+    let header = read_or_exit(padc_file, padc.pad_header());
+
+    let mut writer = create_or_exit(pcapng_file);
+
+    let write_records = |writer: &mut BufWriter<File>| -> Result<(), std::io::Error> {
+        pcapng::write_section_header(writer)?;
+        pcapng::write_interface_description(writer, &header)?;
+
+        let mut buf: Vec<u8> = Vec::new();
+        for i in 0..padc.chunks().len() {
+            buf.clear();
+            for (record, data) in padc.records(i)? {
+                pcapng::append_record_packet(
+                    &mut buf,
+                    0,
+                    record.timestamp_ns,
+                    &record,
+                    &data,
+                    pcapng::trigger_comment(&header, &record).as_deref(),
+                );
+            }
+            writer.write_all(&buf)?;
+        }
+
+        writer.flush()
+    };
+
+    let result = write_records(&mut writer);
+    drop(writer);
+    if let Err(error) = result {
+        eprintln!("Error exporting file {:?}: {:?}", padc_file, error);
+
+        /* Don't leave a truncated pcapng file behind that looks like a complete one. */
+        let _ = std::fs::remove_file(pcapng_file);
+        std::process::exit(1);
+    }
+}
+
+fn main() {
+    let args = Args::parse();
+
+    match args.command {
+        Command::Convert {
+            pad_file,
+            padc_file,
+            chunk_len,
+            level,
+        } => convert(&pad_file, &padc_file, chunk_len, level),
+        Command::Info { padc_file } => print_info(&padc_file),
+        Command::Column { padc_file, column } => print_column(&padc_file, &column),
+        Command::Verify {
+            padc_file,
+            pad_file,
+        } => verify(&padc_file, &pad_file),
+        Command::Export {
+            padc_file,
+            pcapng_file,
+        } => export(&padc_file, &pcapng_file),
+    }
+}
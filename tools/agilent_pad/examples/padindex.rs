@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  padindex.rs - Build the sidecar index of an Agilent PAD file.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::BufWriter;
+use std::path::PathBuf;
+
+use clap::Parser;
+
+use agilent_pad::index::*;
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    /// The PAD file to index.
+    pad_file: String,
+
+    /// The index file to write. Defaults to the PAD file's name with a
+    /// ".padidx" extension.
+    #[arg(short, long)]
+    output: Option<PathBuf>,
+
+    /// Also build Bloom filters of the requester IDs, completer IDs, and
+    /// address pages in each block.
+    #[arg(long)]
+    bloom_filters: bool,
+
+    /// Also build an index of the records that access each address page.
+    #[arg(long)]
+    address_index: bool,
+}
+
+fn main() {
+    let args = Args::parse();
+
+    let pad_file = match MappedPadFile::from_filename(&args.pad_file) {
+        Ok(pf) => pf,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &args.pad_file, error);
+            std::process::exit(1);
+        }
+    };
+
+    let output = args.output.unwrap_or_else(|| index_path(&args.pad_file));
+
+    let options = IndexOptions {
+        bloom_filters: args.bloom_filters,
+        address_index: args.address_index,
+    };
+    let sections = match build_sections(&pad_file, &options) {
+        Ok(sections) => sections,
+        Err(error) => {
+            eprintln!("Error reading file {:?}: {:?}", &args.pad_file, error);
+            std::process::exit(1);
+        }
+    };
+
+    /* Write to a temporary file and rename it, so a mapped index is never modified. */
+    let temp_output = output.with_extension("padidx.tmp");
+    let mut index_writer = match File::create(&temp_output) {
+        Ok(f) => BufWriter::new(f),
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &temp_output, error);
+            std::process::exit(1);
+        }
+    };
+    let result =
+        write_index(&mut index_writer, &pad_file, &sections).and_then(|_| index_writer.flush());
+    drop(index_writer);
+    if let Err(error) = result {
+        eprintln!("Error writing file {:?}: {:?}", &temp_output, error);
+        let _ = std::fs::remove_file(&temp_output);
+        std::process::exit(1);
+    }
+
+    if let Err(error) = std::fs::rename(&temp_output, &output) {
+        eprintln!("Error renaming file {:?}: {:?}", &temp_output, error);
+        let _ = std::fs::remove_file(&temp_output);
+        std::process::exit(1);
+    }
+
+    let index = match PadIndex::from_filename(&output) {
+        Ok(index) => index,
+        Err(error) => {
+            eprintln!("Error reading file {:?}: {:?}", &output, error);
+            std::process::exit(1);
+        }
+    };
+    let mut class_counts = [0_usize; 4];
+    for (_, entry) in index.entries(..) {
+        class_counts[usize::from(entry.class)] += 1;
+    }
+
+    println!(
+        "{}: {} records ({} TLP, {} DLLP, {} ordered set, {} other)",
+        output.display(),
+        index.record_count,
+        class_counts[usize::from(CLASS_TLP)],
+        class_counts[usize::from(CLASS_DLLP)],
+        class_counts[usize::from(CLASS_ORDERED_SET)],
+        class_counts[usize::from(CLASS_UNKNOWN)],
+    );
+    if let Some(zone_maps) = index.zone_maps() {
+        println!(
+            "  {} zone map blocks of up to {} records",
+            zone_maps.len(),
+            zone_maps.block_len()
+        );
+    }
+    if let Some(page_index) = index.page_index() {
+        println!("  {} address pages", page_index.page_count());
+    }
+    for (id, data) in sections.iter() {
+        println!("  section {}: {} bytes", id, data.len());
+    }
+}
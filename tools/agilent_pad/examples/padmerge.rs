@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  padmerge.rs - Merge multiple Agilent PAD files into one PCAP-NG file.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::BufWriter;
+
+use clap::Parser;
+
+use agilent_pad::merge::MergedRecords;
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    /// The PAD files to merge, e.g. one per analyzer port or channel.
+    #[arg(required = true)]
+    pad_files: Vec<String>,
+
+    /// The pcapng file to write.
+    #[arg(short, long)]
+    output: String,
+
+    /// The clock offset (in nanoseconds) to add to the timestamps of each PAD
+    /// file, in the same order as the files. Missing offsets default to zero.
+    #[arg(long, allow_negative_numbers = true)]
+    offset_ns: Vec<i64>,
+}
+
+/*
+ * Writes the merged records of every PAD file to the pcapng file and returns
+ * the number of records taken from each.
+ */
+fn write_merged<W>(
+    writer: &mut W,
+    pad_files: &[MappedPadFile],
+    offsets_ns: &[i64],
+) -> Result<Vec<usize>, std::io::Error>
+where
+    W: Write,
+{
+    /* Interface IDs are assigned in the order the IDBs are written, so source i is interface i. */
+    pcapng::write_section_header(writer)?;
+    for pad_file in pad_files.iter() {
+        pcapng::write_interface_description(writer, &pad_file.header)?;
+    }
+
+    let merged = MergedRecords::new(
+        pad_files
+            .iter()
+            .enumerate()
+            .map(|(i, pad_file)| {
+                (
+                    pad_file.records(..),
+                    offsets_ns.get(i).copied().unwrap_or(0),
+                )
+            })
+            .collect(),
+    );
+
+    let mut counts = vec![0_usize; pad_files.len()];
+    let mut block_data: Vec<u8> = Vec::with_capacity(4 * 1024);
+    for merged_record in merged {
+        let merged_record = merged_record?;
+        let header = &pad_files[merged_record.source].header;
+        let record = &merged_record.record_view.record;
+
+        assert_eq!(record.count, 1, "record \"count\" field is not equal to 1");
+
+        block_data.clear();
+        pcapng::append_enhanced_packet_at(
+            &mut block_data,
+            merged_record.source.try_into().unwrap(),
+            merged_record.timestamp_ns,
+            &merged_record.record_view,
+            pcapng::trigger_comment(header, record).as_deref(),
+        );
+        writer.write_all(&block_data)?;
+
+        counts[merged_record.source] += 1;
+    }
+
+    writer.flush()?;
+
+    Ok(counts)
+}
+
+fn main() {
+    let args = Args::parse();
+
+    if args.offset_ns.len() > args.pad_files.len() {
+        eprintln!(
+            "Error: {} clock offsets given for {} PAD files",
+            args.offset_ns.len(),
+            args.pad_files.len()
+        );
+        std::process::exit(1);
+    }
+
+    let mut pad_files = Vec::new();
+    for filename in args.pad_files.iter() {
+        let pad_file = match MappedPadFile::from_filename(filename) {
+            Ok(pf) => pf,
+            Err(error) => {
+                eprintln!("Error opening file {:?}: {:?}", filename, error);
+                std::process::exit(1);
+            }
+        };
+
+        if !pad_file.header.is_pcie_module() {
+            eprintln!(
+                "Error: Unsupported module type in {:?}: {}",
+                filename, pad_file.header.module_type
+            );
+            std::process::exit(1);
+        }
+
+        pad_files.push(pad_file);
+    }
+
+    let mut pcapng_writer = match File::create(&args.output) {
+        Ok(f) => BufWriter::new(f),
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &args.output, error);
+            std::process::exit(1);
+        }
+    };
+
+    let counts = match write_merged(&mut pcapng_writer, &pad_files, &args.offset_ns) {
+        Ok(counts) => counts,
+        Err(error) => {
+            eprintln!("Error merging PAD files: {:?}", error);
+
+            /* Don't leave a truncated pcapng file behind that looks like a complete one. */
+            drop(pcapng_writer);
+            let _ = std::fs::remove_file(&args.output);
+            std::process::exit(1);
+        }
+    };
+
+    for (filename, count) in args.pad_files.iter().zip(counts) {
+        println!("{}: {} records", filename, count);
+    }
+}
@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  padquery.rs - Query the records of a PAD file.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fmt::Write as _;
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::{BufWriter, ErrorKind};
+use std::ops::Bound;
+use std::path::PathBuf;
+
+use clap::{Parser, ValueEnum};
+
+use agilent_pad::filter::{Field, Filter};
+use agilent_pad::index::PadIndex;
+use agilent_pad::query::QueryPlan;
+use agilent_pad::*;
+
+#[derive(ValueEnum, Clone, Copy, Debug, PartialEq, Eq)]
+enum Format {
+    Text,
+    Jsonl,
+    Pcapng,
+}
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    /// The PAD file to query.
+    pad_file: String,
+
+    /// A filter expression, using the field names of the Wireshark dissector,
+    /// e.g. "pcie.tlp.req == 03:00.0 && pcie.tlp.fmt_type == 0x4a".
+    filter: Option<String>,
+
+    /// The first record to consider.
+    #[arg(long)]
+    first: Option<u32>,
+
+    /// The last record to consider.
+    #[arg(long)]
+    last: Option<u32>,
+
+    /// Only consider records at or after this timestamp (in nanoseconds).
+    #[arg(long)]
+    from_ns: Option<u64>,
+
+    /// Only consider records before this timestamp (in nanoseconds).
+    #[arg(long)]
+    to_ns: Option<u64>,
+
+    /// The output format.
+    #[arg(long, value_enum, default_value_t = Format::Text)]
+    format: Format,
+
+    /// The fields to output for each record, separated by commas. By default,
+    /// the record data is output instead. Ignored for pcapng output.
+    #[arg(long, value_delimiter = ',')]
+    fields: Vec<String>,
+
+    /// The file to write the matching records to, instead of standard output.
+    #[arg(short, long)]
+    output: Option<PathBuf>,
+
+    /// Don't use the PAD file's index, even if it has one.
+    #[arg(long)]
+    no_index: bool,
+}
+
+fn direction(record: &Record) -> &'static str {
+    match record.flags & FLAG_UPSTREAM != 0 {
+        true => "US",
+        false => "DS",
+    }
+}
+
+fn hex(data: &[u8]) -> String {
+    let mut output = String::with_capacity(data.len() * 2);
+    for b in data.iter() {
+        write!(output, "{:02x}", b).unwrap();
+    }
+    output
+}
+
+fn format_text(output: &mut String, record_view: &RecordView, fields: &[Field]) {
+    let record = &record_view.record;
+
+    write!(
+        output,
+        "{} Record {} @ {}.{:09}s:",
+        direction(record),
+        record.number,
+        record.timestamp_ns / 1000000000,
+        record.timestamp_ns % 1000000000,
+    )
+    .unwrap();
+
+    match fields.is_empty() {
+        true => write!(output, " {}", hex(record_view.data_without_metadata())).unwrap(),
+        false => {
+            for field in fields {
+                if let Some(value) = field.value(record_view) {
+                    write!(output, " {}={:#x}", field.name(), value).unwrap();
+                }
+            }
+        }
+    }
+    output.push('\n');
+}
+
+fn format_jsonl(output: &mut String, record_view: &RecordView, fields: &[Field]) {
+    let record = &record_view.record;
+
+    write!(
+        output,
+        "{{\"pcie.record\":{},\"pcie.timestamp_ns\":{}",
+        record.number, record.timestamp_ns
+    )
+    .unwrap();
+
+    match fields.is_empty() {
+        true => write!(
+            output,
+            ",\"pcie.direction\":{},\"pcie.flags\":{},\"data\":\"{}\"",
+            u8::from(record.flags & FLAG_UPSTREAM != 0),
+            record.flags,
+            hex(record_view.data_without_metadata())
+        )
+        .unwrap(),
+        false => {
+            for field in fields {
+                if let Some(value) = field.value(record_view) {
+                    write!(output, ",\"{}\":{}", field.name(), value).unwrap();
+                }
+            }
+        }
+    }
+    output.push_str("}\n");
+}
+
+fn main() {
+    let args = Args::parse();
+
+    let pad_file = match MappedPadFile::from_filename(&args.pad_file) {
+        Ok(pf) => pf,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", &args.pad_file, error);
+            std::process::exit(1);
+        }
+    };
+
+    let filter = match args.filter.as_deref().map(Filter::compile).transpose() {
+        Ok(filter) => filter,
+        Err(error) => {
+            eprintln!("Error in filter {:?}: {}", args.filter.unwrap(), error);
+            std::process::exit(1);
+        }
+    };
+
+    let mut fields: Vec<Field> = Vec::with_capacity(args.fields.len());
+    for name in args.fields.iter() {
+        match Field::from_name(name) {
+            Some(field) => fields.push(field),
+            None => {
+                eprintln!("Error: Unknown field {:?}", name);
+                std::process::exit(1);
+            }
+        }
+    }
+
+    let index = match args.no_index {
+        true => None,
+        false => match PadIndex::for_pad_file(&args.pad_file, &pad_file) {
+            Ok(index) => Some(index),
+            Err(error) if error.kind() == ErrorKind::NotFound => None,
+            Err(error) => {
+                eprintln!("Not using the index: {}", error);
+                None
+            }
+        },
+    };
+
+    let mut writer: BufWriter<Box<dyn Write>> = match &args.output {
+        Some(path) => match File::create(path) {
+            Ok(f) => BufWriter::new(Box::new(f)),
+            Err(error) => {
+                eprintln!("Error opening file {:?}: {:?}", path, error);
+                std::process::exit(1);
+            }
+        },
+        None => BufWriter::new(Box::new(std::io::stdout().lock())),
+    };
+
+    let record_range = (
+        args.first.map_or(Bound::Unbounded, Bound::Included),
+        args.last.map_or(Bound::Unbounded, Bound::Included),
+    );
+    let time_range = (
+        args.from_ns.map_or(Bound::Unbounded, Bound::Included),
+        args.to_ns.map_or(Bound::Unbounded, Bound::Excluded),
+    );
+    let plan = QueryPlan::new(
+        &pad_file,
+        index.as_ref(),
+        filter.as_ref(),
+        record_range,
+        time_range,
+    );
+
+    let header_result = match args.format {
+        Format::Pcapng => pcapng::write_section_header(&mut writer)
+            .and_then(|_| pcapng::write_interface_description(&mut writer, &pad_file.header)),
+        _ => Ok(()),
+    };
+
+    let mut output = String::new();
+    let mut block_data: Vec<u8> = Vec::new();
+    let result = header_result.and_then(|_| {
+        plan.for_each_match(&pad_file, index.as_ref(), filter.as_ref(), |record_view| {
+            match args.format {
+                Format::Text => format_text(&mut output, record_view, &fields),
+                Format::Jsonl => format_jsonl(&mut output, record_view, &fields),
+                Format::Pcapng => {
+                    block_data.clear();
+                    pcapng::append_enhanced_packet(
+                        &mut block_data,
+                        0,
+                        record_view,
+                        pcapng::trigger_comment(&pad_file.header, &record_view.record).as_deref(),
+                    );
+                    writer.write_all(&block_data)?;
+                }
+            }
+            if !output.is_empty() {
+                writer.write_all(output.as_bytes())?;
+                output.clear();
+            }
+            Ok(())
+        })
+    });
+    let stats = match result.and_then(|stats| writer.flush().map(|_| stats)) {
+        Ok(stats) => stats,
+        Err(error) => {
+            eprintln!("Error querying file {:?}: {:?}", &args.pad_file, error);
+
+            /* Don't leave a truncated output file behind that looks like a complete one. */
+            drop(writer);
+            if let Some(path) = &args.output {
+                let _ = std::fs::remove_file(path);
+            }
+            std::process::exit(1);
+        }
+    };
+
+    /* The report goes to standard error, so it doesn't mix with the output. */
+    let record_count = pad_file.probe_record_count();
+    let percent = |count: u64| match record_count {
+        0 => 0.0,
+        total => 100.0 * count as f64 / f64::from(total),
+    };
+
+    eprintln!("Capture: {} records", record_count);
+    for (step, candidates) in plan.steps.iter() {
+        eprintln!(
+            "  after {}: {} candidates ({:.2}%)",
+            step,
+            candidates,
+            percent(*candidates)
+        );
+    }
+    if index.is_some() {
+        eprintln!("Index entries checked: {}", stats.entries_checked);
+    }
+    eprintln!(
+        "Records read: {} ({:.2}%)",
+        stats.records_read,
+        percent(stats.records_read)
+    );
+    eprintln!("Matches: {}", stats.matches);
+}
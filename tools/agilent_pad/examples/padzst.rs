@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  padzst.rs - Random access to Zstandard-compressed Agilent PAD files.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::fmt::Write as _;
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::{BufReader, BufWriter};
+
+use clap::{Parser, Subcommand};
+
+use agilent_pad::seekable::*;
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    #[command(subcommand)]
+    command: Command,
+}
+
+#[derive(Subcommand, Debug)]
+enum Command {
+    /// Recompress a PAD file into the seekable Zstandard format.
+    Compress {
+        /// The PAD file to read, or "-" to read it from standard input.
+        pad_file: String,
+
+        /// The seekable .pad.zst file to write.
+        pad_zst_file: String,
+
+        /// The number of decompressed bytes in each independently-compressed frame.
+        #[arg(long, default_value_t = DEFAULT_FRAME_SIZE)]
+        frame_size: usize,
+
+        /// The Zstandard compression level.
+        #[arg(long, default_value_t = 19)]
+        level: i32,
+    },
+
+    /// Print a range of records from a seekable .pad.zst file.
+    Records {
+        /// The seekable .pad.zst file to read.
+        pad_zst_file: String,
+
+        /// The number of the first record to print.
+        first: u32,
+
+        /// The number of the last record to print.
+        last: u32,
+    },
+}
+
+fn compress_pad(pad_file: &str, pad_zst_file: &str, frame_size: usize, level: i32) {
+    let mut reader: Box<dyn Read> = if pad_file == "-" {
+        Box::new(std::io::stdin().lock())
+    } else {
+        match File::open(pad_file) {
+            Ok(f) => Box::new(f),
+            Err(error) => {
+                eprintln!("Error opening file {:?}: {:?}", pad_file, error);
+                return;
+            }
+        }
+    };
+
+    let mut writer = match File::create(pad_zst_file) {
+        Ok(f) => BufWriter::new(f),
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", pad_zst_file, error);
+            return;
+        }
+    };
+
+    match compress(&mut reader, &mut writer, frame_size, level).and_then(|seek_table| {
+        writer.flush()?;
+        Ok(seek_table)
+    }) {
+        Ok(seek_table) => println!(
+            "Wrote {} frames ({} bytes decompressed).",
+            seek_table.frame_count(),
+            seek_table.decompressed_len()
+        ),
+        Err(error) => eprintln!("Error compressing file {:?}: {:?}", pad_file, error),
+    }
+}
+
+fn print_records(pad_zst_file: &str, first: u32, last: u32) {
+    let mut reader = match File::open(pad_zst_file).and_then(SeekableReader::new) {
+        Ok(r) => r,
+        Err(error) => {
+            eprintln!("Error opening file {:?}: {:?}", pad_zst_file, error);
+            return;
+        }
+    };
+
+    let header = match PadHeader::from_bufreader(&mut BufReader::new(&mut reader)) {
+        Some(h) => h,
+        None => {
+            eprintln!("Error parsing header of {:?}", pad_zst_file);
+            return;
+        }
+    };
+    println!("{:?}", header);
+
+    let result = CoalescedReader::new(reader, &header, first..=last, COALESCED_BATCH_LEN)
+        .for_each_record(|record_view| {
+            let record = &record_view.record;
+
+            let ts_ns_int = record.timestamp_ns / 1000000000;
+            let ts_ns_frac = record.timestamp_ns % 1000000000;
+
+            let mut record_data = String::new();
+            for b in record_view.data_without_metadata().iter() {
+                write!(record_data, "{:02x}", b).unwrap();
+            }
+
+            println!(
+                "{} Record {} @ {}.{:09}s: {}",
+                match record.flags & (1 << 28) != 0 {
+                    true => "US",
+                    false => "DS",
+                },
+                record.number,
+                ts_ns_int,
+                ts_ns_frac,
+                record_data,
+            );
+        });
+
+    if let Err(error) = result {
+        eprintln!("Error reading file {:?}: {:?}", pad_zst_file, error);
+    }
+}
+
+fn main() {
+    let args = Args::parse();
+
+    match args.command {
+        Command::Compress {
+            pad_file,
+            pad_zst_file,
+            frame_size,
+            level,
+        } => compress_pad(&pad_file, &pad_zst_file, frame_size, level),
+        Command::Records {
+            pad_zst_file,
+            first,
+            last,
+        } => print_records(&pad_zst_file, first, last),
+    }
+}
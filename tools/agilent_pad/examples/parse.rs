@@ -18,6 +18,8 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+use std::fmt::Write;
+
 use clap::Parser;
 
 use agilent_pad::*;
@@ -55,6 +57,78 @@ fn char_for_nybble(value: u8) -> char {
     }
 }
 
+/* Everything up to the time since the previous record. */
+fn format_record_head(output: &mut String, record: &Record) {
+    let us_ds = match get_bit(record.flags, 28) {
+        true => "US",
+        false => "DS",
+    };
+
+    let ts_ns_int = record.timestamp_ns / 1000000000;
+    let ts_ns_frac = record.timestamp_ns % 1000000000;
+
+    write!(
+        output,
+        "{} Record {} @ {}.{:09}s",
+        us_ds, record.number, ts_ns_int, ts_ns_frac,
+    )
+    .unwrap();
+}
+
+/* Everything after the time since the previous record. */
+fn format_record_tail(output: &mut String, record_view: &RecordView) {
+    let record = &record_view.record;
+
+    let data = record_view.data_without_metadata();
+
+    let mut record_data = String::with_capacity(2 + data.len() * 2);
+    record_data.push_str(": ");
+    for b in data.iter() {
+        record_data.push(char_for_nybble(b >> 4));
+        record_data.push(char_for_nybble(b & 0xf));
+    }
+
+    writeln!(
+        output,
+        " (count: {}, lfsr: 0x{:04x}, metadata_offset: {} ({}), flags: 0x{:08x}, data_offset: {}){}",
+        record.count,
+        record.lfsr,
+        record.metadata_offset,
+        match record.extra_metadata_present {
+            true => 1,
+            false => 0,
+        },
+        record.flags,
+        record.data_offset,
+        record_data,
+    )
+    .unwrap();
+}
+
+fn format_delta(output: &mut String, timestamp_ns: u64, prev_timestamp_ns: Option<u64>) {
+    let prev_timestamp_ns = prev_timestamp_ns.unwrap_or(timestamp_ns);
+
+    write!(
+        output,
+        " (+{}ns)",
+        timestamp_ns.saturating_sub(prev_timestamp_ns)
+    )
+    .unwrap();
+}
+
+/*
+ * A formatted chunk of records. The first record's line is left split around
+ * its time delta, which depends on the last record of the previous chunk.
+ */
+#[derive(Default)]
+struct FormattedChunk {
+    first_head: String,
+    first_tail: String,
+    first_timestamp_ns: u64,
+    last_timestamp_ns: Option<u64>,
+    rest: String,
+}
+
 fn main() {
     let args = Args::parse();
 
@@ -68,60 +142,55 @@ fn main() {
 
     println!("{:?}", pad_file.header);
 
-    let mut prev_timestamp_ns = None;
-    for record in pad_file.records {
-        let us_ds = match get_bit(record.flags, 28) {
-            true => "US",
-            false => "DS",
-        };
+    /*
+     * Records are formatted in parallel chunks. The time delta of the first
+     * record of each chunk is filled in by the sink, which sees the chunks in
+     * order.
+     */
+    let mut prev_timestamp_ns: Option<u64> = None;
+    let mut output = String::new();
+    let result = pad_file.par_for_each_chunk(
+        ..,
+        par::PAR_CHUNK_LEN,
+        |_, batch| {
+            let mut chunk = FormattedChunk::default();
+            for record_view in batch.records() {
+                let record = &record_view.record;
+                match chunk.last_timestamp_ns {
+                    None => {
+                        format_record_head(&mut chunk.first_head, record);
+                        format_record_tail(&mut chunk.first_tail, &record_view);
+                        chunk.first_timestamp_ns = record.timestamp_ns;
+                    }
+                    Some(prev) => {
+                        format_record_head(&mut chunk.rest, record);
+                        format_delta(&mut chunk.rest, record.timestamp_ns, Some(prev));
+                        format_record_tail(&mut chunk.rest, &record_view);
+                    }
+                }
+                chunk.last_timestamp_ns = Some(record.timestamp_ns);
+            }
+            chunk
+        },
+        |_, chunk| {
+            if chunk.last_timestamp_ns.is_none() {
+                return Ok(());
+            }
 
-        let ts_ns_int = record.timestamp_ns / 1000000000;
-        let ts_ns_frac = record.timestamp_ns % 1000000000;
+            output.clear();
+            output.push_str(&chunk.first_head);
+            format_delta(&mut output, chunk.first_timestamp_ns, prev_timestamp_ns);
+            output.push_str(&chunk.first_tail);
+            print!("{}{}", output, chunk.rest);
 
-        if prev_timestamp_ns.is_none() {
-            prev_timestamp_ns = Some(record.timestamp_ns);
-        }
+            prev_timestamp_ns = chunk.last_timestamp_ns;
 
-        let data = pad_file
-            .record_reader
-            .get_data_for_record_without_metadata(&record);
+            Ok(())
+        },
+    );
 
-        let record_data = {
-            let mut ret = String::with_capacity(2 + 2 * data.len());
-            ret.push_str(": ");
-            for b in data.iter() {
-                ret.push(char_for_nybble(b >> 4));
-                ret.push(char_for_nybble(b & 0xf));
-            }
-            ret
-        };
-
-        let debug_data = format!(
-            " (count: {}, lfsr: 0x{:04x}, metadata_offset: {} ({}), flags: 0x{:08x}, data_offset: {})",
-            record.count,
-            record.lfsr,
-            record.metadata_offset,
-            match record.extra_metadata_present {
-                true => 1,
-                false => 0,
-            },
-            record.flags,
-            record.data_offset,
-        );
-
-        println!(
-            "{} Record {} @ {}.{:09}s (+{}ns){}{}",
-            us_ds,
-            record.number,
-            ts_ns_int,
-            ts_ns_frac,
-            record
-                .timestamp_ns
-                .saturating_sub(prev_timestamp_ns.unwrap()),
-            debug_data,
-            record_data,
-        );
-
-        prev_timestamp_ns = Some(record.timestamp_ns);
+    if let Err(error) = result {
+        eprintln!("Error reading file {:?}: {:?}", &args.pad_file, error);
+        std::process::exit(1);
     }
 }
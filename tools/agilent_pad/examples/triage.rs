@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  triage.rs - Error and direction summary for Agilent PAD files.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::time::Instant;
+
+use clap::Parser;
+
+use agilent_pad::capture::CaptureSet;
+use agilent_pad::scan::*;
+use agilent_pad::*;
+
+#[derive(Parser, Debug)]
+#[command(author, version, about, long_about = None)]
+struct Args {
+    /// The PAD file to read, or every segment of a capture split across several PAD files.
+    #[arg(required = true)]
+    pad_files: Vec<String>,
+
+    /// Only consider records at or after this timestamp (in nanoseconds).
+    #[arg(long)]
+    from_ns: Option<u64>,
+
+    /// Only consider records before this timestamp (in nanoseconds).
+    #[arg(long)]
+    to_ns: Option<u64>,
+
+    /// Print every record with a symbol or disparity error.
+    #[arg(long)]
+    list: bool,
+}
+
+fn main() {
+    let args = Args::parse();
+
+    let capture = match CaptureSet::from_filenames(&args.pad_files) {
+        Ok(c) => c,
+        Err(error) => {
+            eprintln!("Error opening files {:?}: {:?}", &args.pad_files, error);
+            return;
+        }
+    };
+
+    let start = Instant::now();
+    let columns = capture.columns(..);
+    let decode_time = start.elapsed();
+
+    let window = columns.time_range(args.from_ns.unwrap_or(0)..args.to_ns.unwrap_or(u64::MAX));
+
+    let start = Instant::now();
+    let upstream = columns.select_flags(window.clone(), &FlagsPredicate::all_set(FLAG_UPSTREAM));
+    let symbol_errors =
+        columns.select_flags(window.clone(), &FlagsPredicate::all_set(FLAG_SYMBOL_ERROR));
+    let disparity_errors = columns.select_flags(
+        window.clone(),
+        &FlagsPredicate::all_set(FLAG_DISPARITY_ERROR),
+    );
+    let mut errors = symbol_errors.clone();
+    errors.or(&disparity_errors);
+    let mut upstream_errors = errors.clone();
+    upstream_errors.and(&upstream);
+    let scan_time = start.elapsed();
+
+    println!("Records:          {}", window.len());
+    println!("  Upstream:       {}", upstream.count_ones());
+    println!("  Downstream:     {}", window.len() - upstream.count_ones());
+    println!("Symbol errors:    {}", symbol_errors.count_ones());
+    println!("Disparity errors: {}", disparity_errors.count_ones());
+    println!(
+        "Records with errors: {} ({} upstream, {} downstream)",
+        errors.count_ones(),
+        upstream_errors.count_ones(),
+        errors.count_ones() - upstream_errors.count_ones()
+    );
+    println!(
+        "Decoded columns in {:?}, scanned in {:?}.",
+        decode_time, scan_time
+    );
+
+    if args.list {
+        for i in errors.iter_ones() {
+            let index = window.start + i;
+            let timestamp_ns = columns.timestamps_ns[index];
+            println!(
+                "{} Record {} @ {}.{:09}s:{}{}",
+                match upstream.get(i) {
+                    true => "US",
+                    false => "DS",
+                },
+                columns.record_number(index),
+                timestamp_ns / 1000000000,
+                timestamp_ns % 1000000000,
+                match symbol_errors.get(i) {
+                    true => " symbol error",
+                    false => "",
+                },
+                match disparity_errors.get(i) {
+                    true => " disparity error",
+                    false => "",
+                },
+            );
+        }
+    }
+}
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/batch.rs - Work-stealing batch processing of many PAD files.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::collections::{BTreeMap, VecDeque};
+use std::ops::RangeInclusive;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::mpsc::sync_channel;
+use std::sync::{Condvar, Mutex};
+use std::thread;
+
+use crate::par::AbortOnPanic;
+use crate::{par_chunk_ranges, MappedPadFile, MappedRecords};
+
+#[derive(Debug, Clone)]
+pub struct BatchTask {
+    pub file: usize,
+    pub chunk: usize,
+    pub range: RangeInclusive<u32>,
+}
+
+/*
+ * Splits every file into chunks of at most chunk_len records, so a small file
+ * is a single task and a large one is many. The tasks of the largest files come
+ * first so they are started early and the small files fill in the gaps at the
+ * end, instead of one huge file being left running on its own.
+ */
+pub fn plan(files: &[MappedPadFile], chunk_len: usize) -> Vec<BatchTask> {
+    let mut file_ranges: Vec<(usize, Vec<RangeInclusive<u32>>)> = files
+        .iter()
+        .enumerate()
+        .map(|(file, pad_file)| {
+            let ranges = par_chunk_ranges(
+                &pad_file.header,
+                ..,
+                pad_file.probe_last_record(),
+                chunk_len,
+            );
+            (file, ranges)
+        })
+        .collect();
+
+    file_ranges.sort_by_key(|(file, ranges)| {
+        let records: usize = ranges.iter().map(|r| r.clone().count()).sum();
+        (std::cmp::Reverse(records), *file)
+    });
+
+    file_ranges
+        .into_iter()
+        .flat_map(|(file, ranges)| {
+            ranges
+                .into_iter()
+                .enumerate()
+                .map(move |(chunk, range)| BatchTask { file, chunk, range })
+        })
+        .collect()
+}
+
+/*
+ * How far the sink has got through each file. The counts are read without
+ * locking, and the mutex and condition variable are only used to sleep until
+ * the generation changes, i.e. until the sink has retired another chunk.
+ */
+struct Retired {
+    done: Vec<AtomicUsize>,
+    generation: AtomicUsize,
+    wake: (Mutex<()>, Condvar),
+}
+
+impl Retired {
+    fn retire(&self, file: usize, done: usize) {
+        self.done[file].store(done, Ordering::Release);
+
+        /* Bumped under the lock, so a worker about to wait can't miss it. */
+        let _guard = self.wake.0.lock().unwrap();
+        self.generation.fetch_add(1, Ordering::Release);
+        self.wake.1.notify_all();
+    }
+}
+
+/*
+ * Takes the first task from the worker's own queue, or steals the first one
+ * from another worker's queue once its own has run dry, skipping any task that
+ * is `window` or more chunks ahead of the last chunk of its file passed to the
+ * sink. Only the queue being looked at is locked. If every remaining task is
+ * that far ahead, waits for the sink to catch up. No tasks are added after the
+ * start, so finding every queue empty means the batch is done.
+ */
+fn next_task(
+    queues: &[Mutex<VecDeque<BatchTask>>],
+    worker: usize,
+    window: usize,
+    aborted: &AtomicBool,
+    retired: &Retired,
+) -> Option<BatchTask> {
+    loop {
+        if aborted.load(Ordering::Relaxed) {
+            return None;
+        }
+
+        let generation = retired.generation.load(Ordering::Acquire);
+        let mut remaining = false;
+        for victim in (0..queues.len()).map(|offset| (worker + offset) % queues.len()) {
+            let mut queue = queues[victim].lock().unwrap();
+            remaining |= !queue.is_empty();
+            if let Some(position) = queue.iter().position(|task| {
+                task.chunk < retired.done[task.file].load(Ordering::Acquire) + window
+            }) {
+                return queue.remove(position);
+            }
+        }
+
+        if !remaining {
+            return None;
+        }
+
+        let mut guard = retired.wake.0.lock().unwrap();
+        while retired.generation.load(Ordering::Acquire) == generation
+            && !aborted.load(Ordering::Relaxed)
+        {
+            guard = retired.wake.1.wait(guard).unwrap();
+        }
+    }
+}
+
+/*
+ * Runs f over every chunk of every file on a pool of `threads` work-stealing
+ * workers, and passes the results to sink on the calling thread. The results
+ * of each file are passed in chunk order, so a file's output can be written
+ * out sequentially while its later chunks and other files are still being
+ * processed. As in par::for_each_ordered, no file's chunks are processed more
+ * than a few chunks ahead of the sink, which bounds the memory held by
+ * out-of-order results.
+ */
+pub fn for_each_chunk<T, F, S>(
+    files: &[MappedPadFile],
+    chunk_len: usize,
+    threads: usize,
+    f: F,
+    mut sink: S,
+) where
+    T: Send,
+    F: Fn(usize, RangeInclusive<u32>, MappedRecords<'_>) -> T + Sync,
+    S: FnMut(usize, RangeInclusive<u32>, T),
+{
+    let tasks = plan(files, chunk_len);
+    let threads = threads.clamp(1, tasks.len().max(1));
+    let window = threads * 2;
+
+    /* Deal the tasks out round-robin so every worker starts on the largest files */
+    let queues: Vec<Mutex<VecDeque<BatchTask>>> =
+        (0..threads).map(|_| Mutex::new(VecDeque::new())).collect();
+    for (index, task) in tasks.into_iter().enumerate() {
+        queues[index % threads].lock().unwrap().push_back(task);
+    }
+
+    let aborted = AtomicBool::new(false);
+    let retired = Retired {
+        done: files.iter().map(|_| AtomicUsize::new(0)).collect(),
+        generation: AtomicUsize::new(0),
+        wake: (Mutex::new(()), Condvar::new()),
+    };
+
+    thread::scope(|scope| {
+        let (sender, receiver) = sync_channel(threads * 2);
+
+        for worker in 0..threads {
+            let sender = sender.clone();
+            let (queues, aborted, retired, f) = (&queues, &aborted, &retired, &f);
+            scope.spawn(move || {
+                let _guard = AbortOnPanic {
+                    aborted,
+                    retired: &retired.wake,
+                };
+
+                while let Some(task) = next_task(queues, worker, window, aborted, retired) {
+                    let pad_file = &files[task.file];
+                    let result = f(
+                        task.file,
+                        task.range.clone(),
+                        pad_file.records(task.range.clone()),
+                    );
+
+                    if sender.send((task, result)).is_err() {
+                        break;
+                    }
+                }
+            });
+        }
+        drop(sender);
+
+        let _guard = AbortOnPanic {
+            aborted: &aborted,
+            retired: &retired.wake,
+        };
+
+        let mut pending: Vec<BTreeMap<usize, (RangeInclusive<u32>, T)>> =
+            (0..files.len()).map(|_| BTreeMap::new()).collect();
+        let mut expected = vec![0; files.len()];
+        for (task, result) in receiver {
+            let file = task.file;
+            pending[file].insert(task.chunk, (task.range, result));
+
+            let before = expected[file];
+            while let Some((range, result)) = pending[file].remove(&expected[file]) {
+                sink(file, range, result);
+                expected[file] += 1;
+            }
+
+            if expected[file] != before {
+                retired.retire(file, expected[file]);
+            }
+        }
+    });
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testutil::*;
+
+    #[test]
+    fn chunks_reach_the_sink_in_order_for_each_file() {
+        let sizes: [usize; 5] = [5, 300, 0, 77, 1000];
+        let temp_files: Vec<TempFile> = sizes
+            .iter()
+            .map(|size| TempFile::new(&pad_file_bytes(1, &test_records(*size))))
+            .collect();
+        let files: Vec<MappedPadFile> = temp_files
+            .iter()
+            .map(|file| MappedPadFile::from_filename(file.path()).unwrap())
+            .collect();
+
+        let tasks = plan(&files, 16);
+        assert_eq!(tasks.first().unwrap().file, 4);
+        assert_eq!(tasks.last().unwrap().file, 0);
+
+        for threads in [1, 3, 8] {
+            let mut seen: Vec<Vec<u32>> = sizes.iter().map(|_| Vec::new()).collect();
+            for_each_chunk(
+                &files,
+                16,
+                threads,
+                |file, range, records| {
+                    let numbers: Vec<u32> = records.map(|r| r.unwrap().record.number).collect();
+                    assert_eq!(numbers, range.collect::<Vec<u32>>());
+                    (file, numbers)
+                },
+                |file, _, (chunk_file, mut numbers)| {
+                    assert_eq!(file, chunk_file);
+                    seen[file].append(&mut numbers);
+                },
+            );
+
+            for (numbers, size) in seen.iter().zip(sizes) {
+                assert_eq!(
+                    numbers,
+                    &(1..=u32::try_from(size).unwrap()).collect::<Vec<u32>>()
+                );
+            }
+        }
+    }
+}
@@ -0,0 +1,375 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/bloom.rs - Per-block Bloom filters of IDs and address pages.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Each block of records (the same blocks as the zone maps) gets a Bloom filter
+ * of the requester IDs, completer IDs, and 4 KiB address pages of its TLPs. A
+ * lookup that the filter rejects is definitely not in the block, so a search
+ * for one function or one page only has to read the blocks that might hold it.
+ * With the default sizes, a block with a few thousand distinct keys has a false
+ * positive rate well under 1%.
+ *
+ * The Bloom filter section starts with the block length, filter length (in
+ * bytes), hash count, first record number, record count, and a reserved field,
+ * all u32 little-endian, followed by one filter per block.
+ */
+
+use std::ops::RangeInclusive;
+
+use crate::index::IndexEntry;
+
+pub const BLOOM_FILTER_LEN: usize = 16 * 1024;
+pub const BLOOM_HASH_COUNT: u32 = 4;
+pub const PAGE_SHIFT: u32 = 12;
+const SECTION_HEADER_LEN: usize = 24;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BloomKey {
+    RequesterId(u16),
+    CompleterId(u16),
+    /* An address shifted right by PAGE_SHIFT */
+    Page(u64),
+}
+
+impl BloomKey {
+    pub fn page_of(address: u64) -> Self {
+        Self::Page(address >> PAGE_SHIFT)
+    }
+
+    /* Keys of different kinds are kept apart by the top bits. */
+    fn to_u64(self) -> u64 {
+        match self {
+            Self::RequesterId(id) => 1 << 62 | <u16 as Into<u64>>::into(id),
+            Self::CompleterId(id) => 2 << 62 | <u16 as Into<u64>>::into(id),
+            Self::Page(page) => 3 << 62 | (page & ((1 << 62) - 1)),
+        }
+    }
+
+    /* The two halves of a well-mixed 64-bit hash, for double hashing. */
+    fn hashes(self) -> (u32, u32) {
+        /* SplitMix64 finalizer */
+        let mut z = self.to_u64().wrapping_add(0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)).wrapping_mul(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94D049BB133111EB);
+        z ^= z >> 31;
+
+        ((z >> 32) as u32, (z as u32) | 1)
+    }
+}
+
+fn bit_indexes(key: BloomKey, filter_len: usize, hash_count: u32) -> impl Iterator<Item = usize> {
+    let (h1, h2) = key.hashes();
+    /* from_section makes sure this fits. */
+    let bit_count: u32 = (filter_len * 8).try_into().unwrap();
+
+    (0..hash_count).map(move |i| {
+        (h1.wrapping_add(i.wrapping_mul(h2)) % bit_count)
+            .try_into()
+            .unwrap()
+    })
+}
+
+fn filter_contains(filter: &[u8], hash_count: u32, key: BloomKey) -> bool {
+    bit_indexes(key, filter.len(), hash_count).all(|bit| filter[bit / 8] & (1 << (bit % 8)) != 0)
+}
+
+#[derive(Debug, Clone)]
+pub struct BloomFilter {
+    bits: Vec<u8>,
+}
+
+impl BloomFilter {
+    pub fn new() -> Self {
+        Self {
+            bits: vec![0; BLOOM_FILTER_LEN],
+        }
+    }
+
+    pub fn insert(&mut self, key: BloomKey) {
+        for bit in bit_indexes(key, self.bits.len(), BLOOM_HASH_COUNT) {
+            self.bits[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+
+    pub fn contains(&self, key: BloomKey) -> bool {
+        filter_contains(&self.bits, BLOOM_HASH_COUNT, key)
+    }
+
+    /* Adds the IDs and address page of an indexed record. */
+    pub fn add(&mut self, entry: &IndexEntry) {
+        if let Some(requester_id) = entry.requester_id() {
+            self.insert(BloomKey::RequesterId(requester_id));
+        }
+        if let Some(completer_id) = entry.completer_id() {
+            self.insert(BloomKey::CompleterId(completer_id));
+        }
+        if let Some(address) = entry.address() {
+            self.insert(BloomKey::page_of(address));
+        }
+    }
+
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.bits
+    }
+}
+
+impl Default for BloomFilter {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+pub fn section_from_filters(
+    block_len: usize,
+    first_record_number: u32,
+    record_count: u32,
+    filters: &[BloomFilter],
+) -> Vec<u8> {
+    let mut section: Vec<u8> =
+        Vec::with_capacity(SECTION_HEADER_LEN + filters.len() * BLOOM_FILTER_LEN);
+    let fields: [u32; 6] = [
+        block_len.try_into().unwrap(),
+        BLOOM_FILTER_LEN.try_into().unwrap(),
+        BLOOM_HASH_COUNT,
+        first_record_number,
+        record_count,
+        0,
+    ];
+    for field in fields {
+        section.extend_from_slice(&field.to_le_bytes());
+    }
+    for filter in filters {
+        section.extend_from_slice(filter.as_bytes());
+    }
+
+    section
+}
+
+/* A view of the Bloom filter section of a mapped index. */
+#[derive(Debug, Clone, Copy)]
+pub struct BloomFilters<'a> {
+    block_len: u32,
+    filter_len: usize,
+    hash_count: u32,
+    first_record_number: u32,
+    record_count: u32,
+    data: &'a [u8],
+}
+
+impl<'a> BloomFilters<'a> {
+    pub fn from_section(section: &'a [u8]) -> Option<Self> {
+        let u32_at = |offset: usize| {
+            Some(u32::from_le_bytes(
+                section.get(offset..offset + 4)?.try_into().unwrap(),
+            ))
+        };
+
+        let filters = Self {
+            block_len: u32_at(0)?,
+            filter_len: u32_at(4)?.try_into().unwrap(),
+            hash_count: u32_at(8)?,
+            first_record_number: u32_at(12)?,
+            record_count: u32_at(16)?,
+            data: section.get(SECTION_HEADER_LEN..)?,
+        };
+
+        match filters.block_len > 0
+            && filters.filter_len > 0
+            && filters.data.len() % filters.filter_len == 0
+            && filters.is_valid()
+        {
+            true => Some(filters),
+            false => None,
+        }
+    }
+
+    /*
+     * Filters read from an index must have a bit count that fits a u32, one
+     * filter per block, and a record range that doesn't overflow.
+     */
+    fn is_valid(&self) -> bool {
+        let block_count = self.record_count.div_ceil(self.block_len);
+
+        self.filter_len
+            .checked_mul(8)
+            .is_some_and(|bits| u32::try_from(bits).is_ok())
+            && usize::try_from(block_count).is_ok_and(|count| count == self.len())
+            && match self.record_count {
+                0 => true,
+                count => self.first_record_number.checked_add(count - 1).is_some(),
+            }
+    }
+
+    pub fn len(&self) -> usize {
+        self.data.len() / self.filter_len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.data.is_empty()
+    }
+
+    /* The records of a block, or an empty range past the last block. */
+    pub fn block_range(&self, block: usize) -> RangeInclusive<u32> {
+        let start = u32::try_from(block)
+            .ok()
+            .and_then(|block| block.checked_mul(self.block_len))
+            .filter(|start| *start < self.record_count);
+
+        match start {
+            Some(start) => {
+                let first = self.first_record_number.saturating_add(start);
+                let len = (self.record_count - start).min(self.block_len);
+                first..=first.saturating_add(len - 1)
+            }
+            None => 1..=0,
+        }
+    }
+
+    /* False if the block definitely doesn't hold the key. */
+    pub fn may_contain(&self, block: usize, key: BloomKey) -> bool {
+        let filter = &self.data[block * self.filter_len..(block + 1) * self.filter_len];
+
+        filter_contains(filter, self.hash_count, key)
+    }
+
+    /* Returns the record ranges of the blocks that may hold any of the keys, merging adjacent blocks. */
+    pub fn candidate_ranges(&self, keys: &[BloomKey]) -> Vec<RangeInclusive<u32>> {
+        let mut ranges: Vec<RangeInclusive<u32>> = Vec::new();
+        for block in (0..self.len()).filter(|b| keys.iter().any(|k| self.may_contain(*b, *k))) {
+            let range = self.block_range(block);
+            match ranges.last_mut() {
+                Some(last) if last.end().checked_add(1) == Some(*range.start()) => {
+                    *last = *last.start()..=*range.end();
+                }
+                _ => ranges.push(range),
+            }
+        }
+
+        ranges
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn keys(block: u64) -> impl Iterator<Item = BloomKey> {
+        (0..2000).flat_map(move |i| {
+            let id: u16 = ((block * 2000 + i) % 0x10000).try_into().unwrap();
+            [
+                BloomKey::RequesterId(id),
+                BloomKey::CompleterId(id.wrapping_mul(3)),
+                BloomKey::page_of((block << 40) + i * 0x1000),
+            ]
+        })
+    }
+
+    #[test]
+    fn no_false_negatives() {
+        let filters: Vec<BloomFilter> = (0..3)
+            .map(|block| {
+                let mut filter = BloomFilter::new();
+                for key in keys(block) {
+                    filter.insert(key);
+                }
+                filter
+            })
+            .collect();
+
+        for (block, filter) in filters.iter().enumerate() {
+            assert!(keys(block.try_into().unwrap()).all(|key| filter.contains(key)));
+        }
+
+        let section = section_from_filters(100, 5, 250, &filters);
+        let view = BloomFilters::from_section(&section).unwrap();
+        assert_eq!(view.len(), 3);
+        assert_eq!(view.block_range(2), 205..=254);
+        for block in 0..3 {
+            assert!(keys(block).all(|key| view.may_contain(block.try_into().unwrap(), key)));
+        }
+
+        let first = keys(0).next().unwrap();
+        assert_eq!(view.candidate_ranges(&[first])[0], 5..=104);
+    }
+
+    #[test]
+    fn keys_of_different_kinds_differ() {
+        let mut filter = BloomFilter::new();
+        filter.insert(BloomKey::RequesterId(0x0100));
+
+        assert!(filter.contains(BloomKey::RequesterId(0x0100)));
+        assert!(!filter.contains(BloomKey::CompleterId(0x0100)));
+        assert!(!filter.contains(BloomKey::Page(0x0100)));
+    }
+
+    #[test]
+    fn rejects_bad_sections() {
+        let section = section_from_filters(100, 0, 100, &[BloomFilter::new()]);
+
+        for len in [0, 4, 20, 23] {
+            assert!(BloomFilters::from_section(&section[..len]).is_none());
+        }
+        assert!(BloomFilters::from_section(&section[..section.len() - 1]).is_none());
+
+        let with_field = |offset: usize, value: u32| {
+            let mut section = section.clone();
+            section[offset..offset + 4].copy_from_slice(&value.to_le_bytes());
+            section
+        };
+        /* Block length 0 */
+        assert!(BloomFilters::from_section(&with_field(0, 0)).is_none());
+        /* A filter length whose bit count doesn't fit a u32 */
+        assert!(BloomFilters::from_section(&with_field(4, 0x2000_0000)).is_none());
+        /* Too many and too few records for the filter count */
+        assert!(BloomFilters::from_section(&with_field(16, 101)).is_none());
+        assert!(BloomFilters::from_section(&with_field(16, 0)).is_none());
+        /* A record range past u32::MAX */
+        assert!(BloomFilters::from_section(&with_field(12, u32::MAX - 98)).is_none());
+        assert!(BloomFilters::from_section(&with_field(12, u32::MAX - 99)).is_some());
+    }
+
+    #[test]
+    fn block_ranges_are_clamped() {
+        let filters = vec![BloomFilter::new(); 2];
+        let section =
+            section_from_filters(0x8000_0000, u32::MAX - 0x8000_0001, 0x8000_0002, &filters);
+        let view = BloomFilters::from_section(&section).unwrap();
+
+        assert_eq!(view.block_range(0), u32::MAX - 0x8000_0001..=u32::MAX - 2);
+        assert_eq!(view.block_range(1), u32::MAX - 1..=u32::MAX);
+        assert!(view.block_range(2).is_empty());
+        assert!(view.block_range(usize::MAX).is_empty());
+
+        let key = BloomKey::RequesterId(0x0100);
+        let mut filter = BloomFilter::new();
+        filter.insert(key);
+        let section = section_from_filters(
+            0x8000_0000,
+            u32::MAX - 0x8000_0001,
+            0x8000_0002,
+            &[filter.clone(), filter],
+        );
+        let view = BloomFilters::from_section(&section).unwrap();
+        assert_eq!(
+            view.candidate_ranges(&[key]),
+            [u32::MAX - 0x8000_0001..=u32::MAX]
+        );
+    }
+}
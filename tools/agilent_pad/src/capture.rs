@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/capture.rs - Captures split across multiple PAD segments.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::io::{Error, ErrorKind};
+use std::ops::{RangeBounds, RangeInclusive};
+
+use crate::{clamp_record_range, time_range_start, MappedPadFile, RecordColumns, RecordView};
+
+#[derive(Debug)]
+struct SegmentExtent {
+    first_record_number: u32,
+    last_record_number: u32,
+    first_timestamp_ns: u64,
+    last_timestamp_ns: u64,
+}
+
+/*
+ * One acquisition stored as several PAD segments, each holding the next run of
+ * record numbers. The segments are sorted by record number and checked to
+ * belong to the same capture session (by GUID) and to follow on from each other
+ * without gaps or overlaps, so they can be read as a single stream. Record and
+ * time lookups first bisect the segment extents, then the segment itself.
+ */
+#[derive(Debug)]
+pub struct CaptureSet {
+    pub segments: Vec<MappedPadFile>,
+    extents: Vec<SegmentExtent>,
+}
+
+fn invalid_data(message: String) -> Error {
+    Error::new(ErrorKind::InvalidData, message)
+}
+
+impl CaptureSet {
+    pub fn from_filenames<S>(filenames: &[S]) -> Result<Self, Error>
+    where
+        S: AsRef<str>,
+    {
+        let mut segments = Vec::with_capacity(filenames.len());
+        for filename in filenames {
+            segments.push(MappedPadFile::from_filename(filename.as_ref())?);
+        }
+
+        Self::from_segments(segments)
+    }
+
+    pub fn from_segments(mut segments: Vec<MappedPadFile>) -> Result<Self, Error> {
+        if segments.is_empty() {
+            return Err(invalid_data("no segments".to_string()));
+        }
+
+        segments.sort_by_key(|s| s.header.first_record_number);
+
+        let guid = segments[0].header.guid.clone();
+        let mut extents: Vec<SegmentExtent> = Vec::with_capacity(segments.len());
+        for segment in segments.iter() {
+            let header = &segment.header;
+
+            if header.guid != guid {
+                return Err(invalid_data(format!(
+                    "segment GUID {:?} does not match capture GUID {:?}",
+                    header.guid, guid
+                )));
+            }
+
+            let last_record_number = match segment.probe_last_record() {
+                Some(last) => last,
+                None => {
+                    return Err(invalid_data(format!(
+                        "segment starting at record {} has no records",
+                        header.first_record_number
+                    )))
+                }
+            };
+
+            let timestamp_ns = |number: u32| match segment.record(number)? {
+                Some(record_view) => Ok(record_view.record.timestamp_ns),
+                None => Err(invalid_data(format!("record {} is missing", number))),
+            };
+            let extent = SegmentExtent {
+                first_record_number: header.first_record_number,
+                last_record_number,
+                first_timestamp_ns: timestamp_ns(header.first_record_number)?,
+                last_timestamp_ns: timestamp_ns(last_record_number)?,
+            };
+
+            if let Some(prev) = extents.last() {
+                if extent.first_record_number != prev.last_record_number + 1 {
+                    return Err(invalid_data(format!(
+                        "segment starting at record {} does not follow record {}",
+                        extent.first_record_number, prev.last_record_number
+                    )));
+                }
+
+                if extent.first_timestamp_ns < prev.last_timestamp_ns {
+                    return Err(invalid_data(format!(
+                        "segment starting at record {} goes back in time",
+                        extent.first_record_number
+                    )));
+                }
+            }
+
+            extents.push(extent);
+        }
+
+        Ok(Self { segments, extents })
+    }
+
+    pub fn first_record_number(&self) -> u32 {
+        self.extents.first().unwrap().first_record_number
+    }
+
+    pub fn last_record_number(&self) -> u32 {
+        self.extents.last().unwrap().last_record_number
+    }
+
+    pub fn record_count(&self) -> u64 {
+        <u32 as Into<u64>>::into(self.last_record_number() - self.first_record_number()) + 1
+    }
+
+    /* Returns the index of the segment holding the record. */
+    pub fn segment_for_record(&self, number: u32) -> Option<usize> {
+        let index = self
+            .extents
+            .partition_point(|e| e.last_record_number < number);
+
+        match self.extents.get(index) {
+            Some(extent) if extent.first_record_number <= number => Some(index),
+            _ => None,
+        }
+    }
+
+    /* Returns the index of the first segment with a record at or after the timestamp. */
+    pub fn segment_for_time(&self, timestamp_ns: u64) -> Option<usize> {
+        let index = self
+            .extents
+            .partition_point(|e| e.last_timestamp_ns < timestamp_ns);
+
+        match index < self.extents.len() {
+            true => Some(index),
+            false => None,
+        }
+    }
+
+    pub fn record(&self, number: u32) -> Result<Option<RecordView<'_>>, Error> {
+        match self.segment_for_record(number) {
+            Some(segment) => self.segments[segment].record(number),
+            None => Ok(None),
+        }
+    }
+
+    /* Clamps a record range to the records present in the capture. */
+    pub fn record_range<B>(&self, range: B) -> RangeInclusive<u32>
+    where
+        B: RangeBounds<u32>,
+    {
+        clamp_record_range(
+            &range,
+            self.first_record_number(),
+            self.last_record_number(),
+        )
+    }
+
+    /* Returns each segment's index and the part of the record range it holds. */
+    fn segment_ranges<B>(&self, range: B) -> impl Iterator<Item = (usize, RangeInclusive<u32>)> + '_
+    where
+        B: RangeBounds<u32>,
+    {
+        let (start, end) = self.record_range(range).into_inner();
+        let first_segment = match start <= end {
+            true => self.segment_for_record(start).unwrap(),
+            false => self.extents.len(),
+        };
+
+        self.extents[first_segment..]
+            .iter()
+            .enumerate()
+            .take_while(move |(_, e)| e.first_record_number <= end)
+            .map(move |(i, e)| {
+                (
+                    first_segment + i,
+                    e.first_record_number.max(start)..=e.last_record_number.min(end),
+                )
+            })
+    }
+
+    pub fn records<B>(&self, range: B) -> impl Iterator<Item = Result<RecordView<'_>, Error>>
+    where
+        B: RangeBounds<u32>,
+    {
+        self.segment_ranges(range)
+            .flat_map(|(segment, range)| self.segments[segment].records(range))
+    }
+
+    pub fn seek_to_time(&self, timestamp_ns: u64) -> Option<u32> {
+        self.segments[self.segment_for_time(timestamp_ns)?].seek_to_time(timestamp_ns)
+    }
+
+    pub fn records_in_time_range<B>(
+        &self,
+        range: B,
+    ) -> impl Iterator<Item = Result<RecordView<'_>, Error>>
+    where
+        B: RangeBounds<u64>,
+    {
+        let records = match self.seek_to_time(time_range_start(&range)) {
+            Some(first) => self.record_range(first..),
+            None => 1..=0,
+        };
+
+        self.records(records).take_while(move |r| {
+            r.as_ref()
+                .map_or(true, |r| range.contains(&r.record.timestamp_ns))
+        })
+    }
+
+    pub fn for_each_record<F>(&self, mut f: F) -> Result<(), Error>
+    where
+        F: FnMut(&RecordView),
+    {
+        for record_view in self.records(..) {
+            f(&record_view?);
+        }
+
+        Ok(())
+    }
+
+    /*
+     * Decodes the record table columns across all segments. The data offsets
+     * are still relative to the segment each record came from.
+     */
+    pub fn columns<B>(&self, range: B) -> RecordColumns
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = self.record_range(range);
+        let mut columns = RecordColumns::new(*range.start());
+
+        for (segment, range) in self.segment_ranges(range) {
+            let mut segment_columns = self.segments[segment].columns(range);
+
+            columns
+                .timestamps_ns
+                .append(&mut segment_columns.timestamps_ns);
+            columns.flags.append(&mut segment_columns.flags);
+            columns.data_len.append(&mut segment_columns.data_len);
+            columns.data_offset.append(&mut segment_columns.data_offset);
+            columns
+                .metadata_info
+                .append(&mut segment_columns.metadata_info);
+            columns.lfsr.append(&mut segment_columns.lfsr);
+        }
+
+        columns
+    }
+}
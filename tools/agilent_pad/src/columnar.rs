@@ -0,0 +1,908 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/columnar.rs - Columnar compressed archives of PAD files.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A .padc file is a columnar archive of a PAD file, for keeping captures long
+ * term. The records are split into chunks, and each field of the records in a
+ * chunk is stored as its own column, compressed separately with zstd, so one
+ * column (e.g. the timestamps or the TLP types) can be read without
+ * decompressing the others, and in particular without the record data.
+ *
+ * Each column is encoded to suit its contents before it's compressed:
+ *
+ *   - timestamps as zigzag varint deltas of deltas, which are mostly small
+ *     since records arrive at a steady rate
+ *   - the flags and other fields with few distinct values as a dictionary of
+ *     the values in the chunk, followed by a 1-, 2-, or 4-byte code per record
+ *   - the record data offsets as the zigzag varint gap after the previous
+ *     record's data, which is almost always zero
+ *   - the record data as two byte streams: the frame headers (the framing and
+ *     TLP header, or the whole DLLP or ordered set), and everything after them
+ *     (TLP payloads, CRCs, and metadata), since the two compress very differently
+ *
+ * The class and kind columns hold the same classification as the .padidx
+ * index, so e.g. the TLP types can be read without the headers. Record numbers
+ * are implicit, since they are consecutive.
+ *
+ * All integers are little-endian:
+ *
+ *   0   magic "PADC\0\0\0\0"
+ *   8   version (u32)
+ *   12  column count (u32)
+ *   16  chunk length (u32)
+ *   20  chunk count (u32)
+ *   24  first record number (u32)
+ *   28  record count (u32)
+ *   32  PAD header offset (u64)
+ *   40  PAD header compressed length (u32)
+ *   44  PAD header length (u32)
+ *   48  chunk directory offset (u64)
+ *   56  reserved (u64)
+ *
+ * The chunk directory has an entry for each chunk: its first record number and
+ * record count (u32), then for each column the offset (u64), the compressed
+ * and decompressed lengths (u32), and the minimum and maximum value (u64) in
+ * the chunk. For the byte stream columns, these are of the per-record lengths.
+ */
+
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::{Cursor, Error, ErrorKind, SeekFrom};
+use std::ops::RangeInclusive;
+use std::path::Path;
+
+use memmap2::Mmap;
+
+use crate::index::IndexEntry;
+use crate::varint::{read_varint, write_varint};
+use crate::{MappedPadFile, MappedRecords, PadHeader, Record};
+
+const MAGIC: &[u8; 8] = b"PADC\0\0\0\0";
+pub const PADC_VERSION: u32 = 1;
+const HEADER_LEN: usize = 64;
+const COLUMN_ENTRY_LEN: usize = 32;
+const CHUNK_ENTRY_LEN: usize = 8 + COLUMN_COUNT * COLUMN_ENTRY_LEN;
+
+pub const DEFAULT_CHUNK_LEN: usize = 64 * 1024;
+pub const DEFAULT_LEVEL: i32 = 19;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Column {
+    TimestampNs,
+    DataLen,
+    Count,
+    Lfsr,
+    MetadataInfo,
+    Flags,
+    DataOffset,
+    Class,
+    Kind,
+    HeaderLen,
+    Headers,
+    Payloads,
+}
+
+pub const COLUMN_COUNT: usize = 12;
+
+/* In the order they're stored in each chunk */
+pub const COLUMNS: [Column; COLUMN_COUNT] = [
+    Column::TimestampNs,
+    Column::DataLen,
+    Column::Count,
+    Column::Lfsr,
+    Column::MetadataInfo,
+    Column::Flags,
+    Column::DataOffset,
+    Column::Class,
+    Column::Kind,
+    Column::HeaderLen,
+    Column::Headers,
+    Column::Payloads,
+];
+
+impl Column {
+    pub fn name(self) -> &'static str {
+        match self {
+            Self::TimestampNs => "timestamp_ns",
+            Self::DataLen => "data_len",
+            Self::Count => "count",
+            Self::Lfsr => "lfsr",
+            Self::MetadataInfo => "metadata_info",
+            Self::Flags => "flags",
+            Self::DataOffset => "data_offset",
+            Self::Class => "class",
+            Self::Kind => "kind",
+            Self::HeaderLen => "header_len",
+            Self::Headers => "headers",
+            Self::Payloads => "payloads",
+        }
+    }
+
+    pub fn from_name(name: &str) -> Option<Self> {
+        COLUMNS.iter().copied().find(|c| c.name() == name)
+    }
+
+    fn id(self) -> usize {
+        COLUMNS.iter().position(|c| *c == self).unwrap()
+    }
+
+    /* True for the columns that hold record data rather than one value per record. */
+    pub fn is_byte_stream(self) -> bool {
+        matches!(self, Self::Headers | Self::Payloads)
+    }
+}
+
+fn invalid_data(message: String) -> Error {
+    Error::new(ErrorKind::InvalidData, message)
+}
+
+fn zigzag(value: i64) -> u64 {
+    ((value << 1) ^ (value >> 63)) as u64
+}
+
+fn unzigzag(value: u64) -> i64 {
+    ((value >> 1) as i64) ^ -((value & 1) as i64)
+}
+
+fn encode_delta_of_delta(values: &[u64]) -> Vec<u8> {
+    let mut output: Vec<u8> = Vec::with_capacity(values.len());
+    let (mut prev, mut prev_delta): (u64, i64) = (0, 0);
+    for value in values.iter().copied() {
+        let delta = value.wrapping_sub(prev) as i64;
+        write_varint(&mut output, zigzag(delta.wrapping_sub(prev_delta)));
+        (prev, prev_delta) = (value, delta);
+    }
+
+    output
+}
+
+fn decode_delta_of_delta(input: &[u8], count: usize) -> Option<Vec<u64>> {
+    let mut values: Vec<u64> = Vec::with_capacity(count);
+    let mut position = 0;
+    let (mut prev, mut prev_delta): (u64, i64) = (0, 0);
+    for _ in 0..count {
+        let delta = prev_delta.wrapping_add(unzigzag(read_varint(input, &mut position)?));
+        prev = prev.wrapping_add(delta as u64);
+        prev_delta = delta;
+        values.push(prev);
+    }
+
+    match position == input.len() {
+        true => Some(values),
+        false => None,
+    }
+}
+
+fn encode_dictionary(values: &[u64]) -> Vec<u8> {
+    let mut dictionary: Vec<u64> = Vec::new();
+    let mut codes_by_value: HashMap<u64, u32> = HashMap::new();
+    let codes: Vec<u32> = values
+        .iter()
+        .map(|value| {
+            *codes_by_value.entry(*value).or_insert_with(|| {
+                dictionary.push(*value);
+                (dictionary.len() - 1).try_into().unwrap()
+            })
+        })
+        .collect();
+
+    let width: usize = match dictionary.len() {
+        0..=0x100 => 1,
+        0x101..=0x10000 => 2,
+        _ => 4,
+    };
+
+    let mut output: Vec<u8> = Vec::with_capacity(dictionary.len() * 2 + codes.len() * width);
+    write_varint(&mut output, dictionary.len().try_into().unwrap());
+    for value in dictionary {
+        write_varint(&mut output, value);
+    }
+    output.push(width.try_into().unwrap());
+    for code in codes {
+        output.extend_from_slice(&code.to_le_bytes()[..width]);
+    }
+
+    output
+}
+
+fn decode_dictionary(input: &[u8], count: usize) -> Option<Vec<u64>> {
+    let mut position = 0;
+    let dictionary_len: usize = read_varint(input, &mut position)?.try_into().ok()?;
+    let mut dictionary: Vec<u64> = Vec::with_capacity(dictionary_len.min(input.len()));
+    for _ in 0..dictionary_len {
+        dictionary.push(read_varint(input, &mut position)?);
+    }
+
+    let width: usize = (*input.get(position)?).into();
+    let codes = &input[position + 1..];
+    if !matches!(width, 1 | 2 | 4) || codes.len() != count * width {
+        return None;
+    }
+
+    codes
+        .chunks_exact(width)
+        .map(|code| {
+            let mut bytes = [0; 4];
+            bytes[..width].copy_from_slice(code);
+            let index: usize = u32::from_le_bytes(bytes).try_into().unwrap();
+            dictionary.get(index).copied()
+        })
+        .collect()
+}
+
+fn encode_u16(values: &[u64]) -> Vec<u8> {
+    let mut output: Vec<u8> = Vec::with_capacity(values.len() * 2);
+    for value in values.iter().copied() {
+        output.extend_from_slice(&u16::try_from(value).unwrap().to_le_bytes());
+    }
+
+    output
+}
+
+fn decode_u16(input: &[u8], count: usize) -> Option<Vec<u64>> {
+    match input.len() == count * 2 {
+        true => Some(
+            input
+                .chunks_exact(2)
+                .map(|v| u16::from_le_bytes(v.try_into().unwrap()).into())
+                .collect(),
+        ),
+        false => None,
+    }
+}
+
+/* Each data offset is stored as the gap after the end of the previous record's data. */
+fn encode_data_offsets(offsets: &[u64], lens: &[u64]) -> Vec<u8> {
+    let mut output: Vec<u8> = Vec::with_capacity(offsets.len());
+    let mut expected: u64 = 0;
+    for (offset, len) in offsets.iter().zip(lens.iter()) {
+        write_varint(&mut output, zigzag(offset.wrapping_sub(expected) as i64));
+        expected = offset.wrapping_add(*len);
+    }
+
+    output
+}
+
+fn decode_data_offsets(input: &[u8], lens: &[u64]) -> Option<Vec<u64>> {
+    let mut offsets: Vec<u64> = Vec::with_capacity(lens.len());
+    let mut position = 0;
+    let mut expected: u64 = 0;
+    for len in lens.iter() {
+        let offset = expected.wrapping_add(unzigzag(read_varint(input, &mut position)?) as u64);
+        offsets.push(offset);
+        expected = offset.wrapping_add(*len);
+    }
+
+    match position == input.len() {
+        true => Some(offsets),
+        false => None,
+    }
+}
+
+/* Where a column of a chunk is stored, and the range of its values. */
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct ColumnChunk {
+    pub offset: u64,
+    pub compressed_len: u32,
+    pub len: u32,
+    pub min: u64,
+    pub max: u64,
+}
+
+impl ColumnChunk {
+    fn from_bytes(input: &[u8]) -> Self {
+        Self {
+            offset: u64::from_le_bytes(input[0..8].try_into().unwrap()),
+            compressed_len: u32::from_le_bytes(input[8..12].try_into().unwrap()),
+            len: u32::from_le_bytes(input[12..16].try_into().unwrap()),
+            min: u64::from_le_bytes(input[16..24].try_into().unwrap()),
+            max: u64::from_le_bytes(input[24..32].try_into().unwrap()),
+        }
+    }
+
+    fn append_to(&self, output: &mut Vec<u8>) {
+        output.extend_from_slice(&self.offset.to_le_bytes());
+        output.extend_from_slice(&self.compressed_len.to_le_bytes());
+        output.extend_from_slice(&self.len.to_le_bytes());
+        output.extend_from_slice(&self.min.to_le_bytes());
+        output.extend_from_slice(&self.max.to_le_bytes());
+    }
+
+    pub fn overlaps(&self, range: &RangeInclusive<u64>) -> bool {
+        self.min <= *range.end() && self.max >= *range.start()
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Chunk {
+    pub first_record_number: u32,
+    pub record_count: u32,
+    pub columns: [ColumnChunk; COLUMN_COUNT],
+}
+
+impl Chunk {
+    pub fn record_range(&self) -> RangeInclusive<u32> {
+        self.first_record_number..=self.first_record_number + self.record_count - 1
+    }
+
+    pub fn column(&self, column: Column) -> &ColumnChunk {
+        &self.columns[column.id()]
+    }
+}
+
+/* A chunk's columns, encoded and compressed, but not yet placed in the file. */
+struct EncodedChunk {
+    first_record_number: u32,
+    record_count: u32,
+    columns: Vec<(Vec<u8>, ColumnChunk)>,
+}
+
+fn encode_chunk(
+    first_record_number: u32,
+    records: MappedRecords,
+    level: i32,
+) -> Result<EncodedChunk, Error> {
+    let mut values: Vec<Vec<u64>> = vec![Vec::new(); COLUMN_COUNT];
+    let mut headers: Vec<u8> = Vec::new();
+    let mut payloads: Vec<u8> = Vec::new();
+
+    for record_view in records {
+        let record_view = record_view?;
+        let record = &record_view.record;
+        let entry = IndexEntry::from_record_view(&record_view);
+        let data = record_view.all_data();
+        let header_len = record_view.frame().map(|f| f.header_len()).unwrap_or(0);
+
+        headers.extend_from_slice(&data[..header_len]);
+        payloads.extend_from_slice(&data[header_len..]);
+
+        let header_len: u64 = header_len.try_into().unwrap();
+        let row: [u64; COLUMN_COUNT] = [
+            record.timestamp_ns,
+            record.data_len.into(),
+            record.count,
+            record.lfsr.into(),
+            u64::from(record.extra_metadata_present) << 15 | u64::from(record.metadata_offset),
+            record.flags.into(),
+            record.data_offset,
+            entry.class.into(),
+            entry.kind.into(),
+            header_len,
+            header_len,
+            u64::from(record.data_len) - header_len,
+        ];
+        for (column_values, value) in values.iter_mut().zip(row) {
+            column_values.push(value);
+        }
+    }
+
+    let record_count: u32 = values[0].len().try_into().unwrap();
+    let mut columns: Vec<(Vec<u8>, ColumnChunk)> = Vec::with_capacity(COLUMN_COUNT);
+    for column in COLUMNS {
+        let column_values = &values[column.id()];
+        let raw = match column {
+            Column::TimestampNs => encode_delta_of_delta(column_values),
+            Column::Lfsr => encode_u16(column_values),
+            Column::DataOffset => encode_data_offsets(column_values, &values[Column::DataLen.id()]),
+            Column::Headers => std::mem::take(&mut headers),
+            Column::Payloads => std::mem::take(&mut payloads),
+            _ => encode_dictionary(column_values),
+        };
+        let compressed = zstd::bulk::compress(&raw, level)?;
+
+        let stats = ColumnChunk {
+            offset: 0,
+            compressed_len: compressed.len().try_into().unwrap(),
+            len: raw.len().try_into().unwrap(),
+            min: column_values.iter().copied().min().unwrap_or(0),
+            max: column_values.iter().copied().max().unwrap_or(0),
+        };
+        columns.push((compressed, stats));
+    }
+
+    Ok(EncodedChunk {
+        first_record_number,
+        record_count,
+        columns,
+    })
+}
+
+fn write_chunk<W>(
+    writer: &mut W,
+    offset: &mut u64,
+    directory: &mut Vec<u8>,
+    chunk: EncodedChunk,
+) -> Result<(), Error>
+where
+    W: Write,
+{
+    directory.extend_from_slice(&chunk.first_record_number.to_le_bytes());
+    directory.extend_from_slice(&chunk.record_count.to_le_bytes());
+    for (compressed, mut stats) in chunk.columns {
+        writer.write_all(&compressed)?;
+        stats.offset = *offset;
+        stats.append_to(directory);
+        *offset += <u32 as Into<u64>>::into(stats.compressed_len);
+    }
+
+    Ok(())
+}
+
+/*
+ * Writes an archive of every record of the PAD file, in chunks of chunk_len
+ * records that are encoded and compressed on all available cores.
+ */
+pub fn write_padc<W>(
+    writer: &mut W,
+    pad_file: &MappedPadFile,
+    chunk_len: usize,
+    level: i32,
+) -> Result<(), Error>
+where
+    W: Write + Seek,
+{
+    let pad_header = pad_file.header_bytes();
+    let compressed_pad_header = zstd::bulk::compress(pad_header, level)?;
+
+    writer.write_all(&[0; HEADER_LEN])?;
+    writer.write_all(&compressed_pad_header)?;
+
+    let mut offset: u64 = (HEADER_LEN + compressed_pad_header.len())
+        .try_into()
+        .unwrap();
+    let mut directory: Vec<u8> = Vec::new();
+    let mut chunk_count: u32 = 0;
+    pad_file.par_for_each_chunk(
+        ..,
+        chunk_len,
+        |range, records| encode_chunk(*range.start(), records, level),
+        |_, chunk| {
+            write_chunk(writer, &mut offset, &mut directory, chunk)?;
+            chunk_count += 1;
+            Ok(())
+        },
+    )?;
+
+    writer.write_all(&directory)?;
+
+    let mut header: Vec<u8> = Vec::with_capacity(HEADER_LEN);
+    header.extend_from_slice(MAGIC);
+    let fields: [u32; 6] = [
+        PADC_VERSION,
+        COLUMN_COUNT.try_into().unwrap(),
+        chunk_len.try_into().unwrap(),
+        chunk_count,
+        pad_file.header.first_record_number,
+        pad_file.probe_record_count(),
+    ];
+    for field in fields {
+        header.extend_from_slice(&field.to_le_bytes());
+    }
+    header.extend_from_slice(
+        &<usize as TryInto<u64>>::try_into(HEADER_LEN)
+            .unwrap()
+            .to_le_bytes(),
+    );
+    header.extend_from_slice(
+        &<usize as TryInto<u32>>::try_into(compressed_pad_header.len())
+            .unwrap()
+            .to_le_bytes(),
+    );
+    header.extend_from_slice(
+        &<usize as TryInto<u32>>::try_into(pad_header.len())
+            .unwrap()
+            .to_le_bytes(),
+    );
+    header.extend_from_slice(&offset.to_le_bytes());
+    header.extend_from_slice(&0_u64.to_le_bytes());
+
+    writer.seek(SeekFrom::Start(0))?;
+    writer.write_all(&header)?;
+    writer.seek(SeekFrom::End(0))?;
+
+    Ok(())
+}
+
+/* The record data of one byte stream column of a chunk, split into records. */
+#[derive(Debug, Clone)]
+pub struct ByteColumn {
+    data: Vec<u8>,
+    ends: Vec<usize>,
+}
+
+impl ByteColumn {
+    pub fn len(&self) -> usize {
+        self.ends.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.ends.is_empty()
+    }
+
+    pub fn get(&self, index: usize) -> Option<&[u8]> {
+        let start = match index {
+            0 => 0,
+            _ => self.ends[index - 1],
+        };
+
+        Some(&self.data[start..*self.ends.get(index)?])
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = &[u8]> {
+        (0..self.len()).map(|i| self.get(i).unwrap())
+    }
+}
+
+#[derive(Debug)]
+pub struct PadcFile {
+    pub chunk_len: u32,
+    pub first_record_number: u32,
+    pub record_count: u32,
+    chunks: Vec<Chunk>,
+    pad_header_offset: usize,
+    pad_header_compressed_len: usize,
+    pad_header_len: usize,
+    mmap: Mmap,
+}
+
+impl PadcFile {
+    pub fn from_filename<P>(filename: P) -> Result<Self, Error>
+    where
+        P: AsRef<Path>,
+    {
+        let file = File::open(filename)?;
+
+        /* Safety: The mapping is only ever read, and archives are never modified once written. */
+        let mmap = unsafe { Mmap::map(&file)? };
+
+        let u32_at = |offset: usize| {
+            <u32 as TryInto<usize>>::try_into(u32::from_le_bytes(
+                mmap[offset..offset + 4].try_into().unwrap(),
+            ))
+            .unwrap()
+        };
+        let u64_at = |offset: usize| {
+            <u64 as TryInto<usize>>::try_into(u64::from_le_bytes(
+                mmap[offset..offset + 8].try_into().unwrap(),
+            ))
+            .unwrap()
+        };
+
+        if mmap.len() < HEADER_LEN || &mmap[..8] != MAGIC {
+            return Err(invalid_data("not a PADC archive".to_string()));
+        }
+
+        let version: u32 = u32_at(8).try_into().unwrap();
+        if version != PADC_VERSION || u32_at(12) != COLUMN_COUNT {
+            return Err(invalid_data(format!(
+                "unsupported archive version {}",
+                version
+            )));
+        }
+
+        let chunk_count = u32_at(20);
+        let pad_header_offset = u64_at(32);
+        let pad_header_compressed_len = u32_at(40);
+        let directory_offset = u64_at(48);
+        let directory_end = directory_offset + chunk_count * CHUNK_ENTRY_LEN;
+        if mmap.len() < pad_header_offset + pad_header_compressed_len || mmap.len() < directory_end
+        {
+            return Err(invalid_data("truncated archive".to_string()));
+        }
+
+        let first_record_number: u32 = u32_at(24).try_into().unwrap();
+        let record_count: u32 = u32_at(28).try_into().unwrap();
+
+        /* The chunks must hold every record exactly once, in order. */
+        let mut next_record_number: u64 = first_record_number.into();
+        let mut chunks: Vec<Chunk> = Vec::with_capacity(chunk_count);
+        for entry in mmap[directory_offset..directory_end].chunks_exact(CHUNK_ENTRY_LEN) {
+            let mut columns = [ColumnChunk::default(); COLUMN_COUNT];
+            for (column, raw) in columns
+                .iter_mut()
+                .zip(entry[8..].chunks_exact(COLUMN_ENTRY_LEN))
+            {
+                *column = ColumnChunk::from_bytes(raw);
+                let end = column.offset + <u32 as Into<u64>>::into(column.compressed_len);
+                if <usize as TryInto<u64>>::try_into(mmap.len()).unwrap() < end {
+                    return Err(invalid_data("truncated archive".to_string()));
+                }
+            }
+            let chunk = Chunk {
+                first_record_number: u32::from_le_bytes(entry[0..4].try_into().unwrap()),
+                record_count: u32::from_le_bytes(entry[4..8].try_into().unwrap()),
+                columns,
+            };
+            if chunk.record_count == 0 {
+                return Err(invalid_data("empty chunk".to_string()));
+            }
+            if <u32 as Into<u64>>::into(chunk.first_record_number) != next_record_number {
+                return Err(invalid_data(format!(
+                    "chunk {} starts at record {}, expected {}",
+                    chunks.len(),
+                    chunk.first_record_number,
+                    next_record_number
+                )));
+            }
+            next_record_number += <u32 as Into<u64>>::into(chunk.record_count);
+            chunks.push(chunk);
+        }
+        if next_record_number - <u32 as Into<u64>>::into(first_record_number) != record_count.into()
+            || next_record_number > <u32 as Into<u64>>::into(u32::MAX) + 1
+        {
+            return Err(invalid_data(format!(
+                "chunks hold {} records, expected {}",
+                next_record_number - <u32 as Into<u64>>::into(first_record_number),
+                record_count
+            )));
+        }
+
+        Ok(Self {
+            chunk_len: u32_at(16).try_into().unwrap(),
+            first_record_number,
+            record_count,
+            chunks,
+            pad_header_offset,
+            pad_header_compressed_len,
+            pad_header_len: u32_at(44),
+            mmap,
+        })
+    }
+
+    pub fn chunks(&self) -> &[Chunk] {
+        &self.chunks
+    }
+
+    /* Returns the chunks whose values of the column may fall in the range. */
+    pub fn candidate_chunks(
+        &self,
+        column: Column,
+        range: RangeInclusive<u64>,
+    ) -> impl Iterator<Item = usize> + '_ {
+        (0..self.chunks.len()).filter(move |i| self.chunks[*i].column(column).overlaps(&range))
+    }
+
+    /* The header of the archived PAD file, as it was in the PAD file. */
+    pub fn pad_header_bytes(&self) -> Result<Vec<u8>, Error> {
+        let compressed = &self.mmap
+            [self.pad_header_offset..self.pad_header_offset + self.pad_header_compressed_len];
+        let pad_header = zstd::bulk::decompress(compressed, self.pad_header_len)?;
+        match pad_header.len() == self.pad_header_len {
+            true => Ok(pad_header),
+            false => Err(invalid_data("truncated PAD header".to_string())),
+        }
+    }
+
+    /* The header of the archived PAD file. */
+    pub fn pad_header(&self) -> Result<PadHeader, Error> {
+        let pad_header = self.pad_header_bytes()?;
+
+        PadHeader::from_reader(&mut Cursor::new(&pad_header[..]))
+            .ok_or_else(|| invalid_data("bad PAD header".to_string()))
+    }
+
+    /* Decompresses one column of a chunk, without decoding it. */
+    pub fn column_bytes(&self, chunk: usize, column: Column) -> Result<Vec<u8>, Error> {
+        let stats = self.chunks[chunk].column(column);
+        let start: usize = stats.offset.try_into().unwrap();
+        let end = start + <u32 as TryInto<usize>>::try_into(stats.compressed_len).unwrap();
+        let len: usize = stats.len.try_into().unwrap();
+
+        let raw = zstd::bulk::decompress(&self.mmap[start..end], len)?;
+        match raw.len() == len {
+            true => Ok(raw),
+            false => Err(self.corrupt(chunk, column)),
+        }
+    }
+
+    fn corrupt(&self, chunk: usize, column: Column) -> Error {
+        invalid_data(format!(
+            "corrupt {} column in chunk {}",
+            column.name(),
+            chunk
+        ))
+    }
+
+    /*
+     * Returns the value of the column for each record of a chunk. The values of
+     * a byte stream column are the lengths of each record's part of the stream.
+     */
+    pub fn values(&self, chunk: usize, column: Column) -> Result<Vec<u64>, Error> {
+        let count: usize = self.chunks[chunk].record_count.try_into().unwrap();
+
+        let values = match column {
+            Column::TimestampNs => decode_delta_of_delta(&self.column_bytes(chunk, column)?, count),
+            Column::Lfsr => decode_u16(&self.column_bytes(chunk, column)?, count),
+            Column::DataOffset => decode_data_offsets(
+                &self.column_bytes(chunk, column)?,
+                &self.values(chunk, Column::DataLen)?,
+            ),
+            Column::Headers => return self.values(chunk, Column::HeaderLen),
+            Column::Payloads => Some(
+                self.values(chunk, Column::DataLen)?
+                    .into_iter()
+                    .zip(self.values(chunk, Column::HeaderLen)?)
+                    .map(|(data_len, header_len)| data_len.saturating_sub(header_len))
+                    .collect(),
+            ),
+            _ => decode_dictionary(&self.column_bytes(chunk, column)?, count),
+        };
+
+        values.ok_or_else(|| self.corrupt(chunk, column))
+    }
+
+    /* Returns each record's part of a byte stream column of a chunk. */
+    pub fn byte_column(&self, chunk: usize, column: Column) -> Result<ByteColumn, Error> {
+        assert!(column.is_byte_stream(), "not a byte stream column");
+
+        let data = self.column_bytes(chunk, column)?;
+        let mut ends: Vec<usize> = Vec::with_capacity(self.chunks[chunk].record_count as usize);
+        let mut end: usize = 0;
+        for len in self.values(chunk, column)? {
+            end += <u64 as TryInto<usize>>::try_into(len).unwrap();
+            ends.push(end);
+        }
+
+        match end == data.len() {
+            true => Ok(ByteColumn { data, ends }),
+            false => Err(self.corrupt(chunk, column)),
+        }
+    }
+
+    /* Rebuilds every record of a chunk, along with its data (including any metadata). */
+    pub fn records(&self, chunk: usize) -> Result<Vec<(Record, Vec<u8>)>, Error> {
+        let mut columns: Vec<Vec<u64>> = Vec::with_capacity(COLUMN_COUNT);
+        for column in COLUMNS.iter().filter(|c| !c.is_byte_stream()) {
+            columns.push(self.values(chunk, *column)?);
+        }
+        let headers = self.byte_column(chunk, Column::Headers)?;
+        let payloads = self.byte_column(chunk, Column::Payloads)?;
+
+        let count: usize = self.chunks[chunk].record_count.try_into().unwrap();
+        if columns.iter().any(|values| values.len() != count) || headers.len() != count {
+            return Err(invalid_data(format!(
+                "wrong number of records in chunk {}",
+                chunk
+            )));
+        }
+
+        let value = |column: Column, index: usize| columns[column.id()][index];
+        let first_record_number = self.chunks[chunk].first_record_number;
+
+        let mut records = Vec::with_capacity(count);
+        for index in 0..count {
+            let metadata_info = value(Column::MetadataInfo, index);
+            let record = Record {
+                number: first_record_number + <usize as TryInto<u32>>::try_into(index).unwrap(),
+                data_len: value(Column::DataLen, index)
+                    .try_into()
+                    .map_err(|_| self.corrupt(chunk, Column::DataLen))?,
+                count: value(Column::Count, index),
+                timestamp_ns: value(Column::TimestampNs, index),
+                lfsr: value(Column::Lfsr, index)
+                    .try_into()
+                    .map_err(|_| self.corrupt(chunk, Column::Lfsr))?,
+                extra_metadata_present: metadata_info & 0x8000 != 0,
+                metadata_offset: (metadata_info & 0x7FFF).try_into().unwrap(),
+                flags: value(Column::Flags, index)
+                    .try_into()
+                    .map_err(|_| self.corrupt(chunk, Column::Flags))?,
+                data_offset: value(Column::DataOffset, index),
+            };
+
+            let mut data = headers.get(index).unwrap().to_vec();
+            data.extend_from_slice(payloads.get(index).unwrap());
+            records.push((record, data));
+        }
+
+        Ok(records)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const EDGE_VALUES: [u64; 8] = [0, 1, u64::MAX, 0, u64::MAX - 1, 1 << 63, 7, 7];
+
+    #[test]
+    fn zigzag_round_trip() {
+        for value in [0, 1, -1, 63, -64, i64::MAX, i64::MIN] {
+            assert_eq!(unzigzag(zigzag(value)), value);
+        }
+        assert_eq!(zigzag(0), 0);
+        assert_eq!(zigzag(-1), 1);
+        assert_eq!(zigzag(1), 2);
+    }
+
+    #[test]
+    fn delta_of_delta_round_trip() {
+        /* Steady timestamps, then deltas that wrap around in both directions. */
+        let mut values: Vec<u64> = (0..100).map(|i| 1_000_000 + i * 8).collect();
+        values.extend_from_slice(&EDGE_VALUES);
+
+        let encoded = encode_delta_of_delta(&values);
+        assert_eq!(
+            decode_delta_of_delta(&encoded, values.len()),
+            Some(values.clone())
+        );
+
+        /* After the first two values, a steady rate is all zeros. */
+        assert!(encode_delta_of_delta(&values[..100])
+            .iter()
+            .rev()
+            .take(98)
+            .all(|b| *b == 0));
+
+        assert_eq!(decode_delta_of_delta(&encoded, values.len() + 1), None);
+        assert_eq!(decode_delta_of_delta(&encoded, values.len() - 1), None);
+        assert_eq!(decode_delta_of_delta(&[], 0), Some(vec![]));
+    }
+
+    #[test]
+    fn dictionary_round_trip() {
+        let encoded = encode_dictionary(&EDGE_VALUES);
+        assert_eq!(
+            decode_dictionary(&encoded, EDGE_VALUES.len()),
+            Some(EDGE_VALUES.to_vec())
+        );
+        assert_eq!(decode_dictionary(&encoded, EDGE_VALUES.len() + 1), None);
+
+        /* Wider codes once there are more than 256 and 65536 distinct values. */
+        for (count, width) in [(256, 1), (257, 2), (0x10000, 2), (0x10001, 4)] {
+            let values: Vec<u64> = (0..count).map(|v| v * 3).collect();
+            let encoded = encode_dictionary(&values);
+            let header = encoded.len() - values.len() * width;
+            assert_eq!(usize::from(encoded[header - 1]), width);
+            assert_eq!(decode_dictionary(&encoded, values.len()), Some(values));
+        }
+
+        assert_eq!(decode_dictionary(&encode_dictionary(&[]), 0), Some(vec![]));
+    }
+
+    #[test]
+    fn dictionary_rejects_bad_codes() {
+        let mut encoded = encode_dictionary(&[5, 6]);
+        *encoded.last_mut().unwrap() = 2;
+        assert_eq!(decode_dictionary(&encoded, 2), None);
+    }
+
+    #[test]
+    fn data_offsets_round_trip() {
+        let lens: Vec<u64> = vec![8, 20, 0, 12, 4, 4];
+        /* Contiguous, a gap, a zero-length record, a backwards jump, and the extremes. */
+        let offsets: Vec<u64> = vec![0, 8, 100, 100, 50, u64::MAX - 4];
+
+        let encoded = encode_data_offsets(&offsets, &lens);
+        assert_eq!(decode_data_offsets(&encoded, &lens), Some(offsets));
+        assert_eq!(decode_data_offsets(&encoded, &lens[..5]), None);
+
+        /* Contiguous records are one byte each. */
+        assert_eq!(encode_data_offsets(&[0, 8, 28], &[8, 20, 4]), vec![0, 0, 0]);
+    }
+
+    #[test]
+    fn u16_round_trip() {
+        let values: Vec<u64> = vec![0, 1, 0xFFFF, 0x1234];
+        assert_eq!(decode_u16(&encode_u16(&values), values.len()), Some(values));
+        assert_eq!(decode_u16(&[0; 3], 2), None);
+    }
+}
@@ -0,0 +1,1139 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/filter.rs - Record filter expressions using Wireshark field names.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Filters are written like Wireshark display filters, using the field names
+ * that wireshark/proto_pcie.c registers, and have the same value for every
+ * field as the dissector shows (e.g. bitmask fields are shifted down). The
+ * expression is compiled once into a tree of closures that is then evaluated
+ * against each record. Supported syntax:
+ *
+ *   pcie.tlp                            field is present
+ *   pcie.tlp.fmt_type == 0x4a           ==, !=, <, <=, >, >= (or eq, ne, ...)
+ *   pcie.tlp.req == 03:00.1             bus:device.function literals
+ *   pcie.dllp.type in {0x00 0x10}       sets, which may hold ranges (a..b)
+ *   pcie.tlp.first_dw_be & 0x1          bitwise and, tested for non-zero
+ *   !a, a && b, a || b, (a)             also not, and, or
+ *
+ * Values are integers (decimal, 0x hex, or 0b binary), true, or false. A
+ * comparison with a field the record doesn't have is false, as in Wireshark.
+ * Like the dissector's expert info, the *_invalid and status_not_successful
+ * fields are only present when the check fails.
+ *
+ * Many fields can also be answered from a .padidx index entry, so a filter
+ * that only uses those can be evaluated without reading the record at all.
+ * The compiler also collects the conditions that every matching record must
+ * meet, which queries use to skip blocks and records that can't match.
+ */
+
+use std::fmt;
+use std::ops::RangeInclusive;
+
+use crate::frame::{Dllp, Frame, OrderedSet, Tlp, TlpKind, K_29_7};
+use crate::index::{
+    IndexEntry, CLASS_DLLP, CLASS_ORDERED_SET, CLASS_TLP, ENTRY_DISPARITY_ERROR,
+    ENTRY_SYMBOL_ERROR, ENTRY_TRUNCATED, ENTRY_UPSTREAM,
+};
+use crate::{
+    RecordView, FLAGS_ELECTRICAL_IDLE_MASK, FLAGS_LINK_WIDTH_MASK, FLAGS_START_LANE_MASK,
+    FLAG_CHANNEL_BONDED, FLAG_DISPARITY_ERROR, FLAG_GAP, FLAG_SCRAMBLED, FLAG_SYMBOL_ERROR,
+    FLAG_UPSTREAM,
+};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Field {
+    Record,
+    TimestampNs,
+    Flags,
+    Gap,
+    Scrambled,
+    Direction,
+    ElectricalIdle,
+    DisparityError,
+    ChannelBonded,
+    LinkSpeed,
+    StartLane,
+    SymbolError,
+    LinkWidth,
+    Lfsr,
+    MetadataInfo,
+    MetadataOffset,
+    ExtraMetadataPresent,
+    Frame,
+    FrameStartTag,
+    FrameEndTag,
+    FrameEndTagInvalid,
+    TlpSeq,
+    TlpLcrc,
+    TlpLcrcInvalid,
+    OrderedSetType,
+    TsLinkNumber,
+    TsLaneNumber,
+    TsNFts,
+    TsDataRate,
+    TsTrainingControl,
+    Dllp,
+    DllpType,
+    DllpAckNakSeq,
+    DllpHdrScale,
+    DllpHdrFc,
+    DllpDataScale,
+    DllpDataFc,
+    DllpCrc,
+    DllpCrcInvalid,
+    Tlp,
+    TlpFmtType,
+    TlpFmt,
+    TlpType,
+    TlpT9,
+    TlpTc,
+    TlpT8,
+    TlpAttr2,
+    TlpLn,
+    TlpTh,
+    TlpTd,
+    TlpEp,
+    TlpAttr10,
+    TlpAt,
+    TlpLen,
+    TlpReq,
+    TlpReqBus,
+    TlpReqDev,
+    TlpReqFun,
+    TlpTag,
+    TlpTag70,
+    TlpFirstDwBe,
+    TlpLastDwBe,
+    TlpAddr,
+    TlpPh,
+    TlpReg,
+    TlpMsgCode,
+    TlpCpl,
+    TlpCplBus,
+    TlpCplDev,
+    TlpCplFun,
+    TlpCplStatus,
+    TlpCplStatusNotSuccessful,
+    TlpCplBcm,
+    TlpCplByteCount,
+    TlpCplLowerAddr,
+    TlpEcrc,
+    TlpEcrcInvalid,
+}
+
+const FIELDS: &[(&str, Field)] = &[
+    ("pcie.record", Field::Record),
+    ("pcie.timestamp_ns", Field::TimestampNs),
+    ("pcie.flags", Field::Flags),
+    ("pcie.gap", Field::Gap),
+    ("pcie.scrambled", Field::Scrambled),
+    ("pcie.direction", Field::Direction),
+    ("pcie.electrical_idle", Field::ElectricalIdle),
+    ("pcie.disparity_error", Field::DisparityError),
+    ("pcie.channel_bonded", Field::ChannelBonded),
+    ("pcie.link_speed", Field::LinkSpeed),
+    ("pcie.start_lane", Field::StartLane),
+    ("pcie.symbol_error", Field::SymbolError),
+    ("pcie.link_width", Field::LinkWidth),
+    ("pcie.lfsr", Field::Lfsr),
+    ("pcie.metadata_info", Field::MetadataInfo),
+    ("pcie.metadata_info.metadata_offset", Field::MetadataOffset),
+    (
+        "pcie.metadata_info.extra_metadata_present",
+        Field::ExtraMetadataPresent,
+    ),
+    ("pcie.frame", Field::Frame),
+    ("pcie.frame.start_tag", Field::FrameStartTag),
+    ("pcie.frame.end_tag", Field::FrameEndTag),
+    ("pcie.frame.end_tag_invalid", Field::FrameEndTagInvalid),
+    ("pcie.frame.tlp.seq", Field::TlpSeq),
+    ("pcie.frame.tlp.lcrc", Field::TlpLcrc),
+    ("pcie.frame.tlp.lcrc_invalid", Field::TlpLcrcInvalid),
+    ("pcie.frame.ordered_set.type", Field::OrderedSetType),
+    ("pcie.frame.ordered_set.ts.link_number", Field::TsLinkNumber),
+    ("pcie.frame.ordered_set.ts.lane_number", Field::TsLaneNumber),
+    ("pcie.frame.ordered_set.ts.n_fts", Field::TsNFts),
+    ("pcie.frame.ordered_set.ts.data_rate", Field::TsDataRate),
+    (
+        "pcie.frame.ordered_set.ts.training_control",
+        Field::TsTrainingControl,
+    ),
+    ("pcie.dllp", Field::Dllp),
+    ("pcie.dllp.type", Field::DllpType),
+    ("pcie.dllp.ack_nak.seq", Field::DllpAckNakSeq),
+    ("pcie.dllp.init_update_fc.hdr_scale", Field::DllpHdrScale),
+    ("pcie.dllp.init_update_fc.hdr_fc", Field::DllpHdrFc),
+    ("pcie.dllp.init_update_fc.data_scale", Field::DllpDataScale),
+    ("pcie.dllp.init_update_fc.data_fc", Field::DllpDataFc),
+    ("pcie.dllp.crc", Field::DllpCrc),
+    ("pcie.dllp.crc_invalid", Field::DllpCrcInvalid),
+    ("pcie.tlp", Field::Tlp),
+    ("pcie.tlp.fmt_type", Field::TlpFmtType),
+    ("pcie.tlp.fmt", Field::TlpFmt),
+    ("pcie.tlp.type", Field::TlpType),
+    ("pcie.tlp.t9", Field::TlpT9),
+    ("pcie.tlp.tc", Field::TlpTc),
+    ("pcie.tlp.t8", Field::TlpT8),
+    ("pcie.tlp.attr2", Field::TlpAttr2),
+    ("pcie.tlp.ln", Field::TlpLn),
+    ("pcie.tlp.th", Field::TlpTh),
+    ("pcie.tlp.td", Field::TlpTd),
+    ("pcie.tlp.ep", Field::TlpEp),
+    ("pcie.tlp.attr10", Field::TlpAttr10),
+    ("pcie.tlp.at", Field::TlpAt),
+    ("pcie.tlp.len", Field::TlpLen),
+    ("pcie.tlp.req", Field::TlpReq),
+    ("pcie.tlp.req.bus", Field::TlpReqBus),
+    ("pcie.tlp.req.dev", Field::TlpReqDev),
+    ("pcie.tlp.req.fun", Field::TlpReqFun),
+    ("pcie.tlp.tag", Field::TlpTag),
+    ("pcie.tlp.tag70", Field::TlpTag70),
+    ("pcie.tlp.first_dw_be", Field::TlpFirstDwBe),
+    ("pcie.tlp.last_dw_be", Field::TlpLastDwBe),
+    ("pcie.tlp.addr", Field::TlpAddr),
+    ("pcie.tlp.ph", Field::TlpPh),
+    ("pcie.tlp.reg", Field::TlpReg),
+    ("pcie.tlp.msg.code", Field::TlpMsgCode),
+    ("pcie.tlp.cpl", Field::TlpCpl),
+    ("pcie.tlp.cpl.bus", Field::TlpCplBus),
+    ("pcie.tlp.cpl.dev", Field::TlpCplDev),
+    ("pcie.tlp.cpl.fun", Field::TlpCplFun),
+    ("pcie.tlp.cpl.status", Field::TlpCplStatus),
+    (
+        "pcie.tlp.cpl.status_not_successful",
+        Field::TlpCplStatusNotSuccessful,
+    ),
+    ("pcie.tlp.cpl.bcm", Field::TlpCplBcm),
+    ("pcie.tlp.cpl.byte_count", Field::TlpCplByteCount),
+    ("pcie.tlp.cpl.lower_addr", Field::TlpCplLowerAddr),
+    ("pcie.tlp.ecrc", Field::TlpEcrc),
+    ("pcie.tlp.ecrc_invalid", Field::TlpEcrcInvalid),
+];
+
+impl Field {
+    pub fn from_name(name: &str) -> Option<Self> {
+        FIELDS.iter().find(|(n, _)| *n == name).map(|(_, f)| *f)
+    }
+
+    pub fn name(self) -> &'static str {
+        FIELDS.iter().find(|(_, f)| *f == self).unwrap().0
+    }
+
+    pub fn value(self, record_view: &RecordView) -> Option<u64> {
+        let record = &record_view.record;
+        let flags: u64 = record.flags.into();
+        let flag = |mask: u32| Some(<bool as Into<u64>>::into(record.flags & mask != 0));
+
+        match self {
+            Self::Record => Some(record.number.into()),
+            Self::TimestampNs => Some(record.timestamp_ns),
+            Self::Flags => Some(flags),
+            Self::Gap => flag(FLAG_GAP),
+            Self::Scrambled => flag(FLAG_SCRAMBLED),
+            Self::Direction => flag(FLAG_UPSTREAM),
+            Self::ElectricalIdle => Some((flags & u64::from(FLAGS_ELECTRICAL_IDLE_MASK)) >> 12),
+            Self::DisparityError => flag(FLAG_DISPARITY_ERROR),
+            Self::ChannelBonded => flag(FLAG_CHANNEL_BONDED),
+            Self::LinkSpeed => Some((flags >> 8) & 0b11),
+            Self::StartLane => Some((flags & u64::from(FLAGS_START_LANE_MASK)) >> 4),
+            Self::SymbolError => flag(FLAG_SYMBOL_ERROR),
+            Self::LinkWidth => Some(flags & u64::from(FLAGS_LINK_WIDTH_MASK)),
+            Self::Lfsr => Some(record.lfsr.into()),
+            Self::MetadataInfo => Some(
+                u64::from(record.extra_metadata_present) << 15 | u64::from(record.metadata_offset),
+            ),
+            Self::MetadataOffset => Some(record.metadata_offset.into()),
+            Self::ExtraMetadataPresent => Some(record.extra_metadata_present.into()),
+            _ => self.frame_value(&record_view.frame()?),
+        }
+    }
+
+    fn frame_value(self, frame: &Frame) -> Option<u64> {
+        match (self, frame) {
+            (Self::Frame, _) => Some(1),
+            (Self::FrameStartTag, _) => Some(frame.start_tag().into()),
+            (Self::FrameEndTag, Frame::Tlp(tlp_frame)) => tlp_frame.end_tag().map(Into::into),
+            (Self::FrameEndTag, Frame::Dllp(dllp_frame)) => dllp_frame.end_tag().map(Into::into),
+            (Self::TlpSeq, Frame::Tlp(tlp_frame)) => tlp_frame.seq().map(Into::into),
+            (Self::TlpLcrc, Frame::Tlp(tlp_frame)) => tlp_frame.lcrc().map(Into::into),
+            (Self::FrameEndTagInvalid, Frame::Tlp(tlp_frame)) => {
+                expert(tlp_frame.end_tag().is_some_and(|tag| tag != K_29_7))
+            }
+            (Self::FrameEndTagInvalid, Frame::Dllp(dllp_frame)) => {
+                expert(dllp_frame.end_tag().is_some_and(|tag| tag != K_29_7))
+            }
+            (Self::TlpLcrcInvalid, Frame::Tlp(tlp_frame)) => {
+                expert(tlp_frame.lcrc_is_valid() == Some(false))
+            }
+            (Self::Tlp, Frame::Tlp(_)) => Some(1),
+            (_, Frame::Tlp(tlp_frame)) => self.tlp_value(&tlp_frame.tlp()?),
+            (Self::Dllp, Frame::Dllp(_)) => Some(1),
+            (_, Frame::Dllp(dllp_frame)) => self.dllp_value(&dllp_frame.dllp()),
+            (_, Frame::OrderedSet(os)) => self.ordered_set_value(os),
+            _ => None,
+        }
+    }
+
+    fn ordered_set_value(self, os: &OrderedSet) -> Option<u64> {
+        match self {
+            Self::OrderedSetType => os.type_symbol(),
+            Self::TsLinkNumber => os.link_number(),
+            Self::TsLaneNumber => os.lane_number(),
+            Self::TsNFts => os.n_fts(),
+            Self::TsDataRate => os.data_rate(),
+            Self::TsTrainingControl => os.training_control(),
+            _ => None,
+        }
+        .map(Into::into)
+    }
+
+    fn dllp_value(self, dllp: &Dllp) -> Option<u64> {
+        match self {
+            Self::DllpType => Some(dllp.dllp_type().into()),
+            Self::DllpAckNakSeq => dllp.ack_nak_seq().map(Into::into),
+            Self::DllpHdrScale => dllp.flow_control().map(|fc| fc.hdr_scale.into()),
+            Self::DllpHdrFc => dllp.flow_control().map(|fc| fc.hdr_fc.into()),
+            Self::DllpDataScale => dllp.flow_control().map(|fc| fc.data_scale.into()),
+            Self::DllpDataFc => dllp.flow_control().map(|fc| fc.data_fc.into()),
+            Self::DllpCrc => Some(dllp.crc().into()),
+            Self::DllpCrcInvalid => expert(!dllp.crc_is_valid()),
+            _ => None,
+        }
+    }
+
+    fn tlp_value(self, tlp: &Tlp) -> Option<u64> {
+        let attr = tlp.attr();
+
+        match self {
+            Self::TlpFmtType => Some(tlp.fmt_type().into()),
+            Self::TlpFmt => Some(tlp.fmt().into()),
+            Self::TlpType => Some(tlp.tlp_type().into()),
+            Self::TlpT9 => tlp.tag().map(|tag| (tag >> 9).into()),
+            Self::TlpTc => Some(tlp.traffic_class().into()),
+            Self::TlpT8 => tlp.tag().map(|tag| ((tag >> 8) & 1).into()),
+            Self::TlpAttr2 => Some((attr >> 2).into()),
+            Self::TlpLn => Some(tlp.lightweight_notification().into()),
+            Self::TlpTh => Some(tlp.tlp_hints().into()),
+            Self::TlpTd => Some(tlp.tlp_digest().into()),
+            Self::TlpEp => Some(tlp.error_poisoned().into()),
+            Self::TlpAttr10 => Some((attr & 0b11).into()),
+            Self::TlpAt => Some(tlp.address_type().into()),
+            Self::TlpLen => Some(tlp.length_field().into()),
+            Self::TlpFirstDwBe => tlp.first_dw_be().map(Into::into),
+            Self::TlpLastDwBe => tlp.last_dw_be().map(Into::into),
+            Self::TlpAddr => tlp.address(),
+            Self::TlpPh => tlp.processing_hint().map(Into::into),
+            Self::TlpReg => tlp.register().map(|reg| (reg >> 2).into()),
+            Self::TlpMsgCode => tlp.message_code().map(Into::into),
+            Self::TlpCplStatus => tlp.completion_status().map(Into::into),
+            Self::TlpCplStatusNotSuccessful => {
+                expert(tlp.completion_status().is_some_and(|status| status != 0))
+            }
+            Self::TlpCplBcm => tlp.byte_count_modified().map(Into::into),
+            Self::TlpCplByteCount => tlp.byte_count().map(Into::into),
+            Self::TlpCplLowerAddr => tlp.lower_address().map(Into::into),
+            Self::TlpEcrc => tlp.ecrc().map(Into::into),
+            Self::TlpEcrcInvalid => expert(tlp.ecrc_is_valid() == Some(false)),
+            _ => self.id_value(tlp.requester_id(), tlp.tag(), tlp.completer_id()),
+        }
+    }
+
+    /* The requester/completer ID and tag fields, which the index also holds. */
+    fn id_value(
+        self,
+        requester_id: Option<u16>,
+        tag: Option<u16>,
+        completer_id: Option<u16>,
+    ) -> Option<u64> {
+        match self {
+            Self::TlpReq => requester_id,
+            Self::TlpReqBus => requester_id.map(|id| id >> 8),
+            Self::TlpReqDev => requester_id.map(|id| (id >> 3) & 0x1F),
+            Self::TlpReqFun => requester_id.map(|id| id & 0x7),
+            Self::TlpTag => tag,
+            Self::TlpTag70 => tag.map(|tag| tag & 0xFF),
+            Self::TlpCpl => completer_id,
+            Self::TlpCplBus => completer_id.map(|id| id >> 8),
+            Self::TlpCplDev => completer_id.map(|id| (id >> 3) & 0x1F),
+            Self::TlpCplFun => completer_id.map(|id| id & 0x7),
+            _ => None,
+        }
+        .map(Into::into)
+    }
+
+    /*
+     * Returns the field's value for an indexed record, or None if the index
+     * doesn't hold the field.
+     */
+    pub fn entry_value(self, number: u32, entry: &IndexEntry) -> Option<Option<u64>> {
+        let flag = |mask: u8| Some(<bool as Into<u64>>::into(entry.flags & mask != 0));
+        let fmt_type = match entry.class == CLASS_TLP && entry.flags & ENTRY_TRUNCATED == 0 {
+            true => Some(entry.kind),
+            false => None,
+        };
+
+        Some(match self {
+            Self::Record => Some(number.into()),
+            Self::Direction => flag(ENTRY_UPSTREAM),
+            Self::SymbolError => flag(ENTRY_SYMBOL_ERROR),
+            Self::DisparityError => flag(ENTRY_DISPARITY_ERROR),
+            Self::Dllp => (entry.class == CLASS_DLLP).then_some(1),
+            Self::DllpType => (entry.class == CLASS_DLLP).then_some(entry.kind.into()),
+            Self::Tlp => (entry.class == CLASS_TLP).then_some(1),
+            Self::TlpFmtType => fmt_type.map(Into::into),
+            Self::TlpFmt => fmt_type.map(|ft| (ft >> 5).into()),
+            Self::TlpType => fmt_type.map(|ft| (ft & 0x1F).into()),
+            Self::TlpT9 => entry.tag().map(|tag| (tag >> 9).into()),
+            Self::TlpT8 => entry.tag().map(|tag| ((tag >> 8) & 1).into()),
+            Self::TlpAddr => entry.address(),
+            Self::TlpCplStatus => fmt_type
+                .filter(|ft| TlpKind::from_fmt_type(*ft).is_completion())
+                .and(entry.detail())
+                .map(Into::into),
+            Self::TlpCplStatusNotSuccessful => expert(
+                fmt_type
+                    .filter(|ft| TlpKind::from_fmt_type(*ft).is_completion())
+                    .and(entry.detail())
+                    .is_some_and(|status| status != 0),
+            ),
+            Self::TlpMsgCode => fmt_type
+                .filter(|ft| TlpKind::from_fmt_type(*ft) == TlpKind::Message)
+                .and(entry.detail())
+                .map(Into::into),
+            Self::TlpReq
+            | Self::TlpReqBus
+            | Self::TlpReqDev
+            | Self::TlpReqFun
+            | Self::TlpTag
+            | Self::TlpTag70
+            | Self::TlpCpl
+            | Self::TlpCplBus
+            | Self::TlpCplDev
+            | Self::TlpCplFun => {
+                self.id_value(entry.requester_id(), entry.tag(), entry.completer_id())
+            }
+            _ => return None,
+        })
+    }
+
+    pub fn is_indexed(self) -> bool {
+        self.entry_value(0, &IndexEntry::default()).is_some()
+    }
+
+    /* The index class of the records that have the field, if only one class does. */
+    pub fn index_class(self) -> Option<u8> {
+        let name = self.name();
+        if name.starts_with("pcie.tlp") || name.starts_with("pcie.frame.tlp") {
+            Some(CLASS_TLP)
+        } else if name.starts_with("pcie.dllp") {
+            Some(CLASS_DLLP)
+        } else if name.starts_with("pcie.frame.ordered_set") {
+            Some(CLASS_ORDERED_SET)
+        } else {
+            None
+        }
+    }
+}
+
+/* An expert info field, which is only present if its check failed. */
+fn expert(failed: bool) -> Option<u64> {
+    failed.then_some(1)
+}
+
+/* Something that filter fields can be read from. */
+pub trait FieldSource {
+    fn value(&self, field: Field) -> Option<u64>;
+}
+
+impl FieldSource for RecordView<'_> {
+    fn value(&self, field: Field) -> Option<u64> {
+        field.value(self)
+    }
+}
+
+/* A record that's only known by its index entry. Fields the index doesn't hold are absent. */
+#[derive(Debug, Clone, Copy)]
+pub struct IndexedRecord {
+    pub number: u32,
+    pub entry: IndexEntry,
+}
+
+impl FieldSource for IndexedRecord {
+    fn value(&self, field: Field) -> Option<u64> {
+        field.entry_value(self.number, &self.entry).flatten()
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct FilterError {
+    pub position: usize,
+    pub message: String,
+}
+
+impl fmt::Display for FilterError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "{} at position {}", self.message, self.position)
+    }
+}
+
+impl std::error::Error for FilterError {}
+
+/*
+ * A condition that every record a filter matches meets: the field is present,
+ * with a value in one of the ranges. Queries use these to skip records.
+ */
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Constraint {
+    pub field: Field,
+    pub ranges: Vec<RangeInclusive<u64>>,
+}
+
+impl Constraint {
+    fn present(field: Field) -> Self {
+        Self {
+            field,
+            ranges: vec![0..=u64::MAX],
+        }
+    }
+
+    pub fn admits(&self, value: Option<u64>) -> bool {
+        value.is_some_and(|v| self.ranges.iter().any(|r| r.contains(&v)))
+    }
+
+    /* True if the constraint only requires the field to be present. */
+    pub fn is_presence(&self) -> bool {
+        self.ranges == [0..=u64::MAX]
+    }
+
+    /* Returns every value the constraint admits, if there are no more than limit. */
+    pub fn values(&self, limit: u64) -> Option<Vec<u64>> {
+        let mut count: u64 = 0;
+        for range in self.ranges.iter() {
+            count = count.checked_add((range.end() - range.start()).checked_add(1)?)?;
+            if count > limit {
+                return None;
+            }
+        }
+
+        Some(self.ranges.iter().cloned().flatten().collect())
+    }
+
+    /* The constraint that either of two constraints on the same field meets. */
+    fn union(&self, other: &Self) -> Self {
+        let mut ranges: Vec<RangeInclusive<u64>> = self
+            .ranges
+            .iter()
+            .chain(other.ranges.iter())
+            .filter(|r| !r.is_empty())
+            .cloned()
+            .collect();
+        ranges.sort_by_key(|r| *r.start());
+
+        let mut merged: Vec<RangeInclusive<u64>> = Vec::with_capacity(ranges.len());
+        for range in ranges {
+            match merged.last_mut() {
+                Some(last) if range.start().saturating_sub(1) <= *last.end() => {
+                    *last = *last.start()..=*last.end().max(range.end());
+                }
+                _ => merged.push(range),
+            }
+        }
+
+        Self {
+            field: self.field,
+            ranges: merged,
+        }
+    }
+}
+
+type Predicate = Box<dyn Fn(&dyn FieldSource) -> bool + Send + Sync>;
+
+/* A compiled subexpression and the constraints that it implies. */
+type Compiled = (Predicate, Vec<Constraint>);
+
+pub struct Filter {
+    expression: String,
+    fields: Vec<Field>,
+    constraints: Vec<Constraint>,
+    predicate: Predicate,
+}
+
+impl fmt::Debug for Filter {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("Filter")
+            .field("expression", &self.expression)
+            .field("fields", &self.fields)
+            .field("constraints", &self.constraints)
+            .finish()
+    }
+}
+
+impl Filter {
+    pub fn compile(expression: &str) -> Result<Self, FilterError> {
+        let mut parser = Parser {
+            tokens: tokenize(expression)?,
+            position: 0,
+            end: expression.len(),
+            fields: Vec::new(),
+        };
+
+        let (predicate, constraints) = parser.parse_or()?;
+        if let Some((position, token)) = parser.tokens.get(parser.position) {
+            return Err(FilterError {
+                position: *position,
+                message: format!("unexpected {:?}", token),
+            });
+        }
+
+        Ok(Self {
+            expression: expression.to_string(),
+            fields: parser.fields,
+            constraints,
+            predicate,
+        })
+    }
+
+    pub fn expression(&self) -> &str {
+        &self.expression
+    }
+
+    /* The fields the filter reads, without duplicates. */
+    pub fn fields(&self) -> &[Field] {
+        &self.fields
+    }
+
+    /*
+     * Conditions that every matching record meets. They don't describe the
+     * whole filter, e.g. there are none for a filter that's a negation.
+     */
+    pub fn constraints(&self) -> &[Constraint] {
+        &self.constraints
+    }
+
+    /* True if the filter can be evaluated from index entries alone. */
+    pub fn is_indexed(&self) -> bool {
+        self.fields.iter().all(|f| f.is_indexed())
+    }
+
+    pub fn matches(&self, source: &dyn FieldSource) -> bool {
+        (self.predicate)(source)
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+enum Token {
+    Word(String),
+    Symbol(&'static str),
+}
+
+const SYMBOLS: &[&str] = &[
+    "==", "!=", "<=", ">=", "&&", "||", "<", ">", "!", "&", "(", ")", "{", "}", ",",
+];
+
+fn tokenize(expression: &str) -> Result<Vec<(usize, Token)>, FilterError> {
+    let mut tokens = Vec::new();
+    let mut position = 0;
+
+    while position < expression.len() {
+        let rest = &expression[position..];
+        let c = rest.chars().next().unwrap();
+
+        if c.is_whitespace() {
+            position += c.len_utf8();
+        } else if let Some(symbol) = SYMBOLS.iter().find(|s| rest.starts_with(**s)) {
+            tokens.push((position, Token::Symbol(symbol)));
+            position += symbol.len();
+        } else if c.is_ascii_alphanumeric() || c == '_' || c == '.' || c == ':' {
+            let len = rest
+                .find(|c: char| !(c.is_ascii_alphanumeric() || c == '_' || c == '.' || c == ':'))
+                .unwrap_or(rest.len());
+            tokens.push((position, Token::Word(rest[..len].to_string())));
+            position += len;
+        } else {
+            return Err(FilterError {
+                position,
+                message: format!("unexpected character {:?}", c),
+            });
+        }
+    }
+
+    Ok(tokens)
+}
+
+/* Parses an integer, true/false, or a bus:device.function ID. */
+fn parse_value(word: &str) -> Option<u64> {
+    if let Some((bus, dev_fun)) = word.split_once(':') {
+        let (dev, fun) = dev_fun.split_once('.')?;
+        let bus = u64::from_str_radix(bus, 16).ok().filter(|b| *b <= 0xFF)?;
+        let dev = u64::from_str_radix(dev, 16).ok().filter(|d| *d <= 0x1F)?;
+        let fun = u64::from_str_radix(fun, 16).ok().filter(|f| *f <= 0x7)?;
+        return Some(bus << 8 | dev << 3 | fun);
+    }
+
+    match word {
+        "true" => Some(1),
+        "false" => Some(0),
+        _ => match word.get(..2) {
+            Some("0x") | Some("0X") => u64::from_str_radix(&word[2..], 16).ok(),
+            Some("0b") | Some("0B") => u64::from_str_radix(&word[2..], 2).ok(),
+            _ => word.parse().ok(),
+        },
+    }
+}
+
+#[derive(Debug, Clone, Copy)]
+enum Relation {
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+}
+
+fn compare(field: Field, mask: u64, relation: Relation, value: u64) -> Predicate {
+    let get = move |source: &dyn FieldSource| source.value(field).map(|v| v & mask);
+
+    match relation {
+        Relation::Eq => Box::new(move |s| get(s) == Some(value)),
+        Relation::Ne => Box::new(move |s| get(s).is_some_and(|v| v != value)),
+        Relation::Lt => Box::new(move |s| get(s).is_some_and(|v| v < value)),
+        Relation::Le => Box::new(move |s| get(s).is_some_and(|v| v <= value)),
+        Relation::Gt => Box::new(move |s| get(s).is_some_and(|v| v > value)),
+        Relation::Ge => Box::new(move |s| get(s).is_some_and(|v| v >= value)),
+    }
+}
+
+struct Parser {
+    tokens: Vec<(usize, Token)>,
+    position: usize,
+    end: usize,
+    fields: Vec<Field>,
+}
+
+impl Parser {
+    fn peek(&self) -> Option<&Token> {
+        self.tokens.get(self.position).map(|(_, t)| t)
+    }
+
+    fn error<T>(&self, message: &str) -> Result<T, FilterError> {
+        Err(FilterError {
+            position: self
+                .tokens
+                .get(self.position)
+                .map(|(p, _)| *p)
+                .unwrap_or(self.end),
+            message: message.to_string(),
+        })
+    }
+
+    /* Consumes the next token if it's the symbol or the word. */
+    fn accept(&mut self, symbol: &str, word: &str) -> bool {
+        let found = match self.peek() {
+            Some(Token::Symbol(s)) => *s == symbol,
+            Some(Token::Word(w)) => w == word,
+            None => false,
+        };
+        if found {
+            self.position += 1;
+        }
+        found
+    }
+
+    fn accept_symbol(&mut self, symbol: &str) -> bool {
+        self.accept(symbol, "")
+    }
+
+    fn word(&mut self, what: &str) -> Result<String, FilterError> {
+        match self.peek() {
+            Some(Token::Word(word)) => {
+                let word = word.clone();
+                self.position += 1;
+                Ok(word)
+            }
+            _ => self.error(&format!("expected {}", what)),
+        }
+    }
+
+    fn value(&mut self) -> Result<u64, FilterError> {
+        let word = self.word("a value")?;
+        match parse_value(&word) {
+            Some(value) => Ok(value),
+            None => {
+                self.position -= 1;
+                self.error(&format!("invalid value {:?}", word))
+            }
+        }
+    }
+
+    fn parse_or(&mut self) -> Result<Compiled, FilterError> {
+        let (mut predicate, mut constraints) = self.parse_and()?;
+        while self.accept("||", "or") {
+            let (rhs, rhs_constraints) = self.parse_and()?;
+            let lhs = predicate;
+            predicate = Box::new(move |s| lhs(s) || rhs(s));
+
+            /* Only fields that both sides constrain are still constrained. */
+            constraints = constraints
+                .iter()
+                .filter_map(|c| {
+                    let other = rhs_constraints.iter().find(|o| o.field == c.field)?;
+                    Some(c.union(other))
+                })
+                .collect();
+        }
+        Ok((predicate, constraints))
+    }
+
+    fn parse_and(&mut self) -> Result<Compiled, FilterError> {
+        let (mut predicate, mut constraints) = self.parse_not()?;
+        while self.accept("&&", "and") {
+            let (rhs, mut rhs_constraints) = self.parse_not()?;
+            let lhs = predicate;
+            predicate = Box::new(move |s| lhs(s) && rhs(s));
+            constraints.append(&mut rhs_constraints);
+        }
+        Ok((predicate, constraints))
+    }
+
+    fn parse_not(&mut self) -> Result<Compiled, FilterError> {
+        if self.accept("!", "not") {
+            let (inner, _) = self.parse_not()?;
+            return Ok((Box::new(move |s| !inner(s)), Vec::new()));
+        }
+
+        if self.accept_symbol("(") {
+            let inner = self.parse_or()?;
+            if !self.accept_symbol(")") {
+                return self.error("expected \")\"");
+            }
+            return Ok(inner);
+        }
+
+        self.parse_test()
+    }
+
+    fn parse_test(&mut self) -> Result<Compiled, FilterError> {
+        let name = self.word("a field name")?;
+        let field = match Field::from_name(&name) {
+            Some(field) => field,
+            None => {
+                self.position -= 1;
+                return self.error(&format!("unknown field {:?}", name));
+            }
+        };
+        if !self.fields.contains(&field) {
+            self.fields.push(field);
+        }
+
+        let mask = match self.accept_symbol("&") {
+            true => Some(self.value()?),
+            false => None,
+        };
+
+        let relation = match self.peek() {
+            Some(Token::Symbol("==")) => Some(Relation::Eq),
+            Some(Token::Symbol("!=")) => Some(Relation::Ne),
+            Some(Token::Symbol("<")) => Some(Relation::Lt),
+            Some(Token::Symbol("<=")) => Some(Relation::Le),
+            Some(Token::Symbol(">")) => Some(Relation::Gt),
+            Some(Token::Symbol(">=")) => Some(Relation::Ge),
+            Some(Token::Word(word)) => match word.as_str() {
+                "eq" => Some(Relation::Eq),
+                "ne" => Some(Relation::Ne),
+                "lt" => Some(Relation::Lt),
+                "le" => Some(Relation::Le),
+                "gt" => Some(Relation::Gt),
+                "ge" => Some(Relation::Ge),
+                _ => None,
+            },
+            _ => None,
+        };
+
+        /* A masked value says nothing about the field's value, only that it's present. */
+        let mut constraint = Constraint::present(field);
+
+        if let Some(relation) = relation {
+            self.position += 1;
+            let value = self.value()?;
+            if mask.is_none() {
+                constraint.ranges = match relation {
+                    Relation::Eq => vec![value..=value],
+                    Relation::Ne => vec![0..=u64::MAX],
+                    Relation::Lt => value.checked_sub(1).map(|v| 0..=v).into_iter().collect(),
+                    Relation::Le => vec![0..=value],
+                    Relation::Gt => value
+                        .checked_add(1)
+                        .map(|v| v..=u64::MAX)
+                        .into_iter()
+                        .collect(),
+                    Relation::Ge => vec![value..=u64::MAX],
+                };
+            }
+            return Ok((
+                compare(field, mask.unwrap_or(u64::MAX), relation, value),
+                vec![constraint],
+            ));
+        }
+
+        if self.accept("", "in") {
+            let set = self.parse_set()?;
+            if mask.is_none() {
+                constraint = set.iter().fold(
+                    Constraint {
+                        field,
+                        ranges: Vec::new(),
+                    },
+                    |c, (lo, hi)| {
+                        c.union(&Constraint {
+                            field,
+                            ranges: vec![*lo..=*hi],
+                        })
+                    },
+                );
+            }
+            let mask = mask.unwrap_or(u64::MAX);
+            return Ok((
+                Box::new(move |s| {
+                    s.value(field).is_some_and(|v| {
+                        set.iter().any(|(lo, hi)| (*lo..=*hi).contains(&(v & mask)))
+                    })
+                }),
+                vec![constraint],
+            ));
+        }
+
+        let predicate: Predicate = match mask {
+            Some(mask) => Box::new(move |s| s.value(field).is_some_and(|v| v & mask != 0)),
+            None => Box::new(move |s| s.value(field).is_some()),
+        };
+        Ok((predicate, vec![constraint]))
+    }
+
+    /* Parses "{a b c..d}" into inclusive ranges. */
+    fn parse_set(&mut self) -> Result<Vec<(u64, u64)>, FilterError> {
+        if !self.accept_symbol("{") {
+            return self.error("expected \"{\"");
+        }
+
+        let mut set = Vec::new();
+        while !self.accept_symbol("}") {
+            if self.accept_symbol(",") {
+                continue;
+            }
+
+            let word = self.word("a value")?;
+            let (lo, hi) = match word.split_once("..") {
+                Some((lo, "")) => (lo.to_string(), self.word("a value")?),
+                Some((lo, hi)) => (lo.to_string(), hi.to_string()),
+                None if matches!(self.peek(), Some(Token::Word(w)) if w == "..") => {
+                    self.position += 1;
+                    (word, self.word("a value")?)
+                }
+                None => (word.clone(), word),
+            };
+
+            match (parse_value(&lo), parse_value(&hi)) {
+                (Some(lo), Some(hi)) => set.push((lo, hi)),
+                _ => {
+                    self.position -= 1;
+                    return self.error(&format!("invalid range {:?}..{:?}", lo, hi));
+                }
+            }
+        }
+
+        Ok(set)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    struct Values<'a>(&'a [(Field, u64)]);
+
+    impl FieldSource for Values<'_> {
+        fn value(&self, field: Field) -> Option<u64> {
+            self.0.iter().find(|(f, _)| *f == field).map(|(_, v)| *v)
+        }
+    }
+
+    fn error_at(expression: &str) -> usize {
+        Filter::compile(expression).unwrap_err().position
+    }
+
+    fn constraints(expression: &str) -> Vec<Constraint> {
+        Filter::compile(expression).unwrap().constraints().to_vec()
+    }
+
+    #[test]
+    fn parse_errors() {
+        assert_eq!(error_at("pcie.nope"), 0);
+        assert_eq!(error_at("pcie.tlp.len =="), 15);
+        assert_eq!(error_at("pcie.tlp.len == 0xzz"), 16);
+        assert_eq!(error_at("(pcie.tlp.len == 1"), 18);
+        assert_eq!(error_at("pcie.tlp.len == 1 pcie.tlp"), 18);
+        assert_eq!(error_at("pcie.tlp.len == $"), 16);
+        assert_eq!(error_at("pcie.tlp.req == 100:00.0"), 16);
+        assert_eq!(error_at("pcie.tlp.len in {1..}"), 20);
+        assert_eq!(error_at(""), 0);
+    }
+
+    #[test]
+    fn precedence() {
+        /* && binds tighter than ||, so this is a || (b && c). */
+        let filter =
+            Filter::compile("pcie.tlp.len == 1 || pcie.tlp.len == 2 && pcie.tlp.fmt_type == 0")
+                .unwrap();
+        assert!(filter.matches(&Values(&[(Field::TlpLen, 1)])));
+        assert!(!filter.matches(&Values(&[(Field::TlpLen, 2)])));
+
+        /* ! binds tighter than &&, so this is (!a) && b. */
+        let filter = Filter::compile("!pcie.tlp.len == 1 && pcie.tlp.fmt_type == 0").unwrap();
+        assert!(!filter.matches(&Values(&[(Field::TlpLen, 1), (Field::TlpFmtType, 1)])));
+        assert!(filter.matches(&Values(&[(Field::TlpLen, 2), (Field::TlpFmtType, 0)])));
+
+        let filter =
+            Filter::compile("(pcie.tlp.len == 1 || pcie.tlp.len == 2) and pcie.tlp.fmt_type == 0")
+                .unwrap();
+        assert!(!filter.matches(&Values(&[(Field::TlpLen, 1)])));
+        assert!(filter.matches(&Values(&[(Field::TlpLen, 2), (Field::TlpFmtType, 0)])));
+    }
+
+    #[test]
+    fn absent_fields_never_match_comparisons() {
+        let filter = Filter::compile("pcie.tlp.len != 1").unwrap();
+        assert!(!filter.matches(&Values(&[])));
+        assert!(filter.matches(&Values(&[(Field::TlpLen, 2)])));
+
+        let filter = Filter::compile("pcie.tlp.req == 03:00.1").unwrap();
+        assert!(filter.matches(&Values(&[(Field::TlpReq, 0x0301)])));
+    }
+
+    #[test]
+    fn constraints_under_and() {
+        assert_eq!(
+            constraints("pcie.tlp.len >= 4 && pcie.tlp.fmt_type == 0x40"),
+            vec![
+                Constraint {
+                    field: Field::TlpLen,
+                    ranges: vec![4..=u64::MAX],
+                },
+                Constraint {
+                    field: Field::TlpFmtType,
+                    ranges: vec![0x40..=0x40],
+                },
+            ]
+        );
+    }
+
+    #[test]
+    fn constraints_under_or() {
+        assert_eq!(
+            constraints("pcie.tlp.len == 1 || pcie.tlp.len in {3..5 9}"),
+            vec![Constraint {
+                field: Field::TlpLen,
+                ranges: vec![1..=1, 3..=5, 9..=9],
+            }]
+        );
+
+        /* Adjacent and overlapping ranges are merged. */
+        assert_eq!(
+            constraints("pcie.tlp.len <= 4 || pcie.tlp.len in {5..8 7}"),
+            vec![Constraint {
+                field: Field::TlpLen,
+                ranges: vec![0..=8],
+            }]
+        );
+
+        /* A field that only one side constrains isn't constrained. */
+        assert_eq!(
+            constraints("pcie.tlp.len == 1 || pcie.tlp.fmt_type == 0"),
+            vec![]
+        );
+        assert_eq!(
+            constraints("pcie.tlp.len == 1 && pcie.tlp.fmt_type == 0 || pcie.tlp.len == 2"),
+            vec![Constraint {
+                field: Field::TlpLen,
+                ranges: vec![1..=2],
+            }]
+        );
+    }
+
+    #[test]
+    fn constraints_under_not_and_masks() {
+        assert_eq!(constraints("!pcie.tlp.len == 1"), vec![]);
+        assert_eq!(
+            constraints("!(pcie.tlp.len == 1 && pcie.tlp.fmt_type == 0)"),
+            vec![]
+        );
+        assert_eq!(
+            constraints("pcie.tlp.len == 1 && !pcie.tlp.fmt_type == 0"),
+            vec![Constraint {
+                field: Field::TlpLen,
+                ranges: vec![1..=1],
+            }]
+        );
+
+        let masked = constraints("pcie.tlp.fmt_type & 0x40 == 0x40");
+        assert_eq!(masked.len(), 1);
+        assert!(masked[0].is_presence());
+        assert!(constraints("pcie.tlp.len != 3")[0].is_presence());
+    }
+
+    #[test]
+    fn constraints_admit_every_match() {
+        let expressions = [
+            "pcie.tlp.len < 3 || pcie.tlp.len > 60",
+            "pcie.tlp.len in {0 2..4} && pcie.tlp.len != 3",
+            "!(pcie.tlp.len == 5) && pcie.tlp.len <= 8",
+            "pcie.tlp.len & 1 || pcie.tlp.len == 0",
+        ];
+        for expression in expressions {
+            let filter = Filter::compile(expression).unwrap();
+            for len in 0..=64 {
+                let values = [(Field::TlpLen, len)];
+                let source = Values(&values);
+                if filter.matches(&source) {
+                    for constraint in filter.constraints() {
+                        assert!(
+                            constraint.admits(source.value(constraint.field)),
+                            "{:?} excludes {} from {:?}",
+                            constraint,
+                            len,
+                            expression
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn constraint_values() {
+        assert_eq!(
+            constraints("pcie.tlp.len in {1..3 7}")[0].values(4),
+            Some(vec![1, 2, 3, 7])
+        );
+        assert_eq!(constraints("pcie.tlp.len in {1..3 7}")[0].values(3), None);
+        assert_eq!(constraints("pcie.tlp.len < 0")[0].values(4), Some(vec![]));
+        assert_eq!(constraints("pcie.tlp.len >= 0")[0].values(u64::MAX), None);
+    }
+}
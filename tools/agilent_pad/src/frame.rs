@@ -0,0 +1,1108 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/frame.rs - Zero-copy views of PCIe frames in record data.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The views in this module mirror the frame, DLLP and TLP dissectors in
+ * wireshark/proto_pcie.c. Parsing a frame only looks at its start tag, and
+ * every field is read from the borrowed record data when it is asked for, so
+ * nothing is decoded or copied that isn't used.
+ */
+
+/* 8b/10b control symbols */
+pub const K_28_0: u8 = 0x1C; /* SKP */
+pub const K_28_1: u8 = 0x3C; /* FTS */
+pub const K_28_2: u8 = 0x5C; /* SDP */
+pub const K_28_3: u8 = 0x7C; /* IDL */
+pub const K_28_5: u8 = 0xBC; /* COM */
+pub const K_28_7: u8 = 0xFC; /* EIE */
+pub const K_27_7: u8 = 0xFB; /* STP */
+pub const K_29_7: u8 = 0xFD; /* END */
+pub const K_30_7: u8 = 0xFE; /* EDB */
+
+const CRC32_TABLE: [u32; 256] = {
+    let mut table = [0; 256];
+    let mut i = 0;
+    while i < 256 {
+        let mut crc = i as u32;
+        let mut bit = 0;
+        while bit < 8 {
+            crc = match crc & 1 {
+                1 => (crc >> 1) ^ 0xEDB88320,
+                _ => crc >> 1,
+            };
+            bit += 1;
+        }
+        table[i] = crc;
+        i += 1;
+    }
+    table
+};
+
+fn crc32_update(mut crc: u32, data: &[u8]) -> u32 {
+    for b in data {
+        crc = CRC32_TABLE[((crc ^ <u8 as Into<u32>>::into(*b)) & 0xFF) as usize] ^ (crc >> 8);
+    }
+    crc
+}
+
+fn crc32(data: &[u8]) -> u32 {
+    crc32_update(0xFFFFFFFF, data) ^ 0xFFFFFFFF
+}
+
+/* Port of dllp_crc() from proto_pcie.c */
+fn dllp_crc(data: &[u8]) -> u16 {
+    let mut crc: u16 = 0xFFFF;
+    for b in data {
+        for j in 0..8 {
+            let bit = <u8 as Into<u16>>::into((b >> j) & 1) ^ (crc >> 15);
+            crc = (crc << 1) | bit;
+            if bit != 0 {
+                crc ^= 0x100b & 0xfffe;
+            }
+        }
+    }
+    crc ^= 0xFFFF;
+
+    <u8 as Into<u16>>::into((crc as u8).reverse_bits()) << 8
+        | <u8 as Into<u16>>::into(((crc >> 8) as u8).reverse_bits())
+}
+
+fn be_u16(data: &[u8], offset: usize) -> u16 {
+    u16::from_be_bytes(data[offset..offset + 2].try_into().unwrap())
+}
+
+fn be_u32(data: &[u8], offset: usize) -> u32 {
+    u32::from_be_bytes(data[offset..offset + 4].try_into().unwrap())
+}
+
+fn le_u32_at(data: &[u8], offset: usize) -> Option<u32> {
+    Some(u32::from_le_bytes(
+        data.get(offset..offset + 4)?.try_into().unwrap(),
+    ))
+}
+
+#[derive(Debug, Clone, Copy)]
+pub enum Frame<'a> {
+    Tlp(TlpFrame<'a>),
+    Dllp(DllpFrame<'a>),
+    OrderedSet(OrderedSet<'a>),
+    Unknown(&'a [u8]),
+}
+
+impl<'a> Frame<'a> {
+    /* Takes the record data without metadata, which starts with the frame's start tag. */
+    pub fn parse(data: &'a [u8]) -> Option<Self> {
+        Some(match *data.first()? {
+            K_27_7 => Self::Tlp(TlpFrame { data }),
+            K_28_2 if data.len() >= 7 => Self::Dllp(DllpFrame { data }),
+            K_28_5 => Self::OrderedSet(OrderedSet { data }),
+            _ => Self::Unknown(data),
+        })
+    }
+
+    pub fn start_tag(&self) -> u8 {
+        self.as_bytes()[0]
+    }
+
+    pub fn as_bytes(&self) -> &'a [u8] {
+        match self {
+            Self::Tlp(frame) => frame.data,
+            Self::Dllp(frame) => frame.data,
+            Self::OrderedSet(os) => os.data,
+            Self::Unknown(data) => data,
+        }
+    }
+
+    pub fn tlp(&self) -> Option<Tlp<'a>> {
+        match self {
+            Self::Tlp(frame) => frame.tlp(),
+            _ => None,
+        }
+    }
+
+    /* The length of the TLP's framing and header, or of the whole frame if it isn't a TLP. */
+    pub fn header_len(&self) -> usize {
+        let len = self.as_bytes().len();
+
+        match self.tlp() {
+            Some(tlp) => (TlpFrame::TLP_OFFSET + tlp.header_len()).min(len),
+            None => len,
+        }
+    }
+
+    pub fn dllp(&self) -> Option<Dllp<'a>> {
+        match self {
+            Self::Dllp(frame) => Some(frame.dllp()),
+            _ => None,
+        }
+    }
+}
+
+/* A TLP framed by STP, a sequence number, the LCRC, and END. */
+#[derive(Debug, Clone, Copy)]
+pub struct TlpFrame<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> TlpFrame<'a> {
+    const TLP_OFFSET: usize = 3;
+
+    pub fn as_bytes(&self) -> &'a [u8] {
+        self.data
+    }
+
+    pub fn reserved(&self) -> Option<u16> {
+        Some(be_u16(self.data.get(..Self::TLP_OFFSET)?, 1) & 0xF000)
+    }
+
+    pub fn seq(&self) -> Option<u16> {
+        Some(be_u16(self.data.get(..Self::TLP_OFFSET)?, 1) & 0x0FFF)
+    }
+
+    fn tlp_len(&self) -> Option<usize> {
+        let dw0 = be_u32(self.data.get(..Self::TLP_OFFSET + 4)?, Self::TLP_OFFSET);
+
+        Some(Tlp::len_from_dw0(dw0))
+    }
+
+    /* Returns None if the frame is too short to hold the TLP it describes. */
+    pub fn tlp(&self) -> Option<Tlp<'a>> {
+        let end = Self::TLP_OFFSET + self.tlp_len()?;
+
+        Tlp::new(self.data.get(Self::TLP_OFFSET..end)?)
+    }
+
+    pub fn lcrc(&self) -> Option<u32> {
+        le_u32_at(self.data, Self::TLP_OFFSET + self.tlp_len()?)
+    }
+
+    /* The LCRC covers the sequence number and the TLP. */
+    pub fn lcrc_is_valid(&self) -> Option<bool> {
+        let lcrc_offset = Self::TLP_OFFSET + self.tlp_len()?;
+        let lcrc = self.lcrc()?;
+
+        Some(lcrc == crc32(&self.data[1..lcrc_offset]))
+    }
+
+    pub fn end_tag(&self) -> Option<u8> {
+        self.data
+            .get(Self::TLP_OFFSET + self.tlp_len()? + 4)
+            .copied()
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum TlpKind {
+    MemoryRead,
+    MemoryReadLocked,
+    MemoryWrite,
+    IoRead,
+    IoWrite,
+    ConfigRead,
+    ConfigWrite,
+    Message,
+    Completion,
+    CompletionLocked,
+    Other,
+}
+
+impl TlpKind {
+    pub fn from_fmt_type(fmt_type: u8) -> Self {
+        match fmt_type {
+            0b00000000 | 0b00100000 => TlpKind::MemoryRead,
+            0b00000001 | 0b00100001 => TlpKind::MemoryReadLocked,
+            0b01000000 | 0b01100000 => TlpKind::MemoryWrite,
+            0b00000010 => TlpKind::IoRead,
+            0b01000010 => TlpKind::IoWrite,
+            0b00000100 | 0b00000101 => TlpKind::ConfigRead,
+            0b01000100 | 0b01000101 => TlpKind::ConfigWrite,
+            0b00001010 | 0b01001010 => TlpKind::Completion,
+            0b00001011 | 0b01001011 => TlpKind::CompletionLocked,
+            _ if fmt_type & 0b10111000 == 0b00110000 => TlpKind::Message,
+            _ => TlpKind::Other,
+        }
+    }
+
+    pub fn is_completion(self) -> bool {
+        matches!(self, Self::Completion | Self::CompletionLocked)
+    }
+}
+
+/* The TLP itself: a 3 or 4 DW header, optional payload, and optional ECRC. */
+#[derive(Debug, Clone, Copy)]
+pub struct Tlp<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> Tlp<'a> {
+    fn len_from_dw0(dw0: u32) -> usize {
+        let fmt = dw0 >> 29;
+
+        let header_dw_count = 3 + (fmt & 0b001);
+        let payload_dw_count = match fmt & 0b010 {
+            0 => 0,
+            _ => Self::length_from_dw0(dw0),
+        };
+        let ecrc_dw_count = (dw0 >> 15) & 1;
+
+        (4 * (header_dw_count + payload_dw_count + ecrc_dw_count))
+            .try_into()
+            .unwrap()
+    }
+
+    fn length_from_dw0(dw0: u32) -> u32 {
+        match dw0 & ((1 << 10) - 1) {
+            0 => 1 << 10,
+            length => length,
+        }
+    }
+
+    /* Returns None if data is shorter than the TLP header. */
+    pub fn new(data: &'a [u8]) -> Option<Self> {
+        let fmt = data.first()? >> 5;
+        let header_len = 4 * (3 + usize::from(fmt & 0b001));
+
+        match data.len() >= header_len {
+            true => Some(Self { data }),
+            false => None,
+        }
+    }
+
+    pub fn as_bytes(&self) -> &'a [u8] {
+        self.data
+    }
+
+    fn dw0(&self) -> u32 {
+        be_u32(self.data, 0)
+    }
+
+    pub fn fmt_type(&self) -> u8 {
+        self.data[0]
+    }
+
+    pub fn fmt(&self) -> u8 {
+        self.fmt_type() >> 5
+    }
+
+    pub fn tlp_type(&self) -> u8 {
+        self.fmt_type() & 0x1F
+    }
+
+    pub fn has_prefix(&self) -> bool {
+        self.fmt() >= 0b100
+    }
+
+    pub fn has_data(&self) -> bool {
+        self.fmt() & 0b010 != 0
+    }
+
+    pub fn is_4dw_header(&self) -> bool {
+        self.fmt() & 0b001 != 0
+    }
+
+    pub fn header_len(&self) -> usize {
+        match self.is_4dw_header() {
+            true => 16,
+            false => 12,
+        }
+    }
+
+    pub fn traffic_class(&self) -> u8 {
+        ((self.dw0() >> 20) & 0b111) as u8
+    }
+
+    pub fn lightweight_notification(&self) -> bool {
+        self.dw0() & (1 << 17) != 0
+    }
+
+    pub fn tlp_hints(&self) -> bool {
+        self.dw0() & (1 << 16) != 0
+    }
+
+    pub fn tlp_digest(&self) -> bool {
+        self.dw0() & (1 << 15) != 0
+    }
+
+    pub fn error_poisoned(&self) -> bool {
+        self.dw0() & (1 << 14) != 0
+    }
+
+    /* Attr[2] followed by Attr[1:0] */
+    pub fn attr(&self) -> u8 {
+        (((self.dw0() >> 16) & 0b100) | ((self.dw0() >> 12) & 0b11)) as u8
+    }
+
+    pub fn address_type(&self) -> u8 {
+        ((self.dw0() >> 10) & 0b11) as u8
+    }
+
+    /* The raw Length field, where 0 means 1024 DW. */
+    pub fn length_field(&self) -> u16 {
+        (self.dw0() & 0x3FF) as u16
+    }
+
+    pub fn length_dw(&self) -> u32 {
+        Self::length_from_dw0(self.dw0())
+    }
+
+    pub fn kind(&self) -> TlpKind {
+        TlpKind::from_fmt_type(self.fmt_type())
+    }
+
+    /* Memory Writes and Messages, which are never completed. */
+    pub fn is_posted(&self) -> bool {
+        matches!(self.kind(), TlpKind::MemoryWrite | TlpKind::Message)
+    }
+
+    pub fn is_completion(&self) -> bool {
+        self.kind().is_completion()
+    }
+
+    pub fn is_request(&self) -> bool {
+        !matches!(
+            self.kind(),
+            TlpKind::Completion | TlpKind::CompletionLocked | TlpKind::Other
+        )
+    }
+
+    /* The ID of the requester, which completions carry in their third DW. */
+    pub fn requester_id(&self) -> Option<u16> {
+        match self.kind() {
+            TlpKind::Other => None,
+            TlpKind::Completion | TlpKind::CompletionLocked => Some(be_u16(self.data, 8)),
+            _ => Some(be_u16(self.data, 4)),
+        }
+    }
+
+    pub fn completer_id(&self) -> Option<u16> {
+        match self.kind() {
+            TlpKind::ConfigRead | TlpKind::ConfigWrite => Some(be_u16(self.data, 8)),
+            TlpKind::Completion | TlpKind::CompletionLocked => Some(be_u16(self.data, 4)),
+            _ => None,
+        }
+    }
+
+    /* The full 10-bit tag, including the T9 and T8 bits from DW0. */
+    pub fn tag(&self) -> Option<u16> {
+        let tag70: u16 = match self.kind() {
+            TlpKind::Other => return None,
+            TlpKind::Completion | TlpKind::CompletionLocked => self.data[10].into(),
+            _ => self.data[6].into(),
+        };
+        let tag98 = (((self.dw0() >> 22) & 0b10) | ((self.dw0() >> 19) & 0b01)) as u16;
+
+        Some(tag98 << 8 | tag70)
+    }
+
+    /* The requester ID and tag, which together match a completion to its request. */
+    pub fn transaction_id(&self) -> Option<u32> {
+        Some(
+            <u16 as Into<u32>>::into(self.tag()?) << 16
+                | <u16 as Into<u32>>::into(self.requester_id()?),
+        )
+    }
+
+    fn has_byte_enables(&self) -> bool {
+        matches!(
+            self.kind(),
+            TlpKind::MemoryRead
+                | TlpKind::MemoryReadLocked
+                | TlpKind::MemoryWrite
+                | TlpKind::IoRead
+                | TlpKind::IoWrite
+                | TlpKind::ConfigRead
+                | TlpKind::ConfigWrite
+        )
+    }
+
+    pub fn first_dw_be(&self) -> Option<u8> {
+        match self.has_byte_enables() {
+            true => Some(self.data[7] & 0x0F),
+            false => None,
+        }
+    }
+
+    pub fn last_dw_be(&self) -> Option<u8> {
+        match self.has_byte_enables() {
+            true => Some(self.data[7] >> 4),
+            false => None,
+        }
+    }
+
+    pub fn message_code(&self) -> Option<u8> {
+        match self.kind() {
+            TlpKind::Message => Some(self.data[7]),
+            _ => None,
+        }
+    }
+
+    /* The DW-aligned address of a memory or I/O request, without the processing hint bits. */
+    pub fn address(&self) -> Option<u64> {
+        match self.kind() {
+            TlpKind::MemoryRead | TlpKind::MemoryReadLocked | TlpKind::MemoryWrite => {
+                match self.is_4dw_header() {
+                    true => Some(
+                        u64::from_be_bytes(self.data[8..16].try_into().unwrap())
+                            & 0xFFFFFFFFFFFFFFFC,
+                    ),
+                    false => Some((be_u32(self.data, 8) & 0xFFFFFFFC).into()),
+                }
+            }
+            TlpKind::IoRead | TlpKind::IoWrite => Some(be_u32(self.data, 8).into()),
+            _ => None,
+        }
+    }
+
+    pub fn processing_hint(&self) -> Option<u8> {
+        match self.kind() {
+            TlpKind::MemoryRead | TlpKind::MemoryReadLocked | TlpKind::MemoryWrite => {
+                Some(self.data[self.header_len() - 1] & 0b11)
+            }
+            _ => None,
+        }
+    }
+
+    /* The byte offset of the configuration register, i.e. the register number times 4. */
+    pub fn register(&self) -> Option<u16> {
+        match self.kind() {
+            TlpKind::ConfigRead | TlpKind::ConfigWrite => Some(be_u16(self.data, 10) & 0x0FFC),
+            _ => None,
+        }
+    }
+
+    fn completion_dw1(&self) -> Option<u16> {
+        match self.is_completion() {
+            true => Some(be_u16(self.data, 6)),
+            false => None,
+        }
+    }
+
+    pub fn completion_status(&self) -> Option<u8> {
+        Some((self.completion_dw1()? >> 13) as u8)
+    }
+
+    pub fn byte_count_modified(&self) -> Option<bool> {
+        Some(self.completion_dw1()? & (1 << 12) != 0)
+    }
+
+    pub fn byte_count(&self) -> Option<u16> {
+        Some(self.completion_dw1()? & 0x0FFF)
+    }
+
+    pub fn lower_address(&self) -> Option<u8> {
+        match self.is_completion() {
+            true => Some(self.data[11] & 0x7F),
+            false => None,
+        }
+    }
+
+    fn payload_len(&self) -> usize {
+        match self.has_data() {
+            true => (4 * self.length_dw()).try_into().unwrap(),
+            false => 0,
+        }
+    }
+
+    /* Returns None if the TLP was cut short before the end of its payload. */
+    pub fn payload(&self) -> Option<&'a [u8]> {
+        let start = self.header_len();
+
+        self.data.get(start..start + self.payload_len())
+    }
+
+    pub fn ecrc(&self) -> Option<u32> {
+        match self.tlp_digest() {
+            true => le_u32_at(self.data, self.header_len() + self.payload_len()),
+            false => None,
+        }
+    }
+
+    /* The ECRC is calculated with the variant bits of DW0 (TD and the Type bit 0) set. */
+    pub fn ecrc_is_valid(&self) -> Option<bool> {
+        let ecrc = self.ecrc()?;
+        let ecrc_offset = self.header_len() + self.payload_len();
+
+        let modified_dw0 = (self.dw0() | 0x01004000).to_be_bytes();
+        let crc = crc32_update(0xFFFFFFFF, &modified_dw0);
+        let crc = crc32_update(crc, &self.data[4..ecrc_offset]) ^ 0xFFFFFFFF;
+
+        Some(ecrc == crc)
+    }
+}
+
+/* A DLLP framed by SDP and END. */
+#[derive(Debug, Clone, Copy)]
+pub struct DllpFrame<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> DllpFrame<'a> {
+    pub fn as_bytes(&self) -> &'a [u8] {
+        self.data
+    }
+
+    pub fn dllp(&self) -> Dllp<'a> {
+        Dllp {
+            data: self.data[1..7].try_into().unwrap(),
+        }
+    }
+
+    pub fn end_tag(&self) -> Option<u8> {
+        self.data.get(7).copied()
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FlowControl {
+    pub hdr_scale: u8,
+    pub hdr_fc: u8,
+    pub data_scale: u8,
+    pub data_fc: u16,
+}
+
+impl FlowControl {
+    fn scaled(value: u32, scale: u8) -> u32 {
+        match scale {
+            2 => value * 4,
+            3 => value * 16,
+            _ => value,
+        }
+    }
+
+    pub fn hdr_credits(&self) -> u32 {
+        Self::scaled(self.hdr_fc.into(), self.hdr_scale)
+    }
+
+    pub fn data_credits(&self) -> u32 {
+        Self::scaled(self.data_fc.into(), self.data_scale)
+    }
+}
+
+/* The six bytes of a DLLP: type, three bytes of type-specific fields, and CRC. */
+#[derive(Debug, Clone, Copy)]
+pub struct Dllp<'a> {
+    data: &'a [u8; 6],
+}
+
+impl<'a> Dllp<'a> {
+    pub const ACK: u8 = 0b00000000;
+    pub const NAK: u8 = 0b00010000;
+    pub const DATA_LINK_FEATURE: u8 = 0b00000010;
+
+    pub fn as_bytes(&self) -> &'a [u8; 6] {
+        self.data
+    }
+
+    pub fn dllp_type(&self) -> u8 {
+        self.data[0]
+    }
+
+    fn fields(&self) -> u32 {
+        u32::from_be_bytes([0, self.data[1], self.data[2], self.data[3]])
+    }
+
+    pub fn is_ack(&self) -> bool {
+        self.dllp_type() == Self::ACK
+    }
+
+    pub fn is_nak(&self) -> bool {
+        self.dllp_type() == Self::NAK
+    }
+
+    pub fn is_power_management(&self) -> bool {
+        self.dllp_type() & 0b11111000 == 0b00100000
+    }
+
+    pub fn ack_nak_seq(&self) -> Option<u16> {
+        match self.is_ack() || self.is_nak() {
+            true => Some((self.fields() & 0x000FFF) as u16),
+            false => None,
+        }
+    }
+
+    /* The fields of an InitFC1, InitFC2, or UpdateFC DLLP. */
+    pub fn flow_control(&self) -> Option<FlowControl> {
+        let dllp_type = self.dllp_type();
+        if dllp_type & 0b11000000 == 0
+            || dllp_type & 0b00110000 == 0b00110000
+            || dllp_type & 0b00001000 != 0
+        {
+            return None;
+        }
+
+        let fields = self.fields();
+        Some(FlowControl {
+            hdr_scale: ((fields >> 22) & 0b11) as u8,
+            hdr_fc: ((fields >> 14) & 0xFF) as u8,
+            data_scale: ((fields >> 12) & 0b11) as u8,
+            data_fc: (fields & 0x0FFF) as u16,
+        })
+    }
+
+    pub fn crc(&self) -> u16 {
+        u16::from_le_bytes([self.data[4], self.data[5]])
+    }
+
+    pub fn crc_is_valid(&self) -> bool {
+        self.crc() == dllp_crc(&self.data[..4])
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum OrderedSetKind {
+    Skp,
+    Fts,
+    ElectricalIdle,
+    ElectricalIdleExit,
+    Ts1,
+    Ts2,
+    Unknown,
+}
+
+/* An ordered set, which starts with COM. */
+#[derive(Debug, Clone, Copy)]
+pub struct OrderedSet<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> OrderedSet<'a> {
+    pub fn as_bytes(&self) -> &'a [u8] {
+        self.data
+    }
+
+    fn byte(&self, offset: usize) -> Option<u8> {
+        self.data.get(offset).copied()
+    }
+
+    fn repeats(&self, symbol: u8) -> bool {
+        self.data.get(1..4) == Some(&[symbol; 3])
+    }
+
+    pub fn kind(&self) -> OrderedSetKind {
+        match self.byte(1) {
+            Some(K_28_0) => OrderedSetKind::Skp,
+            _ if self.repeats(K_28_1) => OrderedSetKind::Fts,
+            _ if self.repeats(K_28_3) => OrderedSetKind::ElectricalIdle,
+            Some(K_28_7) => OrderedSetKind::ElectricalIdleExit,
+            _ => match self.byte(6) {
+                Some(0x4A) | Some(0xB5) => OrderedSetKind::Ts1,
+                Some(0x45) | Some(0xBA) => OrderedSetKind::Ts2,
+                _ => OrderedSetKind::Unknown,
+            },
+        }
+    }
+
+    /* The symbol that identifies the ordered set, as in pcie.frame.ordered_set.type */
+    pub fn type_symbol(&self) -> Option<u8> {
+        match self.kind() {
+            OrderedSetKind::Ts1 | OrderedSetKind::Ts2 => self.byte(6),
+            OrderedSetKind::Unknown => None,
+            _ => self.byte(1),
+        }
+    }
+
+    /* TS1/TS2 identifiers received with the lane's polarity inverted */
+    pub fn is_polarity_inverted(&self) -> bool {
+        matches!(self.kind(), OrderedSetKind::Ts1 | OrderedSetKind::Ts2)
+            && matches!(self.byte(6), Some(0xB5) | Some(0xBA))
+    }
+
+    /* Training sequence fields are only available if the polarity is not inverted. */
+    fn ts_byte(&self, offset: usize) -> Option<u8> {
+        match self.kind() {
+            OrderedSetKind::Ts1 | OrderedSetKind::Ts2 if !self.is_polarity_inverted() => {
+                self.byte(offset)
+            }
+            _ => None,
+        }
+    }
+
+    pub fn link_number(&self) -> Option<u8> {
+        self.ts_byte(1)
+    }
+
+    pub fn lane_number(&self) -> Option<u8> {
+        self.ts_byte(2)
+    }
+
+    pub fn n_fts(&self) -> Option<u8> {
+        self.ts_byte(3)
+    }
+
+    pub fn data_rate(&self) -> Option<u8> {
+        self.ts_byte(4)
+    }
+
+    pub fn training_control(&self) -> Option<u8> {
+        self.ts_byte(5)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /* PME_Turn_Off and PME_TO_Ack messages and DLLPs from a real capture */
+    const PME_TURN_OFF: [u8; 24] = [
+        0xfb, 0x00, 0x05, 0x33, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x19, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0xfa, 0x26, 0x06, 0x4b, 0xfd,
+    ];
+    const PME_TO_ACK: [u8; 24] = [
+        0xfb, 0x00, 0x04, 0x35, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1b, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0xdb, 0xac, 0xc7, 0xb1, 0xfd,
+    ];
+    const ACK_5: [u8; 8] = [0x5c, 0x00, 0x00, 0x00, 0x05, 0x96, 0x17, 0xfd];
+    const ACK_4: [u8; 8] = [0x5c, 0x00, 0x00, 0x00, 0x04, 0x37, 0x0c, 0xfd];
+    const UPDATE_FC_P: [u8; 8] = [0x5c, 0x80, 0x04, 0xc1, 0x80, 0xb7, 0x3a, 0xfd];
+    const PM_ENTER_L1: [u8; 8] = [0x5c, 0x21, 0x00, 0x00, 0x00, 0x10, 0x55, 0xfd];
+    const PM_REQUEST_ACK: [u8; 8] = [0x5c, 0x24, 0x00, 0x00, 0x00, 0x93, 0x0c, 0xfd];
+
+    /* A 64-bit Memory Write with two DW of payload and an ECRC, sequence number 0x123 */
+    const MEMORY_WRITE_64: [u8; 36] = [
+        0xfb, 0x01, 0x23, 0x60, 0x00, 0x80, 0x02, 0x01, 0x00, 0x05, 0xff, 0x00, 0x00, 0x00, 0x01,
+        0x23, 0x45, 0x67, 0x80, 0xde, 0xad, 0xbe, 0xef, 0x01, 0x02, 0x03, 0x04, 0x6e, 0x0e, 0x31,
+        0x6a, 0x51, 0x98, 0xd7, 0x2b, 0xfd,
+    ];
+
+    fn parse_tlp(frame: &[u8]) -> Tlp<'_> {
+        Frame::parse(frame).unwrap().tlp().unwrap()
+    }
+
+    fn parse_dllp(frame: &[u8]) -> Dllp<'_> {
+        Frame::parse(frame).unwrap().dllp().unwrap()
+    }
+
+    fn parse_ordered_set(data: &[u8]) -> OrderedSet<'_> {
+        match Frame::parse(data) {
+            Some(Frame::OrderedSet(os)) => os,
+            frame => panic!("not an ordered set: {:?}", frame),
+        }
+    }
+
+    #[test]
+    fn captured_messages() {
+        for (frame, seq, fmt_type, code) in
+            [(PME_TURN_OFF, 5, 0x33, 0x19), (PME_TO_ACK, 4, 0x35, 0x1b)]
+        {
+            let Frame::Tlp(tlp_frame) = Frame::parse(&frame).unwrap() else {
+                panic!("not a TLP");
+            };
+            assert_eq!(tlp_frame.seq(), Some(seq));
+            assert_eq!(tlp_frame.reserved(), Some(0));
+            assert_eq!(tlp_frame.lcrc_is_valid(), Some(true));
+            assert_eq!(tlp_frame.end_tag(), Some(K_29_7));
+
+            let tlp = tlp_frame.tlp().unwrap();
+            assert_eq!(tlp.fmt_type(), fmt_type);
+            assert_eq!(tlp.kind(), TlpKind::Message);
+            assert_eq!(tlp.message_code(), Some(code));
+            assert!(tlp.is_4dw_header());
+            assert!(!tlp.has_data());
+            assert!(tlp.is_posted());
+            assert_eq!(tlp.payload(), Some(&[][..]));
+            assert_eq!(tlp.ecrc(), None);
+            assert_eq!(tlp.address(), None);
+            assert_eq!(Frame::parse(&frame).unwrap().header_len(), 19);
+        }
+
+        let mut corrupt = PME_TURN_OFF;
+        corrupt[10] ^= 1;
+        let Frame::Tlp(tlp_frame) = Frame::parse(&corrupt).unwrap() else {
+            panic!("not a TLP");
+        };
+        assert_eq!(tlp_frame.lcrc_is_valid(), Some(false));
+    }
+
+    #[test]
+    fn captured_dllps() {
+        for (frame, seq) in [(ACK_5, 5), (ACK_4, 4)] {
+            assert!(parse_dllp(&frame).is_ack());
+            assert!(!parse_dllp(&frame).is_nak());
+            assert_eq!(parse_dllp(&frame).ack_nak_seq(), Some(seq));
+            assert_eq!(parse_dllp(&frame).flow_control(), None);
+            assert!(parse_dllp(&frame).crc_is_valid());
+        }
+
+        let update_fc = parse_dllp(&UPDATE_FC_P);
+        assert!(update_fc.crc_is_valid());
+        assert_eq!(update_fc.ack_nak_seq(), None);
+        assert_eq!(
+            update_fc.flow_control(),
+            Some(FlowControl {
+                hdr_scale: 0,
+                hdr_fc: 19,
+                data_scale: 0,
+                data_fc: 0x180,
+            })
+        );
+
+        for frame in [PM_ENTER_L1, PM_REQUEST_ACK] {
+            assert!(parse_dllp(&frame).is_power_management());
+            assert!(parse_dllp(&frame).crc_is_valid());
+            assert_eq!(parse_dllp(&frame).flow_control(), None);
+        }
+
+        let Frame::Dllp(dllp_frame) = Frame::parse(&ACK_5).unwrap() else {
+            panic!("not a DLLP");
+        };
+        assert_eq!(dllp_frame.end_tag(), Some(K_29_7));
+        assert_eq!(dllp_frame.dllp().as_bytes(), &ACK_5[1..7]);
+
+        let mut corrupt = ACK_5;
+        corrupt[4] = 6;
+        assert!(!parse_dllp(&corrupt).crc_is_valid());
+
+        /* A DLLP cut short is left unparsed. */
+        assert!(matches!(Frame::parse(&ACK_5[..6]), Some(Frame::Unknown(_))));
+    }
+
+    #[test]
+    fn flow_control_scales() {
+        let fc = FlowControl {
+            hdr_scale: 2,
+            hdr_fc: 10,
+            data_scale: 3,
+            data_fc: 100,
+        };
+        assert_eq!(fc.hdr_credits(), 40);
+        assert_eq!(fc.data_credits(), 1600);
+
+        let fc = FlowControl { hdr_scale: 1, ..fc };
+        assert_eq!(fc.hdr_credits(), 10);
+    }
+
+    #[test]
+    fn memory_write_with_ecrc() {
+        let frame = Frame::parse(&MEMORY_WRITE_64).unwrap();
+        let Frame::Tlp(tlp_frame) = frame else {
+            panic!("not a TLP");
+        };
+        assert_eq!(tlp_frame.seq(), Some(0x123));
+        assert_eq!(tlp_frame.lcrc_is_valid(), Some(true));
+        assert_eq!(tlp_frame.end_tag(), Some(K_29_7));
+        assert_eq!(frame.header_len(), 3 + 16);
+
+        let tlp = parse_tlp(&MEMORY_WRITE_64);
+        assert_eq!(tlp.kind(), TlpKind::MemoryWrite);
+        assert!(tlp.is_posted());
+        assert!(tlp.is_request());
+        assert!(tlp.has_data());
+        assert!(tlp.is_4dw_header());
+        assert!(tlp.tlp_digest());
+        assert_eq!(tlp.header_len(), 16);
+        assert_eq!(tlp.length_field(), 2);
+        assert_eq!(tlp.length_dw(), 2);
+        assert_eq!(tlp.requester_id(), Some(0x0100));
+        assert_eq!(tlp.tag(), Some(0x05));
+        assert_eq!(tlp.first_dw_be(), Some(0xf));
+        assert_eq!(tlp.last_dw_be(), Some(0xf));
+        assert_eq!(tlp.address(), Some(0x1_2345_6780));
+        assert_eq!(tlp.processing_hint(), Some(0));
+        assert_eq!(
+            tlp.payload(),
+            Some(&[0xde, 0xad, 0xbe, 0xef, 0x01, 0x02, 0x03, 0x04][..])
+        );
+        assert_eq!(tlp.ecrc(), Some(0x6a310e6e));
+        assert_eq!(tlp.ecrc_is_valid(), Some(true));
+
+        let mut corrupt = MEMORY_WRITE_64;
+        corrupt[20] ^= 0x80;
+        assert_eq!(parse_tlp(&corrupt).ecrc_is_valid(), Some(false));
+        let Frame::Tlp(tlp_frame) = Frame::parse(&corrupt).unwrap() else {
+            panic!("not a TLP");
+        };
+        assert_eq!(tlp_frame.lcrc_is_valid(), Some(false));
+
+        /* Too short for the payload the header describes */
+        let Frame::Tlp(tlp_frame) = Frame::parse(&MEMORY_WRITE_64[..22]).unwrap() else {
+            panic!("not a TLP");
+        };
+        assert!(tlp_frame.tlp().is_none());
+        assert_eq!(tlp_frame.lcrc(), None);
+        assert_eq!(tlp_frame.end_tag(), None);
+        assert_eq!(
+            Frame::parse(&MEMORY_WRITE_64[..22]).unwrap().header_len(),
+            22
+        );
+        let tlp = Tlp::new(&MEMORY_WRITE_64[3..22]).unwrap();
+        assert_eq!(tlp.payload(), None);
+        assert!(Tlp::new(&MEMORY_WRITE_64[3..18]).is_none());
+    }
+
+    #[test]
+    fn request_and_completion_fields() {
+        /* 32-bit Memory Read with a 10-bit tag and a processing hint */
+        let read = Tlp::new(&[
+            0x00, 0x88, 0x00, 0x01, 0x01, 0x00, 0x2a, 0x0f, 0xfe, 0xed, 0x00, 0x11,
+        ])
+        .unwrap();
+        assert_eq!(read.kind(), TlpKind::MemoryRead);
+        assert!(read.is_request());
+        assert!(!read.is_posted());
+        assert!(!read.is_completion());
+        assert_eq!(read.header_len(), 12);
+        assert_eq!(read.requester_id(), Some(0x0100));
+        assert_eq!(read.tag(), Some(0x32a));
+        assert_eq!(read.transaction_id(), Some(0x032a_0100));
+        assert_eq!(read.first_dw_be(), Some(0xf));
+        assert_eq!(read.last_dw_be(), Some(0));
+        assert_eq!(read.address(), Some(0xfeed_0010));
+        assert_eq!(read.processing_hint(), Some(1));
+        assert_eq!(read.completer_id(), None);
+        assert_eq!(read.byte_count(), None);
+        assert_eq!(read.payload(), Some(&[][..]));
+
+        /* The completion for it, with Unsupported Request status */
+        let completion = Tlp::new(&[
+            0x0a, 0x88, 0x00, 0x00, 0x02, 0x00, 0x30, 0x04, 0x01, 0x00, 0x2a, 0x10,
+        ])
+        .unwrap();
+        assert_eq!(completion.kind(), TlpKind::Completion);
+        assert!(completion.is_completion());
+        assert!(!completion.is_request());
+        assert_eq!(completion.completer_id(), Some(0x0200));
+        assert_eq!(completion.requester_id(), Some(0x0100));
+        assert_eq!(completion.transaction_id(), read.transaction_id());
+        assert_eq!(completion.completion_status(), Some(1));
+        assert_eq!(completion.byte_count_modified(), Some(true));
+        assert_eq!(completion.byte_count(), Some(4));
+        assert_eq!(completion.lower_address(), Some(0x10));
+        assert_eq!(completion.first_dw_be(), None);
+        assert_eq!(completion.address(), None);
+
+        /* Type 0 Configuration Read of register 0x44 */
+        let config_read = Tlp::new(&[
+            0x04, 0x00, 0x00, 0x01, 0x01, 0x00, 0x07, 0x0f, 0x03, 0x08, 0x00, 0x44,
+        ])
+        .unwrap();
+        assert_eq!(config_read.kind(), TlpKind::ConfigRead);
+        assert_eq!(config_read.completer_id(), Some(0x0308));
+        assert_eq!(config_read.register(), Some(0x44));
+        assert_eq!(config_read.address(), None);
+        assert_eq!(config_read.message_code(), None);
+    }
+
+    #[test]
+    fn tlp_kinds() {
+        for (fmt_type, kind) in [
+            (0x00, TlpKind::MemoryRead),
+            (0x20, TlpKind::MemoryRead),
+            (0x01, TlpKind::MemoryReadLocked),
+            (0x40, TlpKind::MemoryWrite),
+            (0x60, TlpKind::MemoryWrite),
+            (0x02, TlpKind::IoRead),
+            (0x42, TlpKind::IoWrite),
+            (0x05, TlpKind::ConfigRead),
+            (0x45, TlpKind::ConfigWrite),
+            (0x0a, TlpKind::Completion),
+            (0x4a, TlpKind::Completion),
+            (0x0b, TlpKind::CompletionLocked),
+            (0x30, TlpKind::Message),
+            (0x34, TlpKind::Message),
+            (0x72, TlpKind::Message),
+            (0x77, TlpKind::Message),
+            (0x38, TlpKind::Other),
+            (0x10, TlpKind::Other),
+            (0x4c, TlpKind::Other),
+            (0x80, TlpKind::Other),
+        ] {
+            assert_eq!(TlpKind::from_fmt_type(fmt_type), kind, "{:#04x}", fmt_type);
+        }
+    }
+
+    #[test]
+    fn ordered_sets() {
+        for (data, kind, symbol) in [
+            (
+                &[0xbc, 0x1c, 0x1c, 0x1c][..],
+                OrderedSetKind::Skp,
+                Some(K_28_0),
+            ),
+            (
+                &[0xbc, 0x3c, 0x3c, 0x3c][..],
+                OrderedSetKind::Fts,
+                Some(K_28_1),
+            ),
+            (
+                &[0xbc, 0x7c, 0x7c, 0x7c, 0xdf][..],
+                OrderedSetKind::ElectricalIdle,
+                Some(K_28_3),
+            ),
+            (
+                &[0xbc, 0xfc, 0xfc, 0xfc, 0xfc][..],
+                OrderedSetKind::ElectricalIdleExit,
+                Some(K_28_7),
+            ),
+            (&[0xbc, 0x00][..], OrderedSetKind::Unknown, None),
+            (&[0xbc][..], OrderedSetKind::Unknown, None),
+        ] {
+            let os = parse_ordered_set(data);
+            assert_eq!(os.kind(), kind);
+            assert_eq!(os.type_symbol(), symbol);
+            assert_eq!(os.link_number(), None);
+        }
+
+        let mut ts1 = [0x4a; 16];
+        ts1[..6].copy_from_slice(&[0xbc, 0x01, 0x02, 0x10, 0x06, 0x00]);
+        let os = parse_ordered_set(&ts1);
+        assert_eq!(os.kind(), OrderedSetKind::Ts1);
+        assert_eq!(os.type_symbol(), Some(0x4a));
+        assert!(!os.is_polarity_inverted());
+        assert_eq!(os.link_number(), Some(0x01));
+        assert_eq!(os.lane_number(), Some(0x02));
+        assert_eq!(os.n_fts(), Some(0x10));
+        assert_eq!(os.data_rate(), Some(0x06));
+        assert_eq!(os.training_control(), Some(0x00));
+
+        let mut ts2 = ts1;
+        ts2[6..].fill(0x45);
+        assert_eq!(parse_ordered_set(&ts2).kind(), OrderedSetKind::Ts2);
+        assert_eq!(parse_ordered_set(&ts2).lane_number(), Some(0x02));
+
+        /* Inverted identifiers are recognized, but the fields can't be trusted. */
+        let mut inverted = ts1;
+        inverted[6..].fill(0xb5);
+        let os = parse_ordered_set(&inverted);
+        assert_eq!(os.kind(), OrderedSetKind::Ts1);
+        assert!(os.is_polarity_inverted());
+        assert_eq!(os.link_number(), None);
+        inverted[6..].fill(0xba);
+        assert_eq!(parse_ordered_set(&inverted).kind(), OrderedSetKind::Ts2);
+        assert!(parse_ordered_set(&inverted).is_polarity_inverted());
+    }
+
+    #[test]
+    fn unknown_frames() {
+        assert!(Frame::parse(&[]).is_none());
+        for data in [&[0x00, 0x01][..], &[K_29_7][..]] {
+            let frame = Frame::parse(data).unwrap();
+            assert!(matches!(frame, Frame::Unknown(_)));
+            assert_eq!(frame.start_tag(), data[0]);
+            assert_eq!(frame.header_len(), data.len());
+            assert!(frame.tlp().is_none());
+            assert!(frame.dllp().is_none());
+        }
+
+        /* An STP too short to hold a TLP header */
+        let frame = Frame::parse(&[K_27_7, 0x00, 0x01, 0x00]).unwrap();
+        assert!(frame.tlp().is_none());
+        assert_eq!(frame.header_len(), 4);
+    }
+}
@@ -0,0 +1,702 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/index.rs - Sidecar index files for PAD captures.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A .padidx file holds the result of classifying every record of a PAD file,
+ * so that later runs can decide which records they need without reading the
+ * record data. It is written next to the PAD file and is meant to be mapped.
+ *
+ * All integers are little-endian, and every section starts 8-byte aligned:
+ *
+ *   0   magic "PADIDX\0\0"
+ *   8   version (u32)
+ *   12  section count (u32)
+ *   16  PAD file length (u64)
+ *   24  first record number (u32)
+ *   28  record count (u32)
+ *   32  GUID length (u32)
+ *   36  reserved (u32)
+ *   40  GUID bytes, zero-padded
+ *   ... section table: id (u32), reserved (u32), offset (u64), length (u64)
+ *   ... sections
+ *
+ * The index is keyed by the PAD file's GUID and length, so an index left over
+ * from a different or re-written capture is rejected instead of being trusted.
+ * The record count is checked too, since the analyzer fills in the record table
+ * of a preallocated file as it captures.
+ * Readers skip sections they don't know, so new sections don't need a new
+ * version number.
+ */
+
+use std::fs::File;
+use std::io::prelude::*;
+use std::io::{Error, ErrorKind};
+use std::ops::RangeBounds;
+use std::path::{Path, PathBuf};
+
+use memmap2::Mmap;
+
+use crate::bloom::{self, BloomFilter, BloomFilters};
+use crate::frame::Frame;
+use crate::pages::{AddressEvent, PageIndex, PageIndexBuilder};
+use crate::zonemap::{self, ZoneMap, ZoneMaps, ZONE_BLOCK_LEN};
+use crate::{
+    clamp_record_range, MappedPadFile, RecordView, FLAG_DISPARITY_ERROR, FLAG_SYMBOL_ERROR,
+    FLAG_UPSTREAM,
+};
+
+const MAGIC: &[u8; 8] = b"PADIDX\0\0";
+pub const INDEX_VERSION: u32 = 1;
+const HEADER_LEN: usize = 40;
+const SECTION_TABLE_ENTRY_LEN: usize = 24;
+
+/* Section IDs */
+pub const SECTION_ENTRIES: u32 = 1;
+pub const SECTION_ZONE_MAPS: u32 = 2;
+pub const SECTION_BLOOM_FILTERS: u32 = 3;
+pub const SECTION_ADDRESS_INDEX: u32 = 4;
+
+/* Entry classes */
+pub const CLASS_UNKNOWN: u8 = 0;
+pub const CLASS_TLP: u8 = 1;
+pub const CLASS_DLLP: u8 = 2;
+pub const CLASS_ORDERED_SET: u8 = 3;
+
+/* Entry flags */
+pub const ENTRY_UPSTREAM: u8 = 1 << 0;
+pub const ENTRY_SYMBOL_ERROR: u8 = 1 << 1;
+pub const ENTRY_DISPARITY_ERROR: u8 = 1 << 2;
+pub const ENTRY_HAS_REQUESTER_ID: u8 = 1 << 3;
+pub const ENTRY_HAS_COMPLETER_ID: u8 = 1 << 4;
+pub const ENTRY_HAS_ADDRESS: u8 = 1 << 5;
+pub const ENTRY_HAS_DETAIL: u8 = 1 << 6;
+pub const ENTRY_TRUNCATED: u8 = 1 << 7;
+
+fn align8(len: usize) -> usize {
+    (len + 7) & !7
+}
+
+fn invalid_data(message: String) -> Error {
+    Error::new(ErrorKind::InvalidData, message)
+}
+
+/* Returns the path of the index for a PAD file, e.g. "capture.padidx" for "capture.pad". */
+pub fn index_path(pad_filename: &str) -> PathBuf {
+    Path::new(pad_filename).with_extension("padidx")
+}
+
+/*
+ * The classification of one record. The kind is the TLP's Fmt/Type byte, the
+ * DLLP type, or the ordered set kind, depending on the class. The detail is
+ * the completion status of a completion or the message code of a message.
+ * The address is the DW-aligned address of a memory or I/O request.
+ */
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct IndexEntry {
+    pub class: u8,
+    pub kind: u8,
+    pub flags: u8,
+    pub detail: u8,
+    pub requester_id: u16,
+    pub tag: u16,
+    pub completer_id: u16,
+    pub address: u64,
+}
+
+impl IndexEntry {
+    pub const LEN: usize = 24;
+
+    pub fn from_record_view(record_view: &RecordView) -> Self {
+        let record_flags = record_view.record.flags;
+
+        let mut entry = Self::default();
+        if record_flags & FLAG_UPSTREAM != 0 {
+            entry.flags |= ENTRY_UPSTREAM;
+        }
+        if record_flags & FLAG_SYMBOL_ERROR != 0 {
+            entry.flags |= ENTRY_SYMBOL_ERROR;
+        }
+        if record_flags & FLAG_DISPARITY_ERROR != 0 {
+            entry.flags |= ENTRY_DISPARITY_ERROR;
+        }
+
+        match record_view.frame() {
+            Some(Frame::Tlp(tlp_frame)) => {
+                entry.class = CLASS_TLP;
+                match tlp_frame.tlp() {
+                    Some(tlp) => entry.set_tlp_fields(&tlp),
+                    None => {
+                        entry.kind = tlp_frame.as_bytes().get(3).copied().unwrap_or(0);
+                        entry.flags |= ENTRY_TRUNCATED;
+                    }
+                }
+            }
+            Some(Frame::Dllp(dllp_frame)) => {
+                entry.class = CLASS_DLLP;
+                entry.kind = dllp_frame.dllp().dllp_type();
+            }
+            Some(Frame::OrderedSet(os)) => {
+                entry.class = CLASS_ORDERED_SET;
+                entry.kind = os.kind() as u8;
+            }
+            Some(Frame::Unknown(_)) | None => (),
+        }
+
+        entry
+    }
+
+    fn set_tlp_fields(&mut self, tlp: &crate::frame::Tlp) {
+        self.kind = tlp.fmt_type();
+
+        if let (Some(requester_id), Some(tag)) = (tlp.requester_id(), tlp.tag()) {
+            self.requester_id = requester_id;
+            self.tag = tag;
+            self.flags |= ENTRY_HAS_REQUESTER_ID;
+        }
+        if let Some(completer_id) = tlp.completer_id() {
+            self.completer_id = completer_id;
+            self.flags |= ENTRY_HAS_COMPLETER_ID;
+        }
+        if let Some(address) = tlp.address() {
+            self.address = address;
+            self.flags |= ENTRY_HAS_ADDRESS;
+        }
+        if let Some(detail) = tlp.completion_status().or(tlp.message_code()) {
+            self.detail = detail;
+            self.flags |= ENTRY_HAS_DETAIL;
+        }
+    }
+
+    pub fn from_bytes(input: &[u8; Self::LEN]) -> Self {
+        Self {
+            class: input[0],
+            kind: input[1],
+            flags: input[2],
+            detail: input[3],
+            requester_id: u16::from_le_bytes(input[4..6].try_into().unwrap()),
+            tag: u16::from_le_bytes(input[6..8].try_into().unwrap()),
+            completer_id: u16::from_le_bytes(input[8..10].try_into().unwrap()),
+            address: u64::from_le_bytes(input[16..24].try_into().unwrap()),
+        }
+    }
+
+    pub fn to_bytes(&self) -> [u8; Self::LEN] {
+        let mut output = [0; Self::LEN];
+        output[0] = self.class;
+        output[1] = self.kind;
+        output[2] = self.flags;
+        output[3] = self.detail;
+        output[4..6].copy_from_slice(&self.requester_id.to_le_bytes());
+        output[6..8].copy_from_slice(&self.tag.to_le_bytes());
+        output[8..10].copy_from_slice(&self.completer_id.to_le_bytes());
+        output[16..24].copy_from_slice(&self.address.to_le_bytes());
+        output
+    }
+
+    pub fn is_upstream(&self) -> bool {
+        self.flags & ENTRY_UPSTREAM != 0
+    }
+
+    fn field<T>(&self, flag: u8, value: T) -> Option<T> {
+        match self.flags & flag != 0 {
+            true => Some(value),
+            false => None,
+        }
+    }
+
+    pub fn requester_id(&self) -> Option<u16> {
+        self.field(ENTRY_HAS_REQUESTER_ID, self.requester_id)
+    }
+
+    pub fn tag(&self) -> Option<u16> {
+        self.field(ENTRY_HAS_REQUESTER_ID, self.tag)
+    }
+
+    pub fn completer_id(&self) -> Option<u16> {
+        self.field(ENTRY_HAS_COMPLETER_ID, self.completer_id)
+    }
+
+    pub fn address(&self) -> Option<u64> {
+        self.field(ENTRY_HAS_ADDRESS, self.address)
+    }
+
+    pub fn detail(&self) -> Option<u8> {
+        self.field(ENTRY_HAS_DETAIL, self.detail)
+    }
+}
+
+/* The optional sections to build. The entries and zone maps are always built. */
+#[derive(Debug, Clone, Default)]
+pub struct IndexOptions {
+    pub bloom_filters: bool,
+    pub address_index: bool,
+}
+
+#[derive(Debug)]
+struct Block {
+    entries: Vec<u8>,
+    zone_map: ZoneMap,
+    bloom_filter: Option<BloomFilter>,
+    address_events: Vec<AddressEvent>,
+}
+
+/*
+ * Builds every section of the index in one pass over the records, one zone map
+ * block per chunk on all available cores.
+ */
+pub fn build_sections(
+    pad_file: &MappedPadFile,
+    options: &IndexOptions,
+) -> Result<Vec<(u32, Vec<u8>)>, Error> {
+    let blocks = pad_file.par_chunks(.., ZONE_BLOCK_LEN, |range, records| {
+        let mut block = Block {
+            entries: Vec::with_capacity(range.clone().count() * IndexEntry::LEN),
+            zone_map: ZoneMap::new(*range.start()),
+            bloom_filter: match options.bloom_filters {
+                true => Some(BloomFilter::new()),
+                false => None,
+            },
+            address_events: Vec::new(),
+        };
+        for record_view in records {
+            let record_view = record_view?;
+            let entry = IndexEntry::from_record_view(&record_view);
+            block.zone_map.add(record_view.record.timestamp_ns, &entry);
+            if let Some(bloom_filter) = block.bloom_filter.as_mut() {
+                bloom_filter.add(&entry);
+            }
+            if options.address_index && entry.class == CLASS_TLP {
+                block
+                    .address_events
+                    .extend(AddressEvent::from_record_view(&record_view));
+            }
+            block.entries.extend_from_slice(&entry.to_bytes());
+        }
+        Ok(block)
+    })?;
+
+    let mut entries: Vec<u8> = Vec::new();
+    let mut zone_maps: Vec<ZoneMap> = Vec::with_capacity(blocks.len());
+    let mut bloom_filters: Vec<BloomFilter> = Vec::new();
+    let mut page_index = PageIndexBuilder::new();
+    for mut block in blocks {
+        /* Completions are matched to requests in record order, across blocks. */
+        for event in block.address_events.iter() {
+            page_index.add(event);
+        }
+        entries.append(&mut block.entries);
+        zone_maps.push(block.zone_map);
+        bloom_filters.extend(block.bloom_filter);
+    }
+
+    let mut sections = vec![
+        (SECTION_ENTRIES, entries),
+        (
+            SECTION_ZONE_MAPS,
+            zonemap::section_from_zone_maps(ZONE_BLOCK_LEN, &zone_maps),
+        ),
+    ];
+
+    if options.bloom_filters {
+        sections.push((
+            SECTION_BLOOM_FILTERS,
+            bloom::section_from_filters(
+                ZONE_BLOCK_LEN,
+                pad_file.header.first_record_number,
+                pad_file.probe_record_count(),
+                &bloom_filters,
+            ),
+        ));
+    }
+
+    if options.address_index {
+        sections.push((
+            SECTION_ADDRESS_INDEX,
+            page_index.to_section(pad_file.header.first_record_number),
+        ));
+    }
+
+    Ok(sections)
+}
+
+pub fn write_index<W>(
+    writer: &mut W,
+    pad_file: &MappedPadFile,
+    sections: &[(u32, Vec<u8>)],
+) -> Result<(), Error>
+where
+    W: Write,
+{
+    let guid = pad_file.header.guid.as_bytes();
+
+    let mut header: Vec<u8> = Vec::with_capacity(HEADER_LEN + align8(guid.len()));
+    header.extend_from_slice(MAGIC);
+    header.extend_from_slice(&INDEX_VERSION.to_le_bytes());
+    header.extend_from_slice(
+        &<usize as TryInto<u32>>::try_into(sections.len())
+            .unwrap()
+            .to_le_bytes(),
+    );
+    header.extend_from_slice(&pad_file.file_len().to_le_bytes());
+    header.extend_from_slice(&pad_file.header.first_record_number.to_le_bytes());
+    header.extend_from_slice(&pad_file.probe_record_count().to_le_bytes());
+    header.extend_from_slice(
+        &<usize as TryInto<u32>>::try_into(guid.len())
+            .unwrap()
+            .to_le_bytes(),
+    );
+    header.extend_from_slice(&0_u32.to_le_bytes());
+    header.extend_from_slice(guid);
+    header.resize(align8(header.len()), 0);
+
+    let mut offset = header.len() + sections.len() * SECTION_TABLE_ENTRY_LEN;
+    for (id, data) in sections {
+        header.extend_from_slice(&id.to_le_bytes());
+        header.extend_from_slice(&0_u32.to_le_bytes());
+        header.extend_from_slice(
+            &<usize as TryInto<u64>>::try_into(offset)
+                .unwrap()
+                .to_le_bytes(),
+        );
+        header.extend_from_slice(
+            &<usize as TryInto<u64>>::try_into(data.len())
+                .unwrap()
+                .to_le_bytes(),
+        );
+        offset += align8(data.len());
+    }
+    writer.write_all(&header)?;
+
+    for (_, data) in sections {
+        writer.write_all(data)?;
+        writer.write_all(&[0; 7][..align8(data.len()) - data.len()])?;
+    }
+
+    Ok(())
+}
+
+#[derive(Debug)]
+struct Section {
+    id: u32,
+    offset: usize,
+    len: usize,
+}
+
+#[derive(Debug)]
+pub struct PadIndex {
+    pub pad_len: u64,
+    pub first_record_number: u32,
+    pub record_count: u32,
+    pub guid: String,
+    sections: Vec<Section>,
+    mmap: Mmap,
+}
+
+impl PadIndex {
+    /* Opens an index without checking that it matches any PAD file. */
+    pub fn from_filename<P>(filename: P) -> Result<Self, Error>
+    where
+        P: AsRef<Path>,
+    {
+        let file = File::open(filename)?;
+
+        /*
+         * Safety: The mapping is only ever read, and index files are replaced
+         * rather than modified when they are rebuilt.
+         */
+        let mmap = unsafe { Mmap::map(&file)? };
+
+        let u32_at =
+            |offset: usize| u32::from_le_bytes(mmap[offset..offset + 4].try_into().unwrap());
+        let u64_at =
+            |offset: usize| u64::from_le_bytes(mmap[offset..offset + 8].try_into().unwrap());
+
+        if mmap.len() < HEADER_LEN || &mmap[..8] != MAGIC {
+            return Err(invalid_data("not a PAD index".to_string()));
+        }
+
+        let version = u32_at(8);
+        if version != INDEX_VERSION {
+            return Err(invalid_data(format!(
+                "unsupported index version {}",
+                version
+            )));
+        }
+
+        let section_count: usize = u32_at(12).try_into().unwrap();
+        let guid_len: usize = u32_at(32).try_into().unwrap();
+        let table_start = HEADER_LEN + align8(guid_len);
+        let table_end = table_start + section_count * SECTION_TABLE_ENTRY_LEN;
+        if mmap.len() < table_end {
+            return Err(invalid_data("truncated index header".to_string()));
+        }
+
+        let mut sections = Vec::with_capacity(section_count);
+        for entry in (table_start..table_end).step_by(SECTION_TABLE_ENTRY_LEN) {
+            let section = Section {
+                id: u32_at(entry),
+                offset: u64_at(entry + 8).try_into().unwrap(),
+                len: u64_at(entry + 16).try_into().unwrap(),
+            };
+            if section
+                .offset
+                .checked_add(section.len)
+                .is_none_or(|end| mmap.len() < end)
+            {
+                return Err(invalid_data(format!(
+                    "truncated index section {}",
+                    section.id
+                )));
+            }
+            sections.push(section);
+        }
+
+        let index = Self {
+            pad_len: u64_at(16),
+            first_record_number: u32_at(24),
+            record_count: u32_at(28),
+            guid: String::from_utf8_lossy(&mmap[HEADER_LEN..HEADER_LEN + guid_len]).into_owned(),
+            sections,
+            mmap,
+        };
+
+        if index.record_count > 0 && index.last_record_number().is_none() {
+            return Err(invalid_data("bad index record range".to_string()));
+        }
+
+        match index.section(SECTION_ENTRIES) {
+            Some(entries)
+                if entries.len()
+                    == <u32 as TryInto<usize>>::try_into(index.record_count).unwrap()
+                        * IndexEntry::LEN =>
+            {
+                Ok(index)
+            }
+            _ => Err(invalid_data("bad index entries section".to_string())),
+        }
+    }
+
+    /* Opens the index next to a PAD file, failing if it was built from a different file. */
+    pub fn for_pad_file(pad_filename: &str, pad_file: &MappedPadFile) -> Result<Self, Error> {
+        let index = Self::from_filename(index_path(pad_filename))?;
+
+        if !index.matches(pad_file) {
+            return Err(invalid_data(format!(
+                "index for {:?} is stale",
+                pad_filename
+            )));
+        }
+
+        Ok(index)
+    }
+
+    pub fn matches(&self, pad_file: &MappedPadFile) -> bool {
+        self.guid == pad_file.header.guid
+            && self.pad_len == pad_file.file_len()
+            && self.first_record_number == pad_file.header.first_record_number
+            && self.record_count == pad_file.probe_record_count()
+    }
+
+    pub fn section(&self, id: u32) -> Option<&[u8]> {
+        let section = self.sections.iter().find(|s| s.id == id)?;
+
+        Some(&self.mmap[section.offset..section.offset + section.len])
+    }
+
+    pub fn zone_maps(&self) -> Option<ZoneMaps<'_>> {
+        ZoneMaps::from_section(self.section(SECTION_ZONE_MAPS)?)
+    }
+
+    /* Only present if the index was built with Bloom filters. */
+    pub fn bloom_filters(&self) -> Option<BloomFilters<'_>> {
+        BloomFilters::from_section(self.section(SECTION_BLOOM_FILTERS)?)
+    }
+
+    /* Only present if the index was built with an address index. */
+    pub fn page_index(&self) -> Option<PageIndex<'_>> {
+        PageIndex::from_section(
+            self.section(SECTION_ADDRESS_INDEX)?,
+            self.first_record_number,
+        )
+    }
+
+    pub fn last_record_number(&self) -> Option<u32> {
+        match self.record_count {
+            0 => None,
+            count => self.first_record_number.checked_add(count - 1),
+        }
+    }
+
+    pub fn entry(&self, number: u32) -> Option<IndexEntry> {
+        let index: usize = number
+            .checked_sub(self.first_record_number)?
+            .try_into()
+            .unwrap();
+        let entries = self.section(SECTION_ENTRIES).unwrap();
+        let raw = entries.get(index * IndexEntry::LEN..(index + 1) * IndexEntry::LEN)?;
+
+        Some(IndexEntry::from_bytes(raw.try_into().unwrap()))
+    }
+
+    /* Returns the number and entry of each indexed record in the range. */
+    pub fn entries<B>(&self, range: B) -> impl Iterator<Item = (u32, IndexEntry)> + '_
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = match self.last_record_number() {
+            Some(last) => clamp_record_range(&range, self.first_record_number, last),
+            None => 1..=0,
+        };
+        let start: usize = range
+            .start()
+            .saturating_sub(self.first_record_number)
+            .try_into()
+            .unwrap();
+        let entries = self.section(SECTION_ENTRIES).unwrap();
+
+        entries
+            .get(start * IndexEntry::LEN..)
+            .unwrap_or_default()
+            .chunks_exact(IndexEntry::LEN)
+            .zip(range)
+            .map(|(raw, number)| (number, IndexEntry::from_bytes(raw.try_into().unwrap())))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testutil::*;
+
+    const ALL_SECTIONS: IndexOptions = IndexOptions {
+        bloom_filters: true,
+        address_index: true,
+    };
+
+    #[test]
+    fn index_round_trip() {
+        let count = ZONE_BLOCK_LEN + 1000;
+        let pad = TempFile::new(&pad_file_bytes(7, &frame_records(count)));
+        let pad_file = MappedPadFile::from_filename(pad.path()).unwrap();
+
+        for options in [IndexOptions::default(), ALL_SECTIONS] {
+            let index_file = index_file(&pad_file, &options);
+            let index = PadIndex::from_filename(index_file.path()).unwrap();
+
+            assert!(index.matches(&pad_file));
+            assert_eq!(index.guid, pad_file.header.guid);
+            assert_eq!(index.pad_len, pad_file.file_len());
+            assert_eq!(index.first_record_number, 7);
+            assert_eq!(index.record_count, u32::try_from(count).unwrap());
+            assert_eq!(index.last_record_number(), Some(7 + index.record_count - 1));
+
+            let mut entries = index.entries(..);
+            for record_view in pad_file.records(..) {
+                let record_view = record_view.unwrap();
+                let number = record_view.record.number;
+                let expected = IndexEntry::from_record_view(&record_view);
+                assert_eq!(entries.next(), Some((number, expected)));
+                assert_eq!(index.entry(number), Some(expected));
+            }
+            assert_eq!(entries.next(), None);
+            assert_eq!(index.entry(6), None);
+            assert_eq!(index.entry(7 + index.record_count), None);
+            assert_eq!(
+                index
+                    .entries(100..=102)
+                    .map(|(n, _)| n)
+                    .collect::<Vec<u32>>(),
+                vec![100, 101, 102]
+            );
+
+            assert_eq!(index.zone_maps().unwrap().len(), 2);
+            assert_eq!(index.bloom_filters().is_some(), options.bloom_filters);
+            assert_eq!(index.page_index().is_some(), options.address_index);
+        }
+    }
+
+    #[test]
+    fn entries_classify_records() {
+        let records = frame_records(5);
+        let pad = TempFile::new(&pad_file_bytes(1, &records));
+        let pad_file = MappedPadFile::from_filename(pad.path()).unwrap();
+        let entries: Vec<IndexEntry> = pad_file
+            .records(..)
+            .map(|r| IndexEntry::from_record_view(&r.unwrap()))
+            .collect();
+
+        assert_eq!(entries[0].class, CLASS_TLP);
+        assert_eq!(entries[0].kind, 0x00);
+        assert_eq!(entries[0].requester_id(), Some(0x0100));
+        assert_eq!(entries[0].tag(), Some(0));
+        assert_eq!(entries[0].address(), Some(0x40));
+        assert!(!entries[0].is_upstream());
+
+        assert_eq!(entries[1].class, CLASS_TLP);
+        assert_eq!(entries[1].kind, 0x4a);
+        assert_eq!(entries[1].completer_id(), Some(0x0200));
+        assert_eq!(entries[1].requester_id(), Some(0x0101));
+        assert_eq!(entries[1].detail(), Some(0));
+        assert!(entries[1].is_upstream());
+
+        assert_eq!(entries[2].address(), Some(0x1_0000_2040));
+        assert_eq!(entries[3].class, CLASS_DLLP);
+        assert_eq!(entries[3].address(), None);
+        assert_eq!(entries[4].class, CLASS_ORDERED_SET);
+
+        for entry in entries {
+            assert_eq!(IndexEntry::from_bytes(&entry.to_bytes()), entry);
+        }
+    }
+
+    #[test]
+    fn malformed_indexes_are_rejected() {
+        let pad = TempFile::new(&pad_file_bytes(1, &frame_records(100)));
+        let pad_file = MappedPadFile::from_filename(pad.path()).unwrap();
+        let sections = build_sections(&pad_file, &ALL_SECTIONS).unwrap();
+        let mut bytes: Vec<u8> = Vec::new();
+        write_index(&mut bytes, &pad_file, &sections).unwrap();
+
+        let open = |bytes: &[u8]| PadIndex::from_filename(TempFile::new(bytes).path());
+        assert!(open(&bytes).is_ok());
+
+        let mut bad_magic = bytes.clone();
+        bad_magic[0] = b'X';
+        assert!(open(&bad_magic).is_err());
+
+        let mut bad_version = bytes.clone();
+        bad_version[8] = 99;
+        assert!(open(&bad_version).is_err());
+
+        /* A record range that runs past the last record number */
+        let mut overflowing = bytes.clone();
+        overflowing[24..28].copy_from_slice(&(u32::MAX - 10).to_le_bytes());
+        assert!(open(&overflowing).is_err());
+
+        /* An entries section that doesn't match the record count */
+        let mut miscounted = bytes.clone();
+        miscounted[28..32].copy_from_slice(&101_u32.to_le_bytes());
+        assert!(open(&miscounted).is_err());
+
+        for len in [0, 39, 64, bytes.len() - 1] {
+            assert!(open(&bytes[..len]).is_err(), "{}", len);
+        }
+    }
+}
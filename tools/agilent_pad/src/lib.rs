@@ -20,13 +20,36 @@
 
 use std::fs::File;
 use std::io::prelude::*;
-use std::io::BufReader;
+use std::io::{BufReader, Cursor, SeekFrom};
+use std::ops::{Bound, RangeBounds, RangeInclusive};
+use std::sync::mpsc::{channel, sync_channel, Receiver, Sender};
+use std::thread::JoinHandle;
 
-use nom::multi::length_data;
-use nom::number::streaming::{be_u16, be_u32, be_u64, le_u16, le_u32};
+use memmap2::Mmap;
+use nom::number::streaming::{le_u16, le_u32};
 use nom::sequence::tuple;
 use nom::IResult;
 
+pub mod batch;
+pub mod bloom;
+pub mod capture;
+pub mod columnar;
+pub mod filter;
+pub mod frame;
+pub mod index;
+pub mod merge;
+pub mod pages;
+pub mod par;
+pub mod pcapng;
+pub mod query;
+pub mod scan;
+pub mod seekable;
+pub mod varint;
+pub mod zonemap;
+
+#[cfg(test)]
+mod testutil;
+
 fn u32_hi_lo_to_u64(hi: u32, lo: u32) -> u64 {
     (<u32 as Into<u64>>::into(hi).checked_shl(32).unwrap()) | <u32 as Into<u64>>::into(lo)
 }
@@ -35,11 +58,20 @@ fn le_u32_typed(input: &[u8]) -> IResult<&[u8], u32> {
     le_u32(input)
 }
 
-fn parse_string(input: &[u8]) -> IResult<&[u8], &[u8]> {
-    length_data(be_u16)(input)
-}
+/* Record flags */
+pub const FLAGS_LINK_WIDTH_MASK: u32 = 0x7;
+pub const FLAG_SYMBOL_ERROR: u32 = 1 << 3;
+pub const FLAGS_START_LANE_MASK: u32 = 0xF << 4;
+pub const FLAG_LINK_SPEED_VALID: u32 = 1 << 8;
+pub const FLAG_LINK_SPEED_5_0_GTS: u32 = 1 << 9;
+pub const FLAG_CHANNEL_BONDED: u32 = 1 << 10;
+pub const FLAG_DISPARITY_ERROR: u32 = 1 << 11;
+pub const FLAGS_ELECTRICAL_IDLE_MASK: u32 = 0xFFFF << 12;
+pub const FLAG_UPSTREAM: u32 = 1 << 28;
+pub const FLAG_SCRAMBLED: u32 = 1 << 29;
+pub const FLAG_GAP: u32 = 1 << 30;
 
-#[derive(Debug)]
+#[derive(Debug, Clone, PartialEq)]
 pub struct Record {
     pub number: u32,
     pub data_len: u32,
@@ -97,9 +129,228 @@ impl Record {
             Err(e) => panic!("{:?}", e),
         }
     }
+
+    pub fn from_bytes(input: &[u8; 40]) -> Self {
+        RawRecord::from_bytes(input).to_record()
+    }
+
+    fn data_read_len(&self, exclude_metadata: bool) -> usize {
+        if exclude_metadata && self.metadata_offset > 0 {
+            self.metadata_offset.into()
+        } else {
+            self.data_len.try_into().unwrap()
+        }
+    }
 }
 
+/*
+ * A zero-copy view of a record as it is laid out in the record table. Every
+ * field is a little-endian integer at a fixed offset, so decoding is just a
+ * handful of unaligned loads, and a whole record table can be viewed as a
+ * slice of these without copying.
+ */
+#[repr(C)]
 #[derive(Debug)]
+pub struct RawRecord {
+    number: [u8; 4],
+    data_len: [u8; 4],
+    count_hi: [u8; 4],
+    count_lo: [u8; 4],
+    timestamp_ns_hi: [u8; 4],
+    timestamp_ns_lo: [u8; 4],
+    lfsr: [u8; 2],
+    metadata_info: [u8; 2],
+    flags: [u8; 4],
+    data_offset_hi: [u8; 4],
+    data_offset_lo: [u8; 4],
+}
+
+const _: () = assert!(std::mem::size_of::<RawRecord>() == 40);
+const _: () = assert!(std::mem::align_of::<RawRecord>() == 1);
+
+impl RawRecord {
+    pub fn from_bytes(input: &[u8; 40]) -> &Self {
+        /* Safety: RawRecord is 40 bytes long, has no padding, and is byte-aligned. */
+        unsafe { &*(input as *const [u8; 40] as *const Self) }
+    }
+
+    pub fn slice_from_bytes(input: &[u8]) -> &[Self] {
+        /* Safety: Same as above. Any trailing partial record is excluded. */
+        unsafe { std::slice::from_raw_parts(input.as_ptr() as *const Self, input.len() / 40) }
+    }
+
+    pub fn as_bytes(&self) -> &[u8; 40] {
+        /* Safety: Same as above. */
+        unsafe { &*(self as *const Self as *const [u8; 40]) }
+    }
+
+    pub fn is_null(&self) -> bool {
+        self.as_bytes().iter().all(|b| *b == 0)
+    }
+
+    pub fn number(&self) -> u32 {
+        u32::from_le_bytes(self.number)
+    }
+
+    pub fn data_len(&self) -> u32 {
+        u32::from_le_bytes(self.data_len)
+    }
+
+    pub fn count(&self) -> u64 {
+        u32_hi_lo_to_u64(
+            u32::from_le_bytes(self.count_hi),
+            u32::from_le_bytes(self.count_lo),
+        )
+    }
+
+    pub fn timestamp_ns(&self) -> u64 {
+        u32_hi_lo_to_u64(
+            u32::from_le_bytes(self.timestamp_ns_hi),
+            u32::from_le_bytes(self.timestamp_ns_lo),
+        )
+    }
+
+    pub fn lfsr(&self) -> u16 {
+        u16::from_le_bytes(self.lfsr)
+    }
+
+    pub fn metadata_info(&self) -> u16 {
+        u16::from_le_bytes(self.metadata_info)
+    }
+
+    pub fn flags(&self) -> u32 {
+        u32::from_le_bytes(self.flags)
+    }
+
+    pub fn data_offset(&self) -> u64 {
+        u32_hi_lo_to_u64(
+            u32::from_le_bytes(self.data_offset_hi),
+            u32::from_le_bytes(self.data_offset_lo),
+        )
+    }
+
+    pub fn to_record(&self) -> Record {
+        let metadata_info = self.metadata_info();
+
+        Record {
+            number: self.number(),
+            data_len: self.data_len(),
+            count: self.count(),
+            timestamp_ns: self.timestamp_ns(),
+            lfsr: self.lfsr(),
+            extra_metadata_present: (metadata_info & 0x8000) != 0,
+            metadata_offset: metadata_info & 0x7FFF,
+            flags: self.flags(),
+            data_offset: self.data_offset(),
+        }
+    }
+}
+
+pub fn decode_records(table: &[u8], records: &mut Vec<Record>) {
+    records.extend(
+        RawRecord::slice_from_bytes(table)
+            .iter()
+            .map(RawRecord::to_record),
+    );
+}
+
+/*
+ * The record table decoded into one dense vector per field, so that scans
+ * which only test one or two fields touch only those columns. Record numbers
+ * are implicit: the record at index i is number first_record_number + i.
+ */
+#[derive(Debug, Default)]
+pub struct RecordColumns {
+    pub first_record_number: u32,
+    pub timestamps_ns: Vec<u64>,
+    pub flags: Vec<u32>,
+    pub data_len: Vec<u32>,
+    pub data_offset: Vec<u64>,
+    pub metadata_info: Vec<u16>,
+    pub lfsr: Vec<u16>,
+}
+
+impl RecordColumns {
+    pub fn new(first_record_number: u32) -> Self {
+        Self {
+            first_record_number,
+            ..Default::default()
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.timestamps_ns.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.timestamps_ns.is_empty()
+    }
+
+    pub fn record_number(&self, index: usize) -> u32 {
+        self.first_record_number + <usize as TryInto<u32>>::try_into(index).unwrap()
+    }
+
+    /* Returns false if the table ended with a null record. */
+    pub fn extend_from_table(&mut self, table: &[u8]) -> bool {
+        let raw_records = RawRecord::slice_from_bytes(table);
+        let valid = raw_records
+            .iter()
+            .position(RawRecord::is_null)
+            .unwrap_or(raw_records.len());
+        let raw_records = &raw_records[..valid];
+
+        self.timestamps_ns.reserve(valid);
+        self.flags.reserve(valid);
+        self.data_len.reserve(valid);
+        self.data_offset.reserve(valid);
+        self.metadata_info.reserve(valid);
+        self.lfsr.reserve(valid);
+
+        let first = self.record_number(self.len());
+        for (raw_record, number) in raw_records.iter().zip(first..) {
+            assert_eq!(raw_record.number(), number, "record number mismatch");
+
+            self.timestamps_ns.push(raw_record.timestamp_ns());
+            self.flags.push(raw_record.flags());
+            self.data_len.push(raw_record.data_len());
+            self.data_offset.push(raw_record.data_offset());
+            self.metadata_info.push(raw_record.metadata_info());
+            self.lfsr.push(raw_record.lfsr());
+        }
+
+        valid == raw_records.len() && valid * 40 == table.len()
+    }
+
+    pub fn from_table(table: &[u8], first_record_number: u32) -> Self {
+        let mut columns = Self::new(first_record_number);
+        columns.extend_from_table(table);
+
+        columns
+    }
+
+    pub fn select_flags(
+        &self,
+        range: std::ops::Range<usize>,
+        predicate: &scan::FlagsPredicate,
+    ) -> scan::SelectionBitmap {
+        scan::scan_flags(&self.flags[range], predicate)
+    }
+
+    /* Returns the range of indices whose timestamps fall within a time range. */
+    pub fn time_range<B>(&self, range: B) -> std::ops::Range<usize>
+    where
+        B: RangeBounds<u64>,
+    {
+        let start = self
+            .timestamps_ns
+            .partition_point(|ts| *ts < time_range_start(&range));
+        let end = start + self.timestamps_ns[start..].partition_point(|ts| range.contains(ts));
+
+        start..end
+    }
+}
+
+#[derive(Debug, Clone)]
 pub struct TimestampsNs {
     pub first: u64,
     pub last: u64,
@@ -107,13 +358,13 @@ pub struct TimestampsNs {
     pub trigger: u64,
 }
 
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct ChannelNames {
     pub a: String,
     pub b: String,
 }
 
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct CoarseTimestamp {
     pub hour: u16,
     pub minute: u16,
@@ -134,7 +385,58 @@ impl CoarseTimestamp {
     }
 }
 
-#[derive(Debug)]
+/*
+ * Decodes the header in a single pass, reading each field exactly once. The
+ * length prefix of each string determines how much is read next, so nothing is
+ * ever re-read or re-parsed.
+ */
+struct HeaderReader<'a, R> {
+    reader: &'a mut R,
+    len: usize,
+}
+
+impl<'a, R> HeaderReader<'a, R>
+where
+    R: Read,
+{
+    fn bytes<const N: usize>(&mut self) -> Option<[u8; N]> {
+        let mut buf = [0; N];
+        self.reader.read_exact(&mut buf).ok()?;
+        self.len += N;
+
+        Some(buf)
+    }
+
+    fn be_u16(&mut self) -> Option<u16> {
+        self.bytes().map(u16::from_be_bytes)
+    }
+
+    fn be_u32(&mut self) -> Option<u32> {
+        self.bytes().map(u32::from_be_bytes)
+    }
+
+    fn be_u64(&mut self) -> Option<u64> {
+        self.bytes().map(u64::from_be_bytes)
+    }
+
+    fn string(&mut self) -> Option<String> {
+        let mut buf: Vec<u8> = vec![0; self.be_u16()?.into()];
+        self.reader.read_exact(&mut buf).ok()?;
+        self.len += buf.len();
+
+        Some(String::from_utf8_lossy(&buf).into())
+    }
+
+    fn coarse_timestamp(&mut self) -> Option<CoarseTimestamp> {
+        Some(CoarseTimestamp::from_tuple((
+            self.be_u16()?,
+            self.be_u16()?,
+            self.be_u16()?,
+        )))
+    }
+}
+
+#[derive(Debug, Clone)]
 pub struct PadHeader {
     pub module_type: String,
     pub port_id: String,
@@ -159,106 +461,75 @@ pub struct PadHeader {
 }
 
 impl PadHeader {
+    /* Only PAD files from PCIe analyzer modules are supported. */
+    pub fn is_pcie_module(&self) -> bool {
+        matches!(
+            self.module_type.as_str(),
+            "AGT_MODULE_ONEPORT_PCIEXPRESS_X8"
+                | "AGT_MODULE_ONEPORT_PCIEXPRESS_X16"
+                | "AGT_MODULE_ONEPORT_PCIEXPRESS_GEN2"
+                | "AGT_MODULE_ONEPORT_PCIEXPRESS_GEN2_X16"
+                | "AGT_MODULE_ONEPORT_PCIEXPRESS_MRIOV_X8"
+                | "AGT_MODULE_ONEPORT_PCIEXPRESS_MRIOV_X16"
+        )
+    }
+
+    fn read_from<R>(pad_reader: &mut R) -> Option<(Self, usize)>
+    where
+        R: Read,
+    {
+        let mut reader = HeaderReader {
+            reader: pad_reader,
+            len: 0,
+        };
+
+        /* Struct fields are evaluated in order, which is also the order they appear in the file. */
+        let header = Self {
+            module_type: reader.string()?,
+            port_id: reader.string()?,
+            rx_or_tx: reader.string()?,
+            description: reader.string()?,
+            format_code: reader.string()?,
+            numbers0: (reader.be_u32()?, reader.be_u32()?),
+            trigger_record_number: reader.be_u32()?,
+            three: reader.be_u32()?,
+            first_record_number: reader.be_u32()?,
+            last_record_number: reader.be_u32()?,
+            record_len: reader.be_u32()?,
+            timestamp_array_size: reader.be_u32()?,
+            timestamps_ns: TimestampsNs {
+                first: reader.be_u64()?,
+                last: reader.be_u64()?,
+                stop: reader.be_u64()?,
+                trigger: reader.be_u64()?,
+            },
+            guid: reader.string()?,
+            channel_names: ChannelNames {
+                a: reader.string()?,
+                b: reader.string()?,
+            },
+            start_time: reader.coarse_timestamp()?,
+            stop_time: reader.coarse_timestamp()?,
+            records_offset: reader.be_u64()?,
+            record_data_offset: reader.be_u64()?,
+            start: reader.string()?,
+        };
+
+        Some((header, reader.len))
+    }
+
+    pub fn from_reader<R>(pad_reader: &mut R) -> Option<Self>
+    where
+        R: Read,
+    {
+        Self::read_from(pad_reader).map(|(header, _)| header)
+    }
+
     pub fn from_bufreader<R>(pad_reader: &mut BufReader<R>) -> Option<Self>
     where
         R: Read + Seek,
     {
-        let mut buffer: Vec<u8> = vec![0; 0];
-        let mut expand: usize = 0;
-        loop {
-            buffer.resize_with(buffer.len() + expand, Default::default);
-            pad_reader.read_exact(buffer.as_mut_slice()).unwrap();
-            //println!("bytes read: {}", bytes_read);
-            match tuple((
-                tuple((
-                    parse_string,
-                    parse_string,
-                    parse_string,
-                    parse_string,
-                    parse_string,
-                )),
-                tuple((be_u32, be_u32)),
-                be_u32,
-                be_u32,
-                be_u32,
-                be_u32,
-                be_u32,
-                be_u32,
-                be_u64,
-                be_u64,
-                be_u64,
-                be_u64,
-                parse_string,
-                tuple((parse_string, parse_string)),
-                tuple((be_u16, be_u16, be_u16)),
-                tuple((be_u16, be_u16, be_u16)),
-                be_u64,
-                be_u64,
-                parse_string,
-            ))(buffer.as_slice())
-            {
-                Ok((
-                    _,
-                    (
-                        (module_type, port_id, rx_or_tx, description, format_code),
-                        numbers0,
-                        trigger_record_number,
-                        three,
-                        first_record_number,
-                        last_record_number,
-                        record_len,
-                        timestamp_array_size,
-                        timestamps_ns_first,
-                        timestamps_ns_last,
-                        timestamps_ns_stop,
-                        timestamps_ns_trigger,
-                        guid,
-                        (channel_names_a, channel_names_b),
-                        start_time,
-                        stop_time,
-                        records_offset,
-                        record_data_offset,
-                        start,
-                    ),
-                )) => {
-                    return Some(Self {
-                        module_type: String::from_utf8_lossy(module_type).into(),
-                        port_id: String::from_utf8_lossy(port_id).into(),
-                        rx_or_tx: String::from_utf8_lossy(rx_or_tx).into(),
-                        description: String::from_utf8_lossy(description).into(),
-                        format_code: String::from_utf8_lossy(format_code).into(),
-                        numbers0,
-                        trigger_record_number,
-                        three,
-                        first_record_number,
-                        last_record_number,
-                        record_len,
-                        timestamp_array_size,
-                        timestamps_ns: TimestampsNs {
-                            first: timestamps_ns_first,
-                            last: timestamps_ns_last,
-                            stop: timestamps_ns_stop,
-                            trigger: timestamps_ns_trigger,
-                        },
-                        guid: String::from_utf8_lossy(guid).into(),
-                        channel_names: ChannelNames {
-                            a: String::from_utf8_lossy(channel_names_a).into(),
-                            b: String::from_utf8_lossy(channel_names_b).into(),
-                        },
-                        start_time: CoarseTimestamp::from_tuple(start_time),
-                        stop_time: CoarseTimestamp::from_tuple(stop_time),
-                        records_offset,
-                        record_data_offset,
-                        start: String::from_utf8_lossy(start).into(),
-                    })
-                }
-                Err(nom::Err::Incomplete(nom::Needed::Size(n))) => expand = n.get(),
-                _ => return None,
-            }
-            pad_reader
-                .seek_relative(-(<usize as TryInto<i64>>::try_into(buffer.len()).unwrap()))
-                .unwrap();
-        }
+        Self::from_reader(pad_reader)
     }
 
     pub fn from_file(pad_file: &mut File) -> Option<Self> {
@@ -266,6 +537,177 @@ impl PadHeader {
 
         Self::from_bufreader(&mut pad_reader)
     }
+
+    pub fn record_range<B>(&self, range: B) -> RangeInclusive<u32>
+    where
+        B: RangeBounds<u32>,
+    {
+        clamp_record_range(&range, self.first_record_number, self.last_record_number)
+    }
+
+    pub fn record_offset(&self, number: u32) -> Option<u64> {
+        if number < self.first_record_number || number > self.last_record_number {
+            return None;
+        }
+
+        let index: u64 = (number - self.first_record_number).into();
+
+        Some(self.records_offset + index * <u32 as Into<u64>>::into(self.record_len))
+    }
+}
+
+pub(crate) fn clamp_record_range<B>(range: &B, first: u32, last: u32) -> RangeInclusive<u32>
+where
+    B: RangeBounds<u32>,
+{
+    let start = match range.start_bound() {
+        Bound::Included(n) => *n,
+        Bound::Excluded(n) => n.saturating_add(1),
+        Bound::Unbounded => 0,
+    }
+    .max(first);
+
+    let end = match range.end_bound() {
+        Bound::Included(n) => Some(*n),
+        Bound::Excluded(n) => n.checked_sub(1),
+        Bound::Unbounded => Some(u32::MAX),
+    };
+
+    match end {
+        Some(end) => start..=end.min(last),
+        /* Empty range */
+        None => 1..=0,
+    }
+}
+
+pub(crate) fn time_range_start<B>(range: &B) -> u64
+where
+    B: RangeBounds<u64>,
+{
+    match range.start_bound() {
+        Bound::Included(ns) => *ns,
+        Bound::Excluded(ns) => ns.saturating_add(1),
+        Bound::Unbounded => 0,
+    }
+}
+
+/*
+ * Record timestamps increase monotonically, so the first record at or after a
+ * given time can be found by bisecting the fixed-stride record table. Null
+ * records sort after every valid record.
+ */
+fn find_first_record_at_time<F>(
+    header: &PadHeader,
+    timestamp_ns: u64,
+    mut get_timestamp_ns: F,
+) -> Option<u32>
+where
+    F: FnMut(u32) -> Option<u64>,
+{
+    let mut lo: u64 = header.first_record_number.into();
+    let mut hi: u64 = <u32 as Into<u64>>::into(header.last_record_number) + 1;
+
+    while lo < hi {
+        let mid = lo + (hi - lo) / 2;
+        match get_timestamp_ns(mid.try_into().unwrap()) {
+            Some(ts) if ts < timestamp_ns => lo = mid + 1,
+            _ => hi = mid,
+        }
+    }
+
+    match get_timestamp_ns(lo.try_into().ok()?) {
+        Some(_) => lo.try_into().ok(),
+        None => None,
+    }
+}
+
+/*
+ * The record table is zero-filled after the last valid record, so the number
+ * of valid records can be found by bisecting for the first null record.
+ */
+fn find_last_valid_record<F>(header: &PadHeader, mut is_valid: F) -> Option<u32>
+where
+    F: FnMut(u32) -> bool,
+{
+    let first: u64 = header.first_record_number.into();
+    let mut lo = first;
+    let mut hi: u64 = <u32 as Into<u64>>::into(header.last_record_number) + 1;
+
+    while lo < hi {
+        let mid = lo + (hi - lo) / 2;
+        match is_valid(mid.try_into().unwrap()) {
+            true => lo = mid + 1,
+            false => hi = mid,
+        }
+    }
+
+    match lo > first {
+        true => (lo - 1).try_into().ok(),
+        false => None,
+    }
+}
+
+fn record_count_through(header: &PadHeader, last_valid: Option<u32>) -> u32 {
+    match last_valid {
+        Some(last) => last - header.first_record_number + 1,
+        None => 0,
+    }
+}
+
+/*
+ * Splits a record range into chunks for parallel processing, leaving out the
+ * records past the null record so no worker is handed an empty chunk.
+ */
+pub(crate) fn par_chunk_ranges<B>(
+    header: &PadHeader,
+    range: B,
+    last_valid: Option<u32>,
+    chunk_len: usize,
+) -> Vec<RangeInclusive<u32>>
+where
+    B: RangeBounds<u32>,
+{
+    let range = header.record_range(range);
+
+    match last_valid {
+        Some(last) => par::chunk_ranges(*range.start()..=last.min(*range.end()), chunk_len),
+        None => Vec::new(),
+    }
+}
+
+pub fn read_record<R>(
+    reader: &mut R,
+    header: &PadHeader,
+    number: u32,
+) -> Result<Option<Record>, std::io::Error>
+where
+    R: Read + Seek,
+{
+    let offset = match header.record_offset(number) {
+        Some(offset) => offset,
+        None => return Ok(None),
+    };
+
+    reader.seek(SeekFrom::Start(offset))?;
+
+    let mut record_buffer = [0; 40];
+
+    reader.read_exact(&mut record_buffer)?;
+
+    let raw_record = RawRecord::from_bytes(&record_buffer);
+
+    /* Handle null record */
+    if raw_record.is_null() {
+        return Ok(None);
+    }
+
+    let record = raw_record.to_record();
+
+    if record.number != number {
+        return Err(std::io::ErrorKind::InvalidData.into());
+    }
+
+    Ok(Some(record))
 }
 
 #[derive(Debug)]
@@ -285,25 +727,23 @@ impl Records {
     }
 }
 
-impl Iterator for Records {
-    type Item = Record;
-
-    fn next(&mut self) -> Option<Self::Item> {
+impl Records {
+    fn next_into(&mut self, record_buffer: &mut [u8; 40]) -> Option<Record> {
         if self.curr > self.last {
             return None;
         }
 
-        let mut record_buffer = [0; 40];
+        self.reader.read_exact(record_buffer).unwrap();
 
-        self.reader.read_exact(&mut record_buffer).unwrap();
+        let raw_record = RawRecord::from_bytes(record_buffer);
 
         /* Handle null record */
-        if record_buffer.iter().all(|b| *b == 0) {
+        if raw_record.is_null() {
             self.curr = self.last + 1;
             return None;
         }
 
-        let record = Record::from_slice(&record_buffer).unwrap();
+        let record = raw_record.to_record();
 
         assert_eq!(record.number, self.curr, "record number mismatch");
 
@@ -313,6 +753,16 @@ impl Iterator for Records {
     }
 }
 
+impl Iterator for Records {
+    type Item = Record;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let mut record_buffer = [0; 40];
+
+        self.next_into(&mut record_buffer)
+    }
+}
+
 #[derive(Debug)]
 pub struct RecordReader {
     data_reader: BufReader<File>,
@@ -320,7 +770,7 @@ pub struct RecordReader {
 }
 
 impl RecordReader {
-    fn get_data_for_record(&mut self, record: &Record, exclude_metadata: bool) -> Vec<u8> {
+    fn read_data_into(&mut self, record: &Record, exclude_metadata: bool, buf: &mut Vec<u8>) {
         self.data_reader
             .seek_relative(
                 <u64 as TryInto<i64>>::try_into(record.data_offset).unwrap()
@@ -328,22 +778,33 @@ impl RecordReader {
             )
             .unwrap();
 
-        let data_read_len = if exclude_metadata && record.metadata_offset > 0 {
-            record.metadata_offset.into()
-        } else {
-            record.data_len.try_into().unwrap()
-        };
+        let data_read_len = record.data_read_len(exclude_metadata);
 
-        let mut buf: Vec<u8> = vec![0; data_read_len];
+        /* Reuses the buffer's existing allocation whenever it is large enough. */
+        buf.resize(data_read_len, 0);
 
         self.data_reader.read_exact(buf.as_mut_slice()).unwrap();
 
         self.curr_data_offset = <u64 as TryInto<i64>>::try_into(record.data_offset).unwrap()
             + <usize as TryInto<i64>>::try_into(buf.len()).unwrap();
+    }
+
+    fn get_data_for_record(&mut self, record: &Record, exclude_metadata: bool) -> Vec<u8> {
+        let mut buf: Vec<u8> = Vec::new();
+
+        self.read_data_into(record, exclude_metadata, &mut buf);
 
         buf
     }
 
+    pub fn read_data_without_metadata_into(&mut self, record: &Record, buf: &mut Vec<u8>) {
+        self.read_data_into(record, true, buf)
+    }
+
+    pub fn read_all_data_into(&mut self, record: &Record, buf: &mut Vec<u8>) {
+        self.read_data_into(record, false, buf)
+    }
+
     pub fn get_data_for_record_without_metadata(&mut self, record: &Record) -> Vec<u8> {
         self.get_data_for_record(record, true)
     }
@@ -353,51 +814,1332 @@ impl RecordReader {
     }
 }
 
-#[derive(Debug)]
-pub struct PadFile {
-    pub header: PadHeader,
-    pub records: Records,
-    pub record_reader: RecordReader,
+pub const COALESCED_BATCH_LEN: usize = 16 * 1024;
+
+#[derive(Debug, Default)]
+pub struct RecordBatch {
+    first: u32,
+    table: Vec<u8>,
+    data: Vec<u8>,
+    data_offset: u64,
 }
 
-impl PadFile {
-    pub fn from_filename(filename: &str) -> Result<Self, std::io::Error> {
-        let mut pad_reader = match File::open(filename) {
-            Ok(f) => BufReader::new(f),
-            Err(e) => return Err(e),
-        };
+impl RecordBatch {
+    pub fn new() -> Self {
+        Default::default()
+    }
 
-        let mut data_reader = match File::open(filename) {
-            Ok(f) => BufReader::new(f),
-            Err(e) => return Err(e),
-        };
+    pub fn len(&self) -> usize {
+        self.table.len() / 40
+    }
 
-        let header = PadHeader::from_bufreader(&mut pad_reader).unwrap();
+    pub fn is_empty(&self) -> bool {
+        self.table.is_empty()
+    }
 
-        assert_eq!(header.record_len, 40, "record length mismatch");
-        assert_eq!(
-            header.timestamp_array_size, 8,
-            "timestamp array size mismatch"
-        );
+    /*
+     * CoalescedReader::read_batch has checked that every record's data lies
+     * within the batch's data span, so the slicing here can't go out of bounds.
+     */
+    pub fn records(&self) -> impl Iterator<Item = RecordView<'_>> {
+        RawRecord::slice_from_bytes(&self.table)
+            .iter()
+            .map(|raw_record| {
+                let raw = raw_record.as_bytes();
+                let record = raw_record.to_record();
 
-        pad_reader
-            .seek(std::io::SeekFrom::Start(header.records_offset))
-            .unwrap();
+                let data_start: usize = (record.data_offset - self.data_offset).try_into().unwrap();
+                let data_end =
+                    data_start + <u32 as TryInto<usize>>::try_into(record.data_len).unwrap();
+                let data = &self.data[data_start..data_end];
 
-        data_reader
-            .seek(std::io::SeekFrom::Start(header.record_data_offset))
-            .unwrap();
+                RecordView { record, raw, data }
+            })
+    }
+}
 
-        let first = header.first_record_number;
-        let last = header.last_record_number;
+/*
+ * Reads the record table and the record data through a single stream. Each
+ * batch is one large read of consecutive record entries followed by one large
+ * read of the data span they cover, which is contiguous because data offsets
+ * increase monotonically.
+ */
+#[derive(Debug)]
+pub struct CoalescedReader<R> {
+    reader: R,
+    curr: u32,
+    last: u32,
+    records_offset: u64,
+    record_data_offset: u64,
+    batch_len: usize,
+}
 
-        Ok(Self {
-            header,
-            records: Records::new(first, last, pad_reader),
-            record_reader: RecordReader {
-                data_reader,
-                curr_data_offset: 0,
-            },
-        })
+impl<R> CoalescedReader<R>
+where
+    R: Read + Seek,
+{
+    pub fn new<B>(reader: R, header: &PadHeader, range: B, batch_len: usize) -> Self
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = header.record_range(range);
+
+        Self {
+            reader,
+            curr: *range.start(),
+            last: *range.end(),
+            records_offset: header
+                .record_offset(*range.start())
+                .unwrap_or(header.records_offset),
+            record_data_offset: header.record_data_offset,
+            batch_len: batch_len.max(1),
+        }
+    }
+
+    pub fn read_batch(&mut self, batch: &mut RecordBatch) -> Result<bool, std::io::Error> {
+        batch.table.clear();
+        batch.data.clear();
+
+        if self.curr > self.last {
+            return Ok(false);
+        }
+
+        let remaining: usize = (self.last - self.curr).try_into().unwrap();
+        let count = (remaining + 1).min(self.batch_len);
+
+        batch.first = self.curr;
+        batch.table.resize(count * 40, 0);
+        self.reader.seek(SeekFrom::Start(self.records_offset))?;
+        self.reader.read_exact(&mut batch.table)?;
+
+        /* Handle null record */
+        if let Some(null_index) = RawRecord::slice_from_bytes(&batch.table)
+            .iter()
+            .position(RawRecord::is_null)
+        {
+            batch.table.truncate(null_index * 40);
+            self.curr = self.last + 1;
+        } else {
+            self.curr += <usize as TryInto<u32>>::try_into(count).unwrap();
+            self.records_offset += <usize as TryInto<u64>>::try_into(batch.table.len()).unwrap();
+        }
+
+        if batch.table.is_empty() {
+            return Ok(false);
+        }
+
+        /*
+         * The data span is only contiguous if the record numbers are in
+         * sequence and each record's data starts no earlier than where the
+         * previous record's data ended.
+         */
+        let raw_records = RawRecord::slice_from_bytes(&batch.table);
+        let data_start = raw_records[0].data_offset();
+        let mut data_end = data_start;
+        for (raw_record, number) in raw_records.iter().zip(batch.first..) {
+            if raw_record.number() != number || raw_record.data_offset() < data_end {
+                return Err(std::io::ErrorKind::InvalidData.into());
+            }
+            data_end = raw_record
+                .data_offset()
+                .checked_add(<u32 as Into<u64>>::into(raw_record.data_len()))
+                .ok_or(std::io::ErrorKind::InvalidData)?;
+        }
+        let data_len: usize = (data_end - data_start)
+            .try_into()
+            .map_err(|_| std::io::ErrorKind::InvalidData)?;
+        let data_position = self
+            .record_data_offset
+            .checked_add(data_start)
+            .ok_or(std::io::ErrorKind::InvalidData)?;
+
+        batch.data_offset = data_start;
+        batch.data.resize(data_len, 0);
+        self.reader.seek(SeekFrom::Start(data_position))?;
+        self.reader.read_exact(&mut batch.data)?;
+
+        Ok(true)
+    }
+
+    pub fn for_each_record<F>(&mut self, mut f: F) -> Result<(), std::io::Error>
+    where
+        F: FnMut(&RecordView),
+    {
+        let mut batch = RecordBatch::new();
+
+        while self.read_batch(&mut batch)? {
+            for record_view in batch.records() {
+                f(&record_view);
+            }
+        }
+
+        Ok(())
+    }
+}
+
+pub const PREFETCH_DEPTH: usize = 4;
+
+/*
+ * Runs a CoalescedReader on a background thread that fills a ring of batch
+ * buffers ahead of the consumer, so that reading the next batch overlaps with
+ * processing the current one. Consumed batches are handed back to the thread
+ * with recycle() so their buffers can be reused.
+ */
+#[derive(Debug)]
+pub struct PrefetchReader {
+    batches: Receiver<Result<RecordBatch, std::io::Error>>,
+    recycled: Sender<RecordBatch>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl PrefetchReader {
+    pub fn new<R>(mut reader: CoalescedReader<R>, depth: usize) -> Self
+    where
+        R: Read + Seek + Send + 'static,
+    {
+        let depth = depth.max(1);
+        let (batch_sender, batches) = sync_channel(depth);
+        let (recycled, recycled_receiver) = channel::<RecordBatch>();
+
+        let thread = std::thread::spawn(move || {
+            let mut allocated = 0;
+            loop {
+                let mut batch = match recycled_receiver.try_recv() {
+                    Ok(batch) => batch,
+                    Err(_) if allocated < depth => {
+                        allocated += 1;
+                        RecordBatch::new()
+                    }
+                    Err(_) => match recycled_receiver.recv() {
+                        Ok(batch) => batch,
+                        /* The consumer has gone away. */
+                        Err(_) => return,
+                    },
+                };
+
+                match reader.read_batch(&mut batch) {
+                    Ok(true) => {
+                        if batch_sender.send(Ok(batch)).is_err() {
+                            return;
+                        }
+                    }
+                    Ok(false) => return,
+                    Err(e) => {
+                        let _ = batch_sender.send(Err(e));
+                        return;
+                    }
+                }
+            }
+        });
+
+        Self {
+            batches,
+            recycled,
+            thread: Some(thread),
+        }
+    }
+
+    pub fn next_batch(&mut self) -> Result<Option<RecordBatch>, std::io::Error> {
+        match self.batches.recv() {
+            Ok(Ok(batch)) => Ok(Some(batch)),
+            Ok(Err(e)) => Err(e),
+            Err(_) => {
+                if let Some(thread) = self.thread.take() {
+                    if let Err(panic) = thread.join() {
+                        std::panic::resume_unwind(panic);
+                    }
+                }
+                Ok(None)
+            }
+        }
+    }
+
+    pub fn recycle(&mut self, batch: RecordBatch) {
+        /* The thread may already have finished, in which case the batch is dropped. */
+        let _ = self.recycled.send(batch);
+    }
+
+    pub fn for_each_record<F>(&mut self, mut f: F) -> Result<(), std::io::Error>
+    where
+        F: FnMut(&RecordView),
+    {
+        while let Some(batch) = self.next_batch()? {
+            for record_view in batch.records() {
+                f(&record_view);
+            }
+            self.recycle(batch);
+        }
+
+        Ok(())
+    }
+}
+
+#[derive(Debug)]
+pub struct PadFile {
+    pub header: PadHeader,
+    pub records: Records,
+    pub record_reader: RecordReader,
+    filename: String,
+    table_reader: BufReader<File>,
+}
+
+impl PadFile {
+    pub fn from_filename(filename: &str) -> Result<Self, std::io::Error> {
+        let mut pad_reader = match File::open(filename) {
+            Ok(f) => BufReader::new(f),
+            Err(e) => return Err(e),
+        };
+
+        let mut data_reader = match File::open(filename) {
+            Ok(f) => BufReader::new(f),
+            Err(e) => return Err(e),
+        };
+
+        let table_reader = match File::open(filename) {
+            Ok(f) => BufReader::new(f),
+            Err(e) => return Err(e),
+        };
+
+        let header = PadHeader::from_bufreader(&mut pad_reader).unwrap();
+
+        assert_eq!(header.record_len, 40, "record length mismatch");
+        assert_eq!(
+            header.timestamp_array_size, 8,
+            "timestamp array size mismatch"
+        );
+
+        pad_reader
+            .seek(SeekFrom::Start(header.records_offset))
+            .unwrap();
+
+        data_reader
+            .seek(SeekFrom::Start(header.record_data_offset))
+            .unwrap();
+
+        let first = header.first_record_number;
+        let last = header.last_record_number;
+
+        Ok(Self {
+            header,
+            records: Records::new(first, last, pad_reader),
+            record_reader: RecordReader {
+                data_reader,
+                curr_data_offset: 0,
+            },
+            filename: filename.to_string(),
+            table_reader,
+        })
+    }
+
+    pub fn record(&mut self, number: u32) -> Result<Option<Record>, std::io::Error> {
+        read_record(&mut self.table_reader, &self.header, number)
+    }
+
+    pub fn records<B>(&self, range: B) -> Result<Records, std::io::Error>
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = self.header.record_range(range);
+
+        let mut reader = BufReader::new(File::open(&self.filename)?);
+
+        if let Some(offset) = self.header.record_offset(*range.start()) {
+            reader.seek(SeekFrom::Start(offset))?;
+        }
+
+        Ok(Records::new(*range.start(), *range.end(), reader))
+    }
+
+    pub fn seek_to_time(&mut self, timestamp_ns: u64) -> Result<Option<u32>, std::io::Error> {
+        let header = &self.header;
+        let reader = &mut self.table_reader;
+
+        let mut error = None;
+        let first = find_first_record_at_time(header, timestamp_ns, |number| {
+            match read_record(reader, header, number) {
+                Ok(record) => record.map(|r| r.timestamp_ns),
+                /* Records past the end of a truncated table sort after every valid record. */
+                Err(e) if e.kind() == std::io::ErrorKind::UnexpectedEof => None,
+                Err(e) => {
+                    error.get_or_insert(e);
+                    None
+                }
+            }
+        });
+
+        match error {
+            Some(e) => Err(e),
+            None => Ok(first),
+        }
+    }
+
+    pub fn probe_last_record(&mut self) -> Option<u32> {
+        let header = &self.header;
+        let reader = &mut self.table_reader;
+
+        find_last_valid_record(header, |number| {
+            matches!(read_record(reader, header, number), Ok(Some(_)))
+        })
+    }
+
+    pub fn probe_record_count(&mut self) -> u32 {
+        let last_valid = self.probe_last_record();
+
+        record_count_through(&self.header, last_valid)
+    }
+
+    pub fn records_in_time_range<B>(
+        &mut self,
+        range: B,
+    ) -> Result<impl Iterator<Item = Record>, std::io::Error>
+    where
+        B: RangeBounds<u64>,
+    {
+        let records = match self.seek_to_time(time_range_start(&range))? {
+            Some(first) => self.records(first..)?,
+            None => self.records(1..1)?,
+        };
+
+        Ok(records.take_while(move |r| range.contains(&r.timestamp_ns)))
+    }
+
+    pub fn for_each_record<F>(&mut self, f: F) -> Result<(), std::io::Error>
+    where
+        F: FnMut(&RecordView),
+    {
+        let range = self.records.curr..=self.records.last;
+        self.records.curr = self.records.last + 1;
+
+        /*
+         * The table reader is only used for random access, which always seeks
+         * before reading, so its file can be borrowed for the coalesced pass.
+         */
+        let mut reader = CoalescedReader::new(
+            self.table_reader.get_mut(),
+            &self.header,
+            range,
+            COALESCED_BATCH_LEN,
+        );
+
+        reader.for_each_record(f)
+    }
+
+    pub fn coalesced_reader<B>(
+        &self,
+        range: B,
+        batch_len: usize,
+    ) -> Result<CoalescedReader<File>, std::io::Error>
+    where
+        B: RangeBounds<u32>,
+    {
+        Ok(CoalescedReader::new(
+            File::open(&self.filename)?,
+            &self.header,
+            range,
+            batch_len,
+        ))
+    }
+
+    pub fn prefetch_reader<B>(
+        &self,
+        range: B,
+        batch_len: usize,
+        depth: usize,
+    ) -> Result<PrefetchReader, std::io::Error>
+    where
+        B: RangeBounds<u32>,
+    {
+        Ok(PrefetchReader::new(
+            self.coalesced_reader(range, batch_len)?,
+            depth,
+        ))
+    }
+
+    /*
+     * Processes the records in chunks of chunk_len records on all available
+     * cores. Each worker thread opens its own handle to the file and reads
+     * each of its chunks as a single coalesced batch.
+     */
+    pub fn par_for_each_chunk<B, T, F, S>(
+        &mut self,
+        range: B,
+        chunk_len: usize,
+        f: F,
+        mut sink: S,
+    ) -> Result<(), std::io::Error>
+    where
+        B: RangeBounds<u32>,
+        T: Send,
+        F: Fn(RangeInclusive<u32>, &RecordBatch) -> T + Sync,
+        S: FnMut(RangeInclusive<u32>, T) -> Result<(), std::io::Error>,
+    {
+        let last_valid = self.probe_last_record();
+        let ranges = par_chunk_ranges(&self.header, range, last_valid, chunk_len);
+
+        let header = &self.header;
+        let filename = &self.filename;
+        let ranges = &ranges;
+
+        par::try_for_each_ordered(
+            ranges.len(),
+            par::default_threads(),
+            || (File::open(filename), RecordBatch::new()),
+            |(file, batch), index| -> Result<T, std::io::Error> {
+                let file = match file {
+                    Ok(f) => f,
+                    Err(e) => return Err(std::io::Error::new(e.kind(), e.to_string())),
+                };
+
+                let range = ranges[index].clone();
+                CoalescedReader::new(file, header, range.clone(), chunk_len).read_batch(batch)?;
+
+                Ok(f(range, batch))
+            },
+            |index, value| sink(ranges[index].clone(), value),
+        )
+    }
+
+    pub fn par_chunks<B, T, F>(
+        &mut self,
+        range: B,
+        chunk_len: usize,
+        f: F,
+    ) -> Result<Vec<T>, std::io::Error>
+    where
+        B: RangeBounds<u32>,
+        T: Send,
+        F: Fn(RangeInclusive<u32>, &RecordBatch) -> T + Sync,
+    {
+        let mut results = Vec::new();
+        self.par_for_each_chunk(range, chunk_len, f, |_, value| {
+            results.push(value);
+            Ok(())
+        })?;
+
+        Ok(results)
+    }
+
+    pub fn columns<B>(&mut self, range: B) -> Result<RecordColumns, std::io::Error>
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = self.header.record_range(range);
+        let mut columns = RecordColumns::new(*range.start());
+
+        let offset = match self.header.record_offset(*range.start()) {
+            Some(offset) if range.start() <= range.end() => offset,
+            _ => return Ok(columns),
+        };
+        self.table_reader.seek(SeekFrom::Start(offset))?;
+
+        let mut remaining: usize = (range.end() - range.start()).try_into().unwrap();
+        remaining += 1;
+
+        let mut table: Vec<u8> = Vec::new();
+        while remaining > 0 {
+            let count = remaining.min(COALESCED_BATCH_LEN);
+            table.resize(count * 40, 0);
+            self.table_reader.read_exact(&mut table)?;
+            remaining -= count;
+
+            if !columns.extend_from_table(&table) {
+                break;
+            }
+        }
+
+        Ok(columns)
+    }
+}
+
+#[derive(Debug)]
+pub struct RecordView<'a> {
+    pub record: Record,
+    pub raw: &'a [u8],
+    data: &'a [u8],
+}
+
+impl<'a> RecordView<'a> {
+    pub fn data_without_metadata(&self) -> &'a [u8] {
+        /* A corrupt metadata offset could point past the end of the data. */
+        &self.data[..self.record.data_read_len(true).min(self.data.len())]
+    }
+
+    pub fn all_data(&self) -> &'a [u8] {
+        self.data
+    }
+
+    pub fn frame(&self) -> Option<frame::Frame<'a>> {
+        frame::Frame::parse(self.data_without_metadata())
+    }
+}
+
+#[derive(Debug)]
+pub struct MappedRecords<'a> {
+    curr: u32,
+    last: u32,
+    table: &'a [u8],
+    data: &'a [u8],
+}
+
+impl<'a> Iterator for MappedRecords<'a> {
+    type Item = Result<RecordView<'a>, std::io::Error>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.curr > self.last || self.table.len() < 40 {
+            return None;
+        }
+
+        let (raw, rest) = self.table.split_at(40);
+        self.table = rest;
+
+        let raw_record = RawRecord::from_bytes(raw.try_into().unwrap());
+
+        /* Handle null record */
+        if raw_record.is_null() {
+            self.table = &[];
+            return None;
+        }
+
+        let record = raw_record.to_record();
+
+        let data = <u64 as TryInto<usize>>::try_into(record.data_offset)
+            .ok()
+            .and_then(|start| {
+                start
+                    .checked_add(<u32 as TryInto<usize>>::try_into(record.data_len).unwrap())
+                    .map(|end| start..end)
+            })
+            .and_then(|range| self.data.get(range));
+
+        /* Stop at the first malformed record, rather than returning garbage after it. */
+        let data = match data {
+            Some(data) if record.number == self.curr => data,
+            _ => {
+                self.table = &[];
+                return Some(Err(std::io::ErrorKind::InvalidData.into()));
+            }
+        };
+
+        self.curr = self.curr.saturating_add(1);
+
+        Some(Ok(RecordView { record, raw, data }))
+    }
+}
+
+#[derive(Debug)]
+pub struct MappedPadFile {
+    pub header: PadHeader,
+    mmap: Mmap,
+}
+
+impl MappedPadFile {
+    pub fn from_filename(filename: &str) -> Result<Self, std::io::Error> {
+        let file = File::open(filename)?;
+
+        /*
+         * Safety: The mapping is only ever read, and PAD files are never
+         * modified once the analyzer has finished writing them.
+         */
+        let mmap = unsafe { Mmap::map(&file)? };
+
+        let header = match PadHeader::from_reader(&mut Cursor::new(&mmap[..])) {
+            Some(h) if h.record_len == 40 && h.timestamp_array_size == 8 => h,
+            _ => return Err(std::io::ErrorKind::InvalidData.into()),
+        };
+
+        /* A truncated or malformed file could put the record table or data past its end. */
+        let file_len: u64 = mmap.len().try_into().unwrap();
+        if header.records_offset > header.record_data_offset || header.record_data_offset > file_len
+        {
+            return Err(std::io::ErrorKind::InvalidData.into());
+        }
+
+        Ok(Self { header, mmap })
+    }
+
+    pub fn file_len(&self) -> u64 {
+        self.mmap.len().try_into().unwrap()
+    }
+
+    /* The raw PAD header, which ends where the record table starts. */
+    pub fn header_bytes(&self) -> &[u8] {
+        let end: usize = self.header.records_offset.try_into().unwrap();
+
+        &self.mmap[..end.min(self.mmap.len())]
+    }
+
+    pub fn record_table(&self) -> &[u8] {
+        let record_count: u64 = (<u32 as Into<u64>>::into(self.header.last_record_number) + 1)
+            .saturating_sub(self.header.first_record_number.into());
+        let start = self.header.records_offset.min(self.file_len());
+        let end = start.saturating_add(record_count * 40).min(self.file_len());
+
+        &self.mmap[start.try_into().unwrap()..end.try_into().unwrap()]
+    }
+
+    pub fn record_data(&self) -> &[u8] {
+        let start = self.header.record_data_offset.min(self.file_len());
+
+        &self.mmap[start.try_into().unwrap()..]
+    }
+
+    /* The record's entry in the record table, if it's there and isn't the null record. */
+    fn raw_record(&self, number: u32) -> Option<&RawRecord> {
+        let index: usize = number
+            .checked_sub(self.header.first_record_number)?
+            .try_into()
+            .unwrap();
+        let raw = self.record_table().get(index * 40..(index + 1) * 40)?;
+        let raw_record = RawRecord::from_bytes(raw.try_into().unwrap());
+
+        match raw_record.is_null() {
+            true => None,
+            false => Some(raw_record),
+        }
+    }
+
+    pub fn record(&self, number: u32) -> Result<Option<RecordView<'_>>, std::io::Error> {
+        self.records(number..=number).next().transpose()
+    }
+
+    pub fn records<B>(&self, range: B) -> MappedRecords<'_>
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = self.header.record_range(range);
+
+        let table = self.record_table();
+        let start: usize = range
+            .start()
+            .saturating_sub(self.header.first_record_number)
+            .try_into()
+            .unwrap();
+
+        MappedRecords {
+            curr: *range.start(),
+            last: *range.end(),
+            table: table.get(start * 40..).unwrap_or_default(),
+            data: self.record_data(),
+        }
+    }
+
+    pub fn seek_to_time(&self, timestamp_ns: u64) -> Option<u32> {
+        find_first_record_at_time(&self.header, timestamp_ns, |number| {
+            self.raw_record(number).map(|r| r.timestamp_ns())
+        })
+    }
+
+    pub fn probe_last_record(&self) -> Option<u32> {
+        find_last_valid_record(&self.header, |number| self.raw_record(number).is_some())
+    }
+
+    pub fn probe_record_count(&self) -> u32 {
+        record_count_through(&self.header, self.probe_last_record())
+    }
+
+    pub fn records_in_time_range<B>(
+        &self,
+        range: B,
+    ) -> impl Iterator<Item = Result<RecordView<'_>, std::io::Error>>
+    where
+        B: RangeBounds<u64>,
+    {
+        let records = match self.seek_to_time(time_range_start(&range)) {
+            Some(first) => self.records(first..),
+            None => self.records(1..1),
+        };
+
+        records.take_while(move |r| {
+            r.as_ref()
+                .map_or(true, |r| range.contains(&r.record.timestamp_ns))
+        })
+    }
+
+    pub fn for_each_record<F>(&self, mut f: F) -> Result<(), std::io::Error>
+    where
+        F: FnMut(&RecordView),
+    {
+        for record_view in self.records(..) {
+            f(&record_view?);
+        }
+
+        Ok(())
+    }
+
+    /*
+     * Processes the records in chunks of chunk_len records on all available
+     * cores. Workers share the mapping, so each chunk is just a view into it.
+     * Processing stops at the first chunk that fails, e.g. on a malformed record.
+     */
+    pub fn par_for_each_chunk<B, T, F, S>(
+        &self,
+        range: B,
+        chunk_len: usize,
+        f: F,
+        mut sink: S,
+    ) -> Result<(), std::io::Error>
+    where
+        B: RangeBounds<u32>,
+        T: Send,
+        F: Fn(RangeInclusive<u32>, MappedRecords<'_>) -> Result<T, std::io::Error> + Sync,
+        S: FnMut(RangeInclusive<u32>, T) -> Result<(), std::io::Error>,
+    {
+        let ranges = par_chunk_ranges(&self.header, range, self.probe_last_record(), chunk_len);
+
+        par::try_for_each_ordered(
+            ranges.len(),
+            par::default_threads(),
+            || (),
+            |_, index| f(ranges[index].clone(), self.records(ranges[index].clone())),
+            |index, value| sink(ranges[index].clone(), value),
+        )
+    }
+
+    pub fn par_chunks<B, T, F>(
+        &self,
+        range: B,
+        chunk_len: usize,
+        f: F,
+    ) -> Result<Vec<T>, std::io::Error>
+    where
+        B: RangeBounds<u32>,
+        T: Send,
+        F: Fn(RangeInclusive<u32>, MappedRecords<'_>) -> Result<T, std::io::Error> + Sync,
+    {
+        let mut results = Vec::new();
+        self.par_for_each_chunk(range, chunk_len, f, |_, value| {
+            results.push(value);
+            Ok(())
+        })?;
+
+        Ok(results)
+    }
+
+    pub fn columns<B>(&self, range: B) -> RecordColumns
+    where
+        B: RangeBounds<u32>,
+    {
+        let range = self.header.record_range(range);
+        let table = self.record_table();
+
+        let start: usize = range
+            .start()
+            .saturating_sub(self.header.first_record_number)
+            .try_into()
+            .unwrap();
+        let end: usize = match range.start() <= range.end() {
+            true => (range.end() - self.header.first_record_number + 1)
+                .try_into()
+                .unwrap(),
+            false => start,
+        };
+
+        RecordColumns::from_table(
+            table
+                .get(start * 40..(end * 40).min(table.len()))
+                .unwrap_or_default(),
+            *range.start(),
+        )
+    }
+}
+
+fn skip_bytes<R>(reader: &mut R, count: u64) -> Result<(), std::io::Error>
+where
+    R: Read,
+{
+    let skipped = std::io::copy(&mut reader.take(count), &mut std::io::sink())?;
+
+    if skipped != count {
+        return Err(std::io::ErrorKind::UnexpectedEof.into());
+    }
+
+    Ok(())
+}
+
+/*
+ * Reads a PAD file from a non-seekable stream, such as a pipe. Since the
+ * record table precedes the record data, the whole table is buffered, but the
+ * record data is streamed through a single reusable buffer.
+ */
+#[derive(Debug)]
+pub struct PadStream<R> {
+    pub header: PadHeader,
+    reader: R,
+    table: Vec<u8>,
+    position: u64,
+}
+
+impl<R> PadStream<R>
+where
+    R: Read,
+{
+    pub fn new(mut reader: R) -> Result<Self, std::io::Error> {
+        let (header, header_len) = match PadHeader::read_from(&mut reader) {
+            Some(h) => h,
+            None => return Err(std::io::ErrorKind::InvalidData.into()),
+        };
+
+        assert_eq!(header.record_len, 40, "record length mismatch");
+        assert_eq!(
+            header.timestamp_array_size, 8,
+            "timestamp array size mismatch"
+        );
+
+        let mut position: u64 = header_len.try_into().unwrap();
+
+        /* A malformed header could point the record table or data before the header's end. */
+        let records_skip = header
+            .records_offset
+            .checked_sub(position)
+            .ok_or(std::io::ErrorKind::InvalidData)?;
+        skip_bytes(&mut reader, records_skip)?;
+        position = header.records_offset;
+
+        let record_count: u64 = (<u32 as Into<u64>>::into(header.last_record_number) + 1)
+            .saturating_sub(header.first_record_number.into());
+        let table_space = header
+            .record_data_offset
+            .checked_sub(position)
+            .ok_or(std::io::ErrorKind::InvalidData)?;
+        let table_len = (record_count * 40).min(table_space);
+
+        let mut table: Vec<u8> = vec![0; table_len.try_into().unwrap()];
+        reader.read_exact(&mut table)?;
+        position += table_len;
+
+        skip_bytes(&mut reader, header.record_data_offset - position)?;
+        position = header.record_data_offset;
+
+        Ok(Self {
+            header,
+            reader,
+            table,
+            position,
+        })
+    }
+
+    pub fn for_each_record<F>(&mut self, mut f: F) -> Result<(), std::io::Error>
+    where
+        F: FnMut(&RecordView),
+    {
+        let mut data_buffer: Vec<u8> = Vec::with_capacity(4 * 1024);
+
+        for (raw_record, number) in RawRecord::slice_from_bytes(&self.table)
+            .iter()
+            .zip(self.header.first_record_number..)
+        {
+            /* Handle null record */
+            if raw_record.is_null() {
+                break;
+            }
+
+            let raw = raw_record.as_bytes();
+            let record = raw_record.to_record();
+
+            assert_eq!(record.number, number, "record number mismatch");
+
+            let data_position = match self
+                .header
+                .record_data_offset
+                .checked_add(record.data_offset)
+            {
+                /* The stream can't be rewound. */
+                Some(position) if position >= self.position => position,
+                _ => return Err(std::io::ErrorKind::InvalidData.into()),
+            };
+            skip_bytes(&mut self.reader, data_position - self.position)?;
+
+            data_buffer.resize(record.data_len.try_into().unwrap(), 0);
+            self.reader.read_exact(&mut data_buffer)?;
+            self.position = data_position + <u32 as Into<u64>>::into(record.data_len);
+
+            f(&RecordView {
+                record,
+                raw,
+                data: &data_buffer,
+            });
+        }
+
+        self.table.clear();
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testutil::*;
+
+    #[test]
+    fn mapped_records_match_the_file() {
+        let records = test_records(100);
+        let file = TempFile::new(&pad_file_bytes(500, &records));
+        let pad_file = MappedPadFile::from_filename(file.path()).unwrap();
+
+        assert_eq!(pad_file.probe_record_count(), 100);
+        let views: Vec<RecordView> = pad_file.records(..).map(Result::unwrap).collect();
+        assert_eq!(views.len(), 100);
+        for ((view, expected), number) in views.iter().zip(records.iter()).zip(500..) {
+            assert_eq!(view.record.number, number);
+            assert_eq!(view.record.timestamp_ns, expected.timestamp_ns);
+            assert_eq!(view.all_data(), &expected.data[..]);
+        }
+        assert_eq!(pad_file.record(550).unwrap().unwrap().record.number, 550);
+        assert!(pad_file.record(600).unwrap().is_none());
+    }
+
+    #[test]
+    fn mapped_file_rejects_bad_headers() {
+        let file = TempFile::new(b"not a PAD file");
+        let error = MappedPadFile::from_filename(file.path()).unwrap_err();
+        assert_eq!(error.kind(), std::io::ErrorKind::InvalidData);
+
+        /* Record data past the end of the file */
+        let mut bytes = pad_header(1, 2, 200, 1 << 40);
+        bytes.resize(300, 0);
+        let file = TempFile::new(&bytes);
+        assert!(MappedPadFile::from_filename(file.path()).is_err());
+    }
+
+    #[test]
+    fn mapped_records_report_truncated_data() {
+        let records = test_records(10);
+        let mut bytes = pad_file_bytes(1, &records);
+        bytes.truncate(bytes.len() - 3);
+        let file = TempFile::new(&bytes);
+        let pad_file = MappedPadFile::from_filename(file.path()).unwrap();
+
+        let results: Vec<_> = pad_file.records(..).collect();
+        assert_eq!(results.len(), 10);
+        assert!(results[..9].iter().all(Result::is_ok));
+        assert_eq!(
+            results[9].as_ref().unwrap_err().kind(),
+            std::io::ErrorKind::InvalidData
+        );
+        assert!(pad_file.for_each_record(|_| ()).is_err());
+    }
+
+    #[test]
+    fn mapped_records_report_corrupt_entries() {
+        let records = test_records(4);
+        let mut bytes = pad_file_bytes(1, &records);
+        let header = PadHeader::from_reader(&mut Cursor::new(&bytes[..])).unwrap();
+        let table: usize = header.records_offset.try_into().unwrap();
+
+        /* A data offset near u64::MAX, then a record number that is out of sequence */
+        bytes[table + 40..table + 80].copy_from_slice(&raw_record(2, 8, 1010, 0, u64::MAX - 4));
+        bytes[table + 80..table + 120].copy_from_slice(&raw_record(7, 0, 1020, 0, 0));
+        let file = TempFile::new(&bytes);
+        let pad_file = MappedPadFile::from_filename(file.path()).unwrap();
+
+        let mut records = pad_file.records(..);
+        assert!(records.next().unwrap().is_ok());
+        assert!(records.next().unwrap().is_err());
+        /* Nothing is returned after the first error. */
+        assert!(records.next().is_none());
+        assert!(pad_file.records(3..).next().unwrap().is_err());
+    }
+
+    #[test]
+    fn mapped_file_tolerates_extreme_record_numbers() {
+        let mut bytes = pad_file_bytes(u32::MAX - 1, &test_records(1));
+        /* The header's last record number is one past the last record, so it can't fit. */
+        let header_len = bytes.len() - 2 * 40 - 4;
+        bytes.splice(
+            ..header_len,
+            pad_header(
+                u32::MAX - 1,
+                u32::MAX,
+                header_len.try_into().unwrap(),
+                (header_len + 80).try_into().unwrap(),
+            ),
+        );
+        let file = TempFile::new(&bytes);
+        let pad_file = MappedPadFile::from_filename(file.path()).unwrap();
+
+        assert_eq!(pad_file.records(..).filter(Result::is_ok).count(), 1);
+        assert_eq!(pad_file.probe_last_record(), Some(u32::MAX - 1));
+    }
+
+    #[test]
+    fn metadata_offset_past_the_data_is_clamped() {
+        let mut raw = raw_record(1, 4, 0, 0, 0);
+        raw[26..28].copy_from_slice(&0x0100_u16.to_le_bytes());
+        let record = Record::from_bytes(&raw);
+        let data = [1, 2, 3, 4];
+        let view = RecordView {
+            record,
+            raw: &raw,
+            data: &data,
+        };
+
+        assert_eq!(view.data_without_metadata(), &data[..]);
+    }
+
+    #[test]
+    fn seek_to_time_finds_the_first_record_at_or_after_the_time() {
+        /* Timestamps 1000, 1010, ..., 1990 */
+        let file = TempFile::new(&pad_file_bytes(100, &test_records(100)));
+        let mapped = MappedPadFile::from_filename(file.path()).unwrap();
+        let mut pad_file = PadFile::from_filename(file.path()).unwrap();
+
+        for (timestamp_ns, expected) in [
+            (0, Some(100)),
+            (1000, Some(100)),
+            (1001, Some(101)),
+            (1500, Some(150)),
+            (1990, Some(199)),
+            (1991, None),
+            (u64::MAX, None),
+        ] {
+            assert_eq!(mapped.seek_to_time(timestamp_ns), expected);
+            assert_eq!(pad_file.seek_to_time(timestamp_ns).unwrap(), expected);
+        }
+
+        let in_window: Vec<u32> = pad_file
+            .records_in_time_range(1500..1550)
+            .unwrap()
+            .map(|r| r.number)
+            .collect();
+        assert_eq!(in_window, (150..155).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn seek_to_time_stops_at_a_truncated_table() {
+        let bytes = pad_file_bytes(1, &test_records(100));
+        let header = PadHeader::from_reader(&mut Cursor::new(&bytes[..])).unwrap();
+        let table: usize = header.records_offset.try_into().unwrap();
+
+        /* Cut the table in the middle of record 61 */
+        let file = TempFile::new(&bytes[..table + 60 * 40 + 20]);
+        let mut pad_file = PadFile::from_filename(file.path()).unwrap();
+
+        assert_eq!(pad_file.seek_to_time(1500).unwrap(), Some(51));
+        assert_eq!(pad_file.seek_to_time(1700).unwrap(), None);
+        assert_eq!(pad_file.probe_last_record(), Some(60));
+    }
+
+    #[test]
+    fn seek_to_time_reports_corrupt_records() {
+        let mut bytes = pad_file_bytes(1, &test_records(100));
+        let header = PadHeader::from_reader(&mut Cursor::new(&bytes[..])).unwrap();
+        let table: usize = header.records_offset.try_into().unwrap();
+
+        /* Record 50 is on the bisection's path to timestamp 1500. */
+        bytes[table + 49 * 40..table + 50 * 40].copy_from_slice(&raw_record(7, 0, 1490, 0, 0));
+        let file = TempFile::new(&bytes);
+        let mut pad_file = PadFile::from_filename(file.path()).unwrap();
+
+        assert_eq!(
+            pad_file.seek_to_time(1500).unwrap_err().kind(),
+            std::io::ErrorKind::InvalidData
+        );
+        assert!(pad_file.record(50).is_err());
+    }
+
+    #[test]
+    fn for_each_record_returns_read_errors() {
+        let records = test_records(50);
+        let mut bytes = pad_file_bytes(1, &records);
+        let file = TempFile::new(&bytes);
+        let mut pad_file = PadFile::from_filename(file.path()).unwrap();
+
+        let mut seen: Vec<(u32, Vec<u8>)> = Vec::new();
+        pad_file
+            .for_each_record(|r| seen.push((r.record.number, r.all_data().to_vec())))
+            .unwrap();
+        assert_eq!(seen.len(), 50);
+        for ((number, data), (expected, expected_number)) in
+            seen.iter().zip(records.iter().zip(1..))
+        {
+            assert_eq!(*number, expected_number);
+            assert_eq!(data, &expected.data);
+        }
+
+        bytes.truncate(bytes.len() - 3);
+        let file = TempFile::new(&bytes);
+        let mut pad_file = PadFile::from_filename(file.path()).unwrap();
+        assert!(pad_file.for_each_record(|_| ()).is_err());
+    }
+
+    fn coalesced_records(bytes: &[u8], batch_len: usize) -> Result<Vec<u32>, std::io::Error> {
+        let file = TempFile::new(bytes);
+        let header = PadHeader::from_reader(&mut &bytes[..]).unwrap();
+        let mut reader =
+            CoalescedReader::new(File::open(file.path()).unwrap(), &header, .., batch_len);
+
+        let mut numbers: Vec<u32> = Vec::new();
+        reader.for_each_record(|r| numbers.push(r.record.number))?;
+
+        Ok(numbers)
+    }
+
+    #[test]
+    fn coalesced_reader_batches() {
+        let records = test_records(50);
+        let bytes = pad_file_bytes(1, &records);
+        let file = TempFile::new(&bytes);
+        let header = PadHeader::from_reader(&mut &bytes[..]).unwrap();
+
+        for batch_len in [1, 7, 50, 1000] {
+            let mut reader =
+                CoalescedReader::new(File::open(file.path()).unwrap(), &header, .., batch_len);
+            let mut seen: Vec<(u32, Vec<u8>)> = Vec::new();
+            reader
+                .for_each_record(|r| seen.push((r.record.number, r.all_data().to_vec())))
+                .unwrap();
+            assert_eq!(seen.len(), records.len());
+            for ((number, data), (expected, expected_number)) in
+                seen.iter().zip(records.iter().zip(1..))
+            {
+                assert_eq!(*number, expected_number);
+                assert_eq!(data, &expected.data);
+            }
+        }
+    }
+
+    #[test]
+    fn coalesced_reader_rejects_bad_offsets() {
+        let records = test_records(10);
+        let bytes = pad_file_bytes(1, &records);
+        let table_offset = pad_header(0, 0, 0, 0).len();
+        let entry = |index: usize| table_offset + index * 40;
+
+        /* Data that starts before the previous record's data in the batch ends. */
+        let mut overlapping = bytes.clone();
+        let offset = entry(4) + 32;
+        overlapping[offset..offset + 8].copy_from_slice(&[0; 8]);
+        let error = coalesced_records(&overlapping, 10).unwrap_err();
+        assert_eq!(error.kind(), std::io::ErrorKind::InvalidData);
+
+        /* Data that ends past the end of the address space. */
+        let mut overflowing = bytes.clone();
+        let offset = entry(9) + 32;
+        overflowing[offset..offset + 8].copy_from_slice(&[0xff; 8]);
+        let error = coalesced_records(&overflowing, 10).unwrap_err();
+        assert_eq!(error.kind(), std::io::ErrorKind::InvalidData);
+
+        /* A record number out of sequence. */
+        let mut renumbered = bytes.clone();
+        let offset = entry(6);
+        renumbered[offset..offset + 4].copy_from_slice(&100_u32.to_le_bytes());
+        let error = coalesced_records(&renumbered, 10).unwrap_err();
+        assert_eq!(error.kind(), std::io::ErrorKind::InvalidData);
+
+        /* Data past the end of the file. */
+        let truncated = &bytes[..bytes.len() - 1];
+        let error = coalesced_records(truncated, 10).unwrap_err();
+        assert_eq!(error.kind(), std::io::ErrorKind::UnexpectedEof);
+
+        assert_eq!(
+            coalesced_records(&bytes, 3).unwrap(),
+            (1..=10).collect::<Vec<u32>>()
+        );
+    }
+
+    #[test]
+    fn raw_records_decode_like_the_parser() {
+        /* xorshift64, so every field sees arbitrary bit patterns */
+        let mut state: u64 = 0x9e37_79b9_7f4a_7c15;
+        let mut table: Vec<u8> = Vec::new();
+        for _ in 0..1000 * 40 {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            table.push(state as u8);
+        }
+        /* Both metadata_info flag states, and a trailing partial record. */
+        table[26..28].copy_from_slice(&0x8123_u16.to_le_bytes());
+        table[66..68].copy_from_slice(&0x0123_u16.to_le_bytes());
+        table.extend_from_slice(&[0xff; 39]);
+
+        let raw_records = RawRecord::slice_from_bytes(&table);
+        assert_eq!(raw_records.len(), 1000);
+
+        let mut decoded: Vec<Record> = Vec::new();
+        decode_records(&table, &mut decoded);
+        assert_eq!(decoded.len(), 1000);
+
+        for ((bytes, raw_record), record) in
+            table.chunks_exact(40).zip(raw_records).zip(decoded.iter())
+        {
+            let parsed = Record::from_slice(bytes).unwrap();
+            assert_eq!(&raw_record.to_record(), &parsed);
+            assert_eq!(record, &parsed);
+            assert_eq!(&Record::from_bytes(bytes.try_into().unwrap()), &parsed);
+            assert_eq!(raw_record.as_bytes(), bytes);
+        }
+        assert!(decoded[0].extra_metadata_present);
+        assert_eq!(decoded[0].metadata_offset, 0x0123);
+        assert!(!decoded[1].extra_metadata_present);
+        assert_eq!(decoded[1].metadata_offset, 0x0123);
+    }
+
+    #[test]
+    fn last_valid_record_is_found_by_bisection() {
+        let header = PadHeader::from_reader(&mut &pad_header(10, 100, 0, 0)[..]).unwrap();
+
+        for valid in 0..=91 {
+            let mut probes: Vec<u32> = Vec::new();
+            let last = find_last_valid_record(&header, |number| {
+                probes.push(number);
+                number < 10 + valid
+            });
+            assert_eq!(last, valid.checked_sub(1).map(|n| 10 + n));
+            assert_eq!(record_count_through(&header, last), valid);
+            assert!(probes.len() <= 7, "{} probes", probes.len());
+            assert!(probes.iter().all(|n| (10..=100).contains(n)));
+        }
+
+        let header =
+            PadHeader::from_reader(&mut &pad_header(u32::MAX - 1, u32::MAX, 0, 0)[..]).unwrap();
+        assert_eq!(find_last_valid_record(&header, |_| true), Some(u32::MAX));
+        assert_eq!(find_last_valid_record(&header, |_| false), None);
+    }
+
+    #[test]
+    fn probe_stops_at_the_zero_filled_table() {
+        /* Room for 100 records in the table, but only 37 were captured. */
+        let records = test_records(37);
+        let header_len = pad_header(0, 0, 0, 0).len();
+        let table_len = 100 * 40;
+        let mut bytes = pad_header(
+            1,
+            100,
+            header_len.try_into().unwrap(),
+            (header_len + table_len).try_into().unwrap(),
+        );
+        let mut data: Vec<u8> = Vec::new();
+        for (record, number) in records.iter().zip(1..) {
+            bytes.extend_from_slice(&raw_record(
+                number,
+                record.data.len().try_into().unwrap(),
+                record.timestamp_ns,
+                record.flags,
+                data.len().try_into().unwrap(),
+            ));
+            data.extend_from_slice(&record.data);
+        }
+        bytes.resize(header_len + table_len, 0);
+        bytes.append(&mut data);
+
+        let file = TempFile::new(&bytes);
+        let mapped = MappedPadFile::from_filename(file.path()).unwrap();
+        assert_eq!(mapped.probe_last_record(), Some(37));
+        assert_eq!(mapped.probe_record_count(), 37);
+        let mut pad_file = PadFile::from_filename(file.path()).unwrap();
+        assert_eq!(pad_file.probe_last_record(), Some(37));
+        assert_eq!(pad_file.probe_record_count(), 37);
+
+        let chunks = mapped
+            .par_chunks(.., 10, |range, records| {
+                Ok((range, records.collect::<Result<Vec<_>, _>>()?.len()))
+            })
+            .unwrap();
+        assert_eq!(
+            chunks,
+            vec![(1..=10, 10), (11..=20, 10), (21..=30, 10), (31..=37, 7)]
+        );
     }
 }
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/merge.rs - Timestamp-ordered merging of multiple record streams.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::cmp::Reverse;
+use std::collections::BinaryHeap;
+
+use std::io::Error;
+
+use crate::RecordView;
+
+#[derive(Debug)]
+pub struct MergedRecord<'a> {
+    pub source: usize,
+    /* The record's timestamp with the source's clock offset applied */
+    pub timestamp_ns: u64,
+    pub record_view: RecordView<'a>,
+}
+
+/*
+ * Merges the records of several sources into a single stream ordered by
+ * timestamp. Each source's records must already be in timestamp order, which
+ * is always true of a PAD file, so only the next record of each source needs
+ * to be held: a min-heap of those picks the source to take from next. Memory
+ * use therefore depends only on the number of sources, not their size.
+ *
+ * Each source has a clock offset that is added to its timestamps before they
+ * are compared, to line up captures from analyzers whose clocks differ. Records
+ * with equal timestamps are taken in source order.
+ *
+ * An error reading a source is returned in place of the record it was reading,
+ * as soon as it is hit.
+ */
+pub struct MergedRecords<'a, I> {
+    sources: Vec<I>,
+    offsets_ns: Vec<i64>,
+    heads: Vec<Option<RecordView<'a>>>,
+    heap: BinaryHeap<Reverse<(u64, usize)>>,
+    error: Option<Error>,
+}
+
+impl<'a, I> MergedRecords<'a, I>
+where
+    I: Iterator<Item = Result<RecordView<'a>, Error>>,
+{
+    pub fn new(sources: Vec<(I, i64)>) -> Self {
+        let (sources, offsets_ns): (Vec<I>, Vec<i64>) = sources.into_iter().unzip();
+
+        let mut merged = Self {
+            heads: sources.iter().map(|_| None).collect(),
+            heap: BinaryHeap::with_capacity(sources.len()),
+            sources,
+            offsets_ns,
+            error: None,
+        };
+
+        for source in 0..merged.sources.len() {
+            merged.refill(source);
+        }
+
+        merged
+    }
+
+    fn refill(&mut self, source: usize) {
+        let record_view = match self.sources[source].next() {
+            Some(Ok(record_view)) => record_view,
+            Some(Err(e)) => {
+                self.error = Some(e);
+                return;
+            }
+            None => return,
+        };
+
+        let timestamp_ns = record_view
+            .record
+            .timestamp_ns
+            .saturating_add_signed(self.offsets_ns[source]);
+
+        self.heads[source] = Some(record_view);
+        self.heap.push(Reverse((timestamp_ns, source)));
+    }
+}
+
+impl<'a, I> Iterator for MergedRecords<'a, I>
+where
+    I: Iterator<Item = Result<RecordView<'a>, Error>>,
+{
+    type Item = Result<MergedRecord<'a>, Error>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if let Some(e) = self.error.take() {
+            return Some(Err(e));
+        }
+
+        let Reverse((timestamp_ns, source)) = self.heap.pop()?;
+        let record_view = self.heads[source].take().unwrap();
+
+        self.refill(source);
+
+        Some(Ok(MergedRecord {
+            source,
+            timestamp_ns,
+            record_view,
+        }))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testutil::*;
+    use crate::MappedPadFile;
+
+    fn timestamped_records(timestamps_ns: &[u64]) -> Vec<TestRecord> {
+        timestamps_ns
+            .iter()
+            .map(|ts| TestRecord {
+                timestamp_ns: *ts,
+                flags: 0,
+                data: ts.to_le_bytes().to_vec(),
+            })
+            .collect()
+    }
+
+    #[test]
+    fn records_are_merged_in_timestamp_order() {
+        /* Sources of different lengths, with ties both within and between sources. */
+        let mut state: u64 = 0x853c_49e6_748f_ea9b;
+        let sources: Vec<Vec<u64>> = [200, 0, 57, 1, 300]
+            .iter()
+            .map(|len| {
+                let mut ts: u64 = 1_000_000;
+                (0..*len)
+                    .map(|_| {
+                        state ^= state << 13;
+                        state ^= state >> 7;
+                        state ^= state << 17;
+                        ts += state % 40;
+                        ts
+                    })
+                    .collect()
+            })
+            .collect();
+        let offsets_ns: [i64; 5] = [0, 5, -700, 2_000_000, -1_000_001];
+
+        let temp_files: Vec<TempFile> = sources
+            .iter()
+            .map(|timestamps_ns| {
+                TempFile::new(&pad_file_bytes(1, &timestamped_records(timestamps_ns)))
+            })
+            .collect();
+        let pad_files: Vec<MappedPadFile> = temp_files
+            .iter()
+            .map(|file| MappedPadFile::from_filename(file.path()).unwrap())
+            .collect();
+
+        /* Sorting is stable, so equal timestamps stay in source, then record, order. */
+        let mut expected: Vec<(u64, usize, u32)> = Vec::new();
+        for (source, timestamps_ns) in sources.iter().enumerate() {
+            for (ts, number) in timestamps_ns.iter().zip(1..) {
+                expected.push((ts.saturating_add_signed(offsets_ns[source]), source, number));
+            }
+        }
+        expected.sort_by_key(|(ts, _, _)| *ts);
+
+        let merged: Vec<(u64, usize, u32)> = MergedRecords::new(
+            pad_files
+                .iter()
+                .zip(offsets_ns)
+                .map(|(pad_file, offset_ns)| (pad_file.records(..), offset_ns))
+                .collect(),
+        )
+        .map(|merged_record| {
+            let merged_record = merged_record.unwrap();
+            let record = &merged_record.record_view.record;
+            assert_eq!(
+                merged_record.record_view.all_data(),
+                record.timestamp_ns.to_le_bytes()
+            );
+            (
+                merged_record.timestamp_ns,
+                merged_record.source,
+                record.number,
+            )
+        })
+        .collect();
+
+        assert_eq!(merged, expected);
+    }
+
+    #[test]
+    fn source_errors_are_returned() {
+        let mut bytes = pad_file_bytes(1, &timestamped_records(&[10, 20, 30, 40]));
+        /* Renumber the third record, which is read when the second is taken. */
+        let offset = pad_header(0, 0, 0, 0).len() + 2 * 40;
+        bytes[offset..offset + 4].copy_from_slice(&9_u32.to_le_bytes());
+        let bad = TempFile::new(&bytes);
+        let good = TempFile::new(&pad_file_bytes(1, &timestamped_records(&[15, 25, 35])));
+
+        let bad = MappedPadFile::from_filename(bad.path()).unwrap();
+        let good = MappedPadFile::from_filename(good.path()).unwrap();
+        let results: Vec<Result<u64, Error>> =
+            MergedRecords::new(vec![(bad.records(..), 0), (good.records(..), 0)])
+                .map(|r| r.map(|r| r.timestamp_ns))
+                .collect();
+
+        let first_error = results.iter().position(|r| r.is_err()).unwrap();
+        assert_eq!(
+            results[..first_error]
+                .iter()
+                .map(|r| *r.as_ref().unwrap())
+                .collect::<Vec<u64>>(),
+            vec![10, 15, 20]
+        );
+        assert_eq!(
+            results[first_error].as_ref().unwrap_err().kind(),
+            std::io::ErrorKind::InvalidData
+        );
+    }
+}
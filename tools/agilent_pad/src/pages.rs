@@ -0,0 +1,475 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/pages.rs - Inverted index from address pages to records.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The address index lists, for every 4 KiB page, the records of the TLPs that
+ * access it: memory and I/O requests by the bytes their header addresses and
+ * byte enables select, and completions by the bytes they return. Completions
+ * don't carry a full address, so each one is matched to its read request by
+ * transaction ID, and its address is the request's address advanced by the
+ * bytes already returned, with the low bits taken from its Lower Address field.
+ *
+ * The address index section starts with the page shift and page count (u32),
+ * followed by a table of (page (u64), list offset (u64), record count (u32),
+ * reserved (u32)) sorted by page, followed by the record lists. Each list is
+ * the differences between successive record numbers, starting from the first
+ * record number of the capture, as LEB128 varints.
+ */
+
+use std::collections::{BTreeMap, HashMap};
+use std::io::{Error, ErrorKind};
+use std::ops::RangeInclusive;
+
+use crate::bloom::PAGE_SHIFT;
+use crate::frame::{Tlp, TlpKind};
+use crate::varint::{read_varint, write_varint};
+use crate::{RecordView, FLAG_UPSTREAM};
+
+const SECTION_HEADER_LEN: usize = 8;
+const PAGE_TABLE_ENTRY_LEN: usize = 24;
+
+fn invalid_data(message: String) -> Error {
+    Error::new(ErrorKind::InvalidData, message)
+}
+
+/* The part of a TLP that the address index needs, collected in parallel. */
+#[derive(Debug, Clone)]
+pub enum AddressEvent {
+    Request {
+        number: u32,
+        upstream: bool,
+        non_posted: bool,
+        transaction_id: u32,
+        address: u64,
+        len: u64,
+    },
+    Completion {
+        number: u32,
+        upstream: bool,
+        transaction_id: u32,
+        byte_count: u64,
+        lower_address: u8,
+        len: u64,
+    },
+}
+
+/* Returns the address of the first enabled byte and the number of bytes up to the last one. */
+fn request_span(tlp: &Tlp) -> Option<(u64, u64)> {
+    let address = tlp.address()?;
+
+    if let TlpKind::IoRead | TlpKind::IoWrite = tlp.kind() {
+        return Some((address, 4));
+    }
+
+    let first_dw_be = tlp.first_dw_be()?;
+    let last_dw_be = match tlp.length_dw() {
+        1 => first_dw_be,
+        _ => tlp.last_dw_be()?,
+    };
+    let leading: u64 = match first_dw_be {
+        0 => 0,
+        be => be.trailing_zeros().into(),
+    };
+    let trailing: u64 = match last_dw_be {
+        0 => 0,
+        be => (be.leading_zeros() - 4).into(),
+    };
+
+    let len = (4 * <u32 as Into<u64>>::into(tlp.length_dw())).saturating_sub(leading + trailing);
+
+    Some((address + leading, len.max(1)))
+}
+
+impl AddressEvent {
+    pub fn from_record_view(record_view: &RecordView) -> Option<Self> {
+        let tlp = record_view.frame()?.tlp()?;
+        let number = record_view.record.number;
+        let upstream = record_view.record.flags & FLAG_UPSTREAM != 0;
+
+        match tlp.kind() {
+            TlpKind::Completion | TlpKind::CompletionLocked => {
+                let byte_count = match tlp.byte_count()? {
+                    0 => 4096,
+                    count => count.into(),
+                };
+                let len = match tlp.has_data() {
+                    true => (4 * <u32 as Into<u64>>::into(tlp.length_dw())).min(byte_count),
+                    false => 0,
+                };
+
+                Some(Self::Completion {
+                    number,
+                    upstream,
+                    transaction_id: tlp.transaction_id()?,
+                    byte_count,
+                    lower_address: tlp.lower_address()?,
+                    len,
+                })
+            }
+            _ => {
+                let (address, len) = request_span(&tlp)?;
+
+                Some(Self::Request {
+                    number,
+                    upstream,
+                    non_posted: !tlp.is_posted(),
+                    transaction_id: tlp.transaction_id()?,
+                    address,
+                    len,
+                })
+            }
+        }
+    }
+}
+
+#[derive(Debug)]
+struct OutstandingRequest {
+    address: u64,
+    len: u64,
+}
+
+/* Builds the address index from the address events of every record, in record order. */
+#[derive(Debug, Default)]
+pub struct PageIndexBuilder {
+    pages: BTreeMap<u64, Vec<u32>>,
+    /* Keyed by the transaction ID and the direction of the request */
+    outstanding: HashMap<(u32, bool), OutstandingRequest>,
+}
+
+impl PageIndexBuilder {
+    pub fn new() -> Self {
+        Default::default()
+    }
+
+    fn add_span(&mut self, number: u32, address: u64, len: u64) {
+        let first_page = address >> PAGE_SHIFT;
+        let last_page = address.saturating_add(len.max(1) - 1) >> PAGE_SHIFT;
+
+        for page in first_page..=last_page {
+            let records = self.pages.entry(page).or_default();
+            if records.last() != Some(&number) {
+                records.push(number);
+            }
+        }
+    }
+
+    pub fn add(&mut self, event: &AddressEvent) {
+        match *event {
+            AddressEvent::Request {
+                number,
+                upstream,
+                non_posted,
+                transaction_id,
+                address,
+                len,
+            } => {
+                self.add_span(number, address, len);
+                if non_posted {
+                    self.outstanding.insert(
+                        (transaction_id, upstream),
+                        OutstandingRequest { address, len },
+                    );
+                }
+            }
+            AddressEvent::Completion {
+                number,
+                upstream,
+                transaction_id,
+                byte_count,
+                lower_address,
+                len,
+            } => {
+                /* The request went the other way. */
+                let key = (transaction_id, !upstream);
+                let request = match self.outstanding.get(&key) {
+                    Some(request) => request,
+                    None => return,
+                };
+
+                let returned = request.len.saturating_sub(byte_count);
+                let address =
+                    ((request.address + returned) & !0x7F) | <u8 as Into<u64>>::into(lower_address);
+                let last_completion = len == 0 || len >= byte_count;
+
+                self.add_span(number, address, len);
+                if last_completion {
+                    self.outstanding.remove(&key);
+                }
+            }
+        }
+    }
+
+    pub fn to_section(&self, first_record_number: u32) -> Vec<u8> {
+        let mut table: Vec<u8> = Vec::with_capacity(self.pages.len() * PAGE_TABLE_ENTRY_LEN);
+        let mut lists: Vec<u8> = Vec::new();
+
+        for (page, records) in self.pages.iter() {
+            table.extend_from_slice(&page.to_le_bytes());
+            table.extend_from_slice(
+                &<usize as TryInto<u64>>::try_into(lists.len())
+                    .unwrap()
+                    .to_le_bytes(),
+            );
+            table.extend_from_slice(
+                &<usize as TryInto<u32>>::try_into(records.len())
+                    .unwrap()
+                    .to_le_bytes(),
+            );
+            table.extend_from_slice(&0_u32.to_le_bytes());
+
+            let mut prev = first_record_number;
+            for number in records {
+                write_varint(&mut lists, (number - prev).into());
+                prev = *number;
+            }
+        }
+
+        let mut section: Vec<u8> =
+            Vec::with_capacity(SECTION_HEADER_LEN + table.len() + lists.len());
+        section.extend_from_slice(&PAGE_SHIFT.to_le_bytes());
+        section.extend_from_slice(
+            &<usize as TryInto<u32>>::try_into(self.pages.len())
+                .unwrap()
+                .to_le_bytes(),
+        );
+        section.append(&mut table);
+        section.append(&mut lists);
+
+        section
+    }
+}
+
+/* A view of the address index section of a mapped index. */
+#[derive(Debug, Clone, Copy)]
+pub struct PageIndex<'a> {
+    page_shift: u32,
+    first_record_number: u32,
+    table: &'a [u8],
+    lists: &'a [u8],
+}
+
+impl<'a> PageIndex<'a> {
+    pub fn from_section(section: &'a [u8], first_record_number: u32) -> Option<Self> {
+        let page_shift = u32::from_le_bytes(section.get(0..4)?.try_into().unwrap());
+        if page_shift >= u64::BITS {
+            return None;
+        }
+        let page_count: usize = u32::from_le_bytes(section.get(4..8)?.try_into().unwrap())
+            .try_into()
+            .unwrap();
+        let lists_start = SECTION_HEADER_LEN + page_count * PAGE_TABLE_ENTRY_LEN;
+
+        let page_index = Self {
+            page_shift,
+            first_record_number,
+            table: section.get(SECTION_HEADER_LEN..lists_start)?,
+            lists: &section[lists_start..],
+        };
+
+        /* Every varint is at least one byte, so each list has to fit in the rest of the lists. */
+        let lists_len = page_index.lists.len();
+        for index in 0..page_count {
+            let (_, offset, count) = page_index.page_entry(index);
+            if offset > lists_len || count > lists_len - offset {
+                return None;
+            }
+        }
+
+        Some(page_index)
+    }
+
+    pub fn page_shift(&self) -> u32 {
+        self.page_shift
+    }
+
+    pub fn page_count(&self) -> usize {
+        self.table.len() / PAGE_TABLE_ENTRY_LEN
+    }
+
+    fn page_entry(&self, index: usize) -> (u64, usize, usize) {
+        let entry = &self.table[index * PAGE_TABLE_ENTRY_LEN..(index + 1) * PAGE_TABLE_ENTRY_LEN];
+
+        (
+            u64::from_le_bytes(entry[0..8].try_into().unwrap()),
+            u64::from_le_bytes(entry[8..16].try_into().unwrap())
+                .try_into()
+                .unwrap(),
+            u32::from_le_bytes(entry[16..20].try_into().unwrap())
+                .try_into()
+                .unwrap(),
+        )
+    }
+
+    /* Returns the pages in the index, in order. */
+    pub fn pages(&self) -> impl Iterator<Item = u64> + '_ {
+        (0..self.page_count()).map(|i| self.page_entry(i).0)
+    }
+
+    fn records_at(&self, index: usize, records: &mut Vec<u32>) -> Result<(), Error> {
+        let (page, offset, count) = self.page_entry(index);
+        let mut position = offset;
+        let mut prev = self.first_record_number;
+
+        for _ in 0..count {
+            prev = read_varint(self.lists, &mut position)
+                .and_then(|delta| u32::try_from(delta).ok())
+                .and_then(|delta| prev.checked_add(delta))
+                .ok_or_else(|| invalid_data(format!("corrupt record list for page {:#x}", page)))?;
+            records.push(prev);
+        }
+
+        Ok(())
+    }
+
+    /* Returns the index of the first page in the table at or after the page. */
+    fn partition_point(&self, page: u64) -> usize {
+        let mut lo = 0;
+        let mut hi = self.page_count();
+        while lo < hi {
+            let mid = lo + (hi - lo) / 2;
+            match self.page_entry(mid).0 < page {
+                true => lo = mid + 1,
+                false => hi = mid,
+            }
+        }
+
+        lo
+    }
+
+    pub fn records_in_page(&self, page: u64) -> Result<Vec<u32>, Error> {
+        let mut records: Vec<u32> = Vec::new();
+
+        let index = self.partition_point(page);
+        if index < self.page_count() && self.page_entry(index).0 == page {
+            self.records_at(index, &mut records)?;
+        }
+
+        Ok(records)
+    }
+
+    /* Returns the records that access any byte in the address range, in order. */
+    pub fn records_in_address_range(&self, range: RangeInclusive<u64>) -> Result<Vec<u32>, Error> {
+        let first_page = range.start() >> self.page_shift;
+        let last_page = range.end() >> self.page_shift;
+
+        let mut records: Vec<u32> = Vec::new();
+        for index in self.partition_point(first_page)..self.page_count() {
+            if self.page_entry(index).0 > last_page {
+                break;
+            }
+            self.records_at(index, &mut records)?;
+        }
+        records.sort_unstable();
+        records.dedup();
+
+        Ok(records)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn request(number: u32, address: u64, len: u64) -> AddressEvent {
+        AddressEvent::Request {
+            number,
+            upstream: false,
+            non_posted: false,
+            transaction_id: 0,
+            address,
+            len,
+        }
+    }
+
+    fn builder() -> PageIndexBuilder {
+        let mut builder = PageIndexBuilder::new();
+        builder.add(&request(10, 0x1000, 4));
+        builder.add(&request(11, 0x1FFC, 8));
+        for number in (1000..200_000).step_by(997) {
+            builder.add(&request(number, 0xFFFF_F000, 4));
+        }
+        builder.add(&request(u32::MAX, 0x5000, 4));
+
+        builder
+    }
+
+    #[test]
+    fn round_trip() {
+        let section = builder().to_section(10);
+        let page_index = PageIndex::from_section(&section, 10).unwrap();
+
+        assert_eq!(
+            page_index.pages().collect::<Vec<_>>(),
+            vec![0x1, 0x2, 0x5, 0xFFFFF]
+        );
+        assert_eq!(page_index.records_in_page(0x1).unwrap(), vec![10, 11]);
+        assert_eq!(page_index.records_in_page(0x2).unwrap(), vec![11]);
+        assert_eq!(page_index.records_in_page(0x5).unwrap(), vec![u32::MAX]);
+        assert_eq!(
+            page_index.records_in_page(0xFFFFF).unwrap(),
+            (1000..200_000).step_by(997).collect::<Vec<_>>()
+        );
+        assert_eq!(page_index.records_in_page(0x3).unwrap(), vec![]);
+
+        assert_eq!(
+            page_index
+                .records_in_address_range(0x1FFF..=0x5000)
+                .unwrap(),
+            vec![10, 11, u32::MAX]
+        );
+        assert_eq!(
+            page_index
+                .records_in_address_range(0x6000..=0xFFFF_EFFF)
+                .unwrap(),
+            vec![]
+        );
+    }
+
+    #[test]
+    fn rejects_bad_sections() {
+        let section = builder().to_section(10);
+
+        assert!(PageIndex::from_section(&section[..4], 10).is_none());
+
+        /* A truncated last list is only found when it's read. */
+        let truncated = PageIndex::from_section(&section[..section.len() - 1], 10).unwrap();
+        assert!(truncated.records_in_page(0xFFFFF).is_err());
+        assert_eq!(truncated.records_in_page(0x1).unwrap(), vec![10, 11]);
+
+        /* A list offset past the end of the lists */
+        let mut bad = section.clone();
+        bad[SECTION_HEADER_LEN + 8..SECTION_HEADER_LEN + 16]
+            .copy_from_slice(&u64::MAX.to_le_bytes());
+        assert!(PageIndex::from_section(&bad, 10).is_none());
+
+        /* A page shift too large to shift by */
+        let mut bad = section.clone();
+        bad[0..4].copy_from_slice(&64_u32.to_le_bytes());
+        assert!(PageIndex::from_section(&bad, 10).is_none());
+
+        /* Lists that aren't valid varints */
+        let mut bad = section.clone();
+        let lists_start = SECTION_HEADER_LEN + 4 * PAGE_TABLE_ENTRY_LEN;
+        bad[lists_start..].fill(0xFF);
+        let page_index = PageIndex::from_section(&bad, 10).unwrap();
+        assert!(page_index.records_in_page(0xFFFFF).is_err());
+        assert!(page_index.records_in_address_range(0..=u64::MAX).is_err());
+    }
+}
@@ -0,0 +1,404 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/par.rs - Parallel chunked processing of record ranges.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::collections::BTreeMap;
+use std::ops::RangeInclusive;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::mpsc::sync_channel;
+use std::sync::{Condvar, Mutex};
+use std::thread;
+
+pub const PAR_CHUNK_LEN: usize = 16 * 1024;
+
+pub fn default_threads() -> usize {
+    thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1)
+}
+
+/* Splits a record number range into consecutive chunks of at most chunk_len records. */
+pub fn chunk_ranges(range: RangeInclusive<u32>, chunk_len: usize) -> Vec<RangeInclusive<u32>> {
+    let chunk_len: u64 = chunk_len.max(1).try_into().unwrap();
+    let end: u64 = (*range.end()).into();
+    let mut start: u64 = (*range.start()).into();
+
+    let mut ranges = Vec::new();
+    while start <= end {
+        let chunk_end = (start + chunk_len - 1).min(end);
+        ranges.push(start.try_into().unwrap()..=chunk_end.try_into().unwrap());
+        start = chunk_end + 1;
+    }
+
+    ranges
+}
+
+/*
+ * Wakes up any workers waiting for the reorder window if a worker or the sink
+ * panics, so the scope can be torn down instead of deadlocking.
+ */
+pub(crate) struct AbortOnPanic<'a, T> {
+    pub(crate) aborted: &'a AtomicBool,
+    pub(crate) retired: &'a (Mutex<T>, Condvar),
+}
+
+impl<T> Drop for AbortOnPanic<'_, T> {
+    fn drop(&mut self) {
+        if thread::panicking() {
+            self.aborted.store(true, Ordering::Relaxed);
+            let _guard = self.retired.0.lock();
+            self.retired.1.notify_all();
+        }
+    }
+}
+
+/*
+ * Runs f over chunk indices 0..chunk_count on up to `threads` scoped worker
+ * threads and passes the results to sink in chunk order. Workers claim chunks
+ * from a shared counter, so uneven chunks don't leave threads idle, and each
+ * worker builds its own state with init (e.g. a file handle and a buffer) so
+ * nothing is shared between them. A worker never runs more than a few chunks
+ * ahead of the sink, which bounds the memory held by out-of-order results.
+ */
+pub fn for_each_ordered<W, T, I, F, S>(
+    chunk_count: usize,
+    threads: usize,
+    init: I,
+    f: F,
+    mut sink: S,
+) where
+    T: Send,
+    I: Fn() -> W + Sync,
+    F: Fn(&mut W, usize) -> T + Sync,
+    S: FnMut(usize, T),
+{
+    for_each_ordered_while(chunk_count, threads, init, f, |index, result| {
+        sink(index, result);
+        true
+    });
+}
+
+/*
+ * Like for_each_ordered, but for chunks and a sink that can fail. After the
+ * first error from either, workers stop claiming chunks, and the error is
+ * returned once the workers have finished the chunks they were already working
+ * on.
+ */
+pub fn try_for_each_ordered<W, T, E, I, F, S>(
+    chunk_count: usize,
+    threads: usize,
+    init: I,
+    f: F,
+    mut sink: S,
+) -> Result<(), E>
+where
+    T: Send,
+    E: Send,
+    I: Fn() -> W + Sync,
+    F: Fn(&mut W, usize) -> Result<T, E> + Sync,
+    S: FnMut(usize, T) -> Result<(), E>,
+{
+    let mut error = None;
+    for_each_ordered_while(chunk_count, threads, init, f, |index, result| match result
+        .and_then(|value| sink(index, value))
+    {
+        Ok(()) => true,
+        Err(e) => {
+            error = Some(e);
+            false
+        }
+    });
+
+    match error {
+        Some(e) => Err(e),
+        None => Ok(()),
+    }
+}
+
+/* Stops handing out chunks as soon as sink returns false. */
+fn for_each_ordered_while<W, T, I, F, S>(
+    chunk_count: usize,
+    threads: usize,
+    init: I,
+    f: F,
+    mut sink: S,
+) where
+    T: Send,
+    I: Fn() -> W + Sync,
+    F: Fn(&mut W, usize) -> T + Sync,
+    S: FnMut(usize, T) -> bool,
+{
+    let threads = threads.clamp(1, chunk_count.max(1));
+    let window = threads * 2;
+
+    let next = AtomicUsize::new(0);
+    let aborted = AtomicBool::new(false);
+    let retired: (Mutex<usize>, Condvar) = (Mutex::new(0), Condvar::new());
+
+    thread::scope(|scope| {
+        let (sender, receiver) = sync_channel(window);
+
+        for _ in 0..threads {
+            let sender = sender.clone();
+            let (next, aborted, retired, init, f) = (&next, &aborted, &retired, &init, &f);
+            scope.spawn(move || {
+                let _guard = AbortOnPanic { aborted, retired };
+                let mut state = init();
+
+                loop {
+                    let index = next.fetch_add(1, Ordering::Relaxed);
+                    if index >= chunk_count {
+                        break;
+                    }
+
+                    let mut done = retired.0.lock().unwrap();
+                    while index >= *done + window && !aborted.load(Ordering::Relaxed) {
+                        done = retired.1.wait(done).unwrap();
+                    }
+                    drop(done);
+
+                    if aborted.load(Ordering::Relaxed) {
+                        break;
+                    }
+
+                    if sender.send((index, f(&mut state, index))).is_err() {
+                        break;
+                    }
+                }
+            });
+        }
+        drop(sender);
+
+        let _guard = AbortOnPanic {
+            aborted: &aborted,
+            retired: &retired,
+        };
+
+        let mut pending = BTreeMap::new();
+        let mut expected = 0;
+        'receive: for (index, result) in receiver {
+            pending.insert(index, result);
+
+            while let Some(result) = pending.remove(&expected) {
+                if !sink(expected, result) {
+                    /* Dropping the receiver also stops any worker blocked on sending. */
+                    aborted.store(true, Ordering::Relaxed);
+                    let _done = retired.0.lock();
+                    retired.1.notify_all();
+                    break 'receive;
+                }
+                expected += 1;
+
+                *retired.0.lock().unwrap() = expected;
+                retired.1.notify_all();
+            }
+        }
+    });
+}
+
+/* Like for_each_ordered, but collects the results into a Vec in chunk order. */
+pub fn map_ordered<W, T, I, F>(chunk_count: usize, threads: usize, init: I, f: F) -> Vec<T>
+where
+    T: Send,
+    I: Fn() -> W + Sync,
+    F: Fn(&mut W, usize) -> T + Sync,
+{
+    let mut results = Vec::with_capacity(chunk_count);
+    for_each_ordered(chunk_count, threads, init, f, |_, result| {
+        results.push(result)
+    });
+
+    results
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /* Uneven amounts of work, so chunks finish out of order. */
+    fn busy_work(index: usize) -> usize {
+        let mut x = index;
+        for _ in 0..(index * 7919) % 5000 {
+            x = std::hint::black_box(x.wrapping_mul(31).wrapping_add(7));
+        }
+        std::hint::black_box(x);
+        index * 2
+    }
+
+    #[test]
+    fn chunk_ranges_cover_the_range() {
+        assert_eq!(chunk_ranges(1..=10, 4), vec![1..=4, 5..=8, 9..=10]);
+        assert_eq!(chunk_ranges(5..=5, 0), vec![5..=5]);
+        assert_eq!(chunk_ranges(5..=4, 3), vec![]);
+        assert_eq!(
+            chunk_ranges(u32::MAX - 4..=u32::MAX, 2),
+            vec![
+                u32::MAX - 4..=u32::MAX - 3,
+                u32::MAX - 2..=u32::MAX - 1,
+                u32::MAX..=u32::MAX
+            ]
+        );
+    }
+
+    #[test]
+    fn results_are_passed_in_order() {
+        for threads in [1, 2, 8] {
+            for chunk_count in [0, 1, 7, 200] {
+                let mut seen: Vec<(usize, usize)> = Vec::new();
+                for_each_ordered(
+                    chunk_count,
+                    threads,
+                    || (),
+                    |_, i| busy_work(i),
+                    |i, r| seen.push((i, r)),
+                );
+                let expected: Vec<(usize, usize)> = (0..chunk_count).map(|i| (i, i * 2)).collect();
+                assert_eq!(seen, expected);
+
+                assert_eq!(
+                    map_ordered(chunk_count, threads, || (), |_, i| busy_work(i)),
+                    (0..chunk_count).map(|i| i * 2).collect::<Vec<usize>>()
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn each_worker_has_its_own_state() {
+        let inits = AtomicUsize::new(0);
+        let total: usize = map_ordered(
+            100,
+            4,
+            || {
+                inits.fetch_add(1, Ordering::Relaxed);
+                0_usize
+            },
+            |calls, _| {
+                *calls += 1;
+                *calls
+            },
+        )
+        .len();
+        assert_eq!(total, 100);
+        assert!((1..=4).contains(&inits.load(Ordering::Relaxed)));
+    }
+
+    #[test]
+    fn workers_stay_within_the_window() {
+        let threads = 4;
+        let claimed = AtomicUsize::new(0);
+        for_each_ordered(
+            1000,
+            threads,
+            || (),
+            |_, i| {
+                claimed.fetch_max(i, Ordering::Relaxed);
+                busy_work(i)
+            },
+            |i, _| {
+                /* No chunk is started until the sink is within a window of it. */
+                assert!(claimed.load(Ordering::Relaxed) < i + 1 + threads * 2);
+            },
+        );
+    }
+
+    #[test]
+    fn the_first_error_stops_processing() {
+        for threads in [1, 4] {
+            let processed = AtomicUsize::new(0);
+            let mut seen: Vec<usize> = Vec::new();
+            let result = try_for_each_ordered(
+                10_000,
+                threads,
+                || (),
+                |_, i| {
+                    processed.fetch_add(1, Ordering::Relaxed);
+                    match i {
+                        50 | 60 => Err(i),
+                        _ => Ok(busy_work(i)),
+                    }
+                },
+                |i, _| {
+                    seen.push(i);
+                    Ok(())
+                },
+            );
+            assert_eq!(result, Err(50));
+            assert_eq!(seen, (0..50).collect::<Vec<usize>>());
+            assert!(processed.load(Ordering::Relaxed) < 10_000);
+        }
+    }
+
+    #[test]
+    fn a_sink_error_stops_processing() {
+        let processed = AtomicUsize::new(0);
+        let mut seen: Vec<usize> = Vec::new();
+        let result: Result<(), &str> = try_for_each_ordered(
+            10_000,
+            4,
+            || (),
+            |_, i| {
+                processed.fetch_add(1, Ordering::Relaxed);
+                Ok(busy_work(i))
+            },
+            |i, _| match i {
+                20 => Err("full"),
+                _ => {
+                    seen.push(i);
+                    Ok(())
+                }
+            },
+        );
+        assert_eq!(result, Err("full"));
+        assert_eq!(seen, (0..20).collect::<Vec<usize>>());
+        assert!(processed.load(Ordering::Relaxed) < 10_000);
+    }
+
+    #[test]
+    fn panics_are_propagated_instead_of_deadlocking() {
+        let result = std::panic::catch_unwind(|| {
+            for_each_ordered(
+                1000,
+                4,
+                || (),
+                |_, i| match i {
+                    30 => panic!("worker panic"),
+                    _ => busy_work(i),
+                },
+                |_, _| (),
+            );
+        });
+        assert!(result.is_err());
+
+        let result = std::panic::catch_unwind(|| {
+            for_each_ordered(
+                1000,
+                4,
+                || (),
+                |_, i| busy_work(i),
+                |i, _| {
+                    if i == 30 {
+                        panic!("sink panic");
+                    }
+                },
+            );
+        });
+        assert!(result.is_err());
+    }
+}
@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/pcapng.rs - PCAP-NG blocks for PAD records.
+ *  Copyright (C) 2023-2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::cmp::Ordering;
+use std::io::prelude::*;
+
+use crate::{PadHeader, Record, RecordView};
+
+/* LINKTYPE_USER11, which the Wireshark PCIe dissector is registered for */
+pub const LINKTYPE_PCIE_RECORD: u16 = 147 + 11;
+
+fn pad_to_u32(data: &mut Vec<u8>) {
+    let padding_count = if data.len() % 4 != 0 {
+        4 - (data.len() % 4)
+    } else {
+        0
+    };
+    data.resize(data.len() + padding_count, 0);
+}
+
+fn append_option(data: &mut Vec<u8>, code: u16, value: &[u8]) {
+    data.extend_from_slice(&code.to_le_bytes());
+    data.extend_from_slice(
+        &<usize as TryInto<u16>>::try_into(value.len())
+            .unwrap()
+            .to_le_bytes(),
+    );
+    data.extend_from_slice(value);
+    pad_to_u32(data);
+}
+
+fn append_end_of_options(data: &mut Vec<u8>) {
+    data.extend_from_slice(&0_u16.to_le_bytes());
+    data.extend_from_slice(&0_u16.to_le_bytes());
+}
+
+fn write_block<W>(writer: &mut W, block_type: u32, data: &[u8]) -> Result<(), std::io::Error>
+where
+    W: Write,
+{
+    let block_len: u32 = <usize as TryInto<u32>>::try_into(data.len()).unwrap() + 4 * 3;
+    writer.write_all(&block_type.to_le_bytes())?;
+    writer.write_all(&block_len.to_le_bytes())?;
+    writer.write_all(data)?;
+    writer.write_all(&block_len.to_le_bytes())
+}
+
+pub fn write_section_header<W>(writer: &mut W) -> Result<(), std::io::Error>
+where
+    W: Write,
+{
+    let mut sh_data: Vec<u8> = Vec::new();
+    sh_data.extend_from_slice(&0x1a2b3c4d_u32.to_le_bytes());
+    sh_data.extend_from_slice(&0x0001_u16.to_le_bytes());
+    sh_data.extend_from_slice(&0x0000_u16.to_le_bytes());
+    sh_data.extend_from_slice(&(-1_i64).to_le_bytes());
+
+    write_block(writer, 0x0a0d0d0a, &sh_data)
+}
+
+/* Writes an Interface Description Block named after the capture's port ID. */
+pub fn write_interface_description<W>(
+    writer: &mut W,
+    header: &PadHeader,
+) -> Result<(), std::io::Error>
+where
+    W: Write,
+{
+    let mut if_data: Vec<u8> = Vec::new();
+    if_data.extend_from_slice(&LINKTYPE_PCIE_RECORD.to_le_bytes());
+    if_data.extend_from_slice(&0x0000_u16.to_le_bytes());
+    if_data.extend_from_slice(&0_u32.to_le_bytes());
+
+    // Options
+    append_option(&mut if_data, 2, header.port_id.as_bytes());
+
+    /*
+    append_option(&mut if_data, 8, &(2e9 as u64).to_le_bytes());
+    */
+
+    append_option(&mut if_data, 9, &[9]);
+    append_option(&mut if_data, 15, header.module_type.as_bytes());
+    append_end_of_options(&mut if_data);
+
+    write_block(writer, 0x00000001, &if_data)
+}
+
+/*
+ * Returns the comment to attach to the record the capture was triggered on, or
+ * to the first or last record if the trigger falls outside the capture.
+ */
+pub fn trigger_comment(header: &PadHeader, record: &Record) -> Option<String> {
+    let trigger_record_number = header.trigger_record_number;
+    let trigger_timestamp_ns = header.timestamps_ns.trigger;
+
+    if !((record.number == trigger_record_number)
+        || (record.number == header.first_record_number
+            && trigger_record_number < header.first_record_number)
+        || (record.number == header.last_record_number
+            && trigger_record_number > header.last_record_number))
+    {
+        return None;
+    }
+
+    Some(match trigger_timestamp_ns.cmp(&record.timestamp_ns) {
+        Ordering::Less => {
+            let difference_ns = record.timestamp_ns - trigger_timestamp_ns;
+            let ts_ns_int = difference_ns / 1000000000;
+            let ts_ns_frac = difference_ns % 1000000000;
+            format!(
+                "Triggered {}.{:09}s before this record.",
+                ts_ns_int, ts_ns_frac
+            )
+        }
+        Ordering::Equal => "Triggered on this record.".to_string(),
+        Ordering::Greater => {
+            let difference_ns = trigger_timestamp_ns - record.timestamp_ns;
+            let ts_ns_int = difference_ns / 1000000000;
+            let ts_ns_frac = difference_ns % 1000000000;
+            format!(
+                "Triggered {}.{:09}s after this record.",
+                ts_ns_int, ts_ns_frac
+            )
+        }
+    })
+}
+
+/*
+ * Appends an Enhanced Packet Block for the record to buf. The packet data is
+ * the record metadata the dissector expects followed by the record data.
+ */
+pub fn append_enhanced_packet(
+    buf: &mut Vec<u8>,
+    interface_id: u32,
+    record_view: &RecordView,
+    comment: Option<&str>,
+) {
+    append_enhanced_packet_at(
+        buf,
+        interface_id,
+        record_view.record.timestamp_ns,
+        record_view,
+        comment,
+    );
+}
+
+/*
+ * Like append_enhanced_packet, but with the block timestamp set to
+ * timestamp_ns, e.g. to apply a clock offset. The record metadata keeps the
+ * timestamp from the PAD file.
+ */
+pub fn append_enhanced_packet_at(
+    buf: &mut Vec<u8>,
+    interface_id: u32,
+    timestamp_ns: u64,
+    record_view: &RecordView,
+    comment: Option<&str>,
+) {
+    append_record_packet(
+        buf,
+        interface_id,
+        timestamp_ns,
+        &record_view.record,
+        record_view.all_data(),
+        comment,
+    );
+}
+
+/*
+ * Like append_enhanced_packet_at, but for a record and its data (including any
+ * metadata) that don't come from a PAD file, e.g. ones rebuilt from an archive.
+ */
+pub fn append_record_packet(
+    buf: &mut Vec<u8>,
+    interface_id: u32,
+    timestamp_ns: u64,
+    record: &Record,
+    record_data: &[u8],
+    comment: Option<&str>,
+) {
+    let block_start = buf.len();
+    buf.extend_from_slice(&0x00000006_u32.to_le_bytes());
+    buf.extend_from_slice(&0_u32.to_le_bytes());
+
+    let data_start = buf.len();
+    buf.extend_from_slice(&interface_id.to_le_bytes());
+    buf.extend_from_slice(
+        &<u64 as TryInto<u32>>::try_into(timestamp_ns.checked_shr(32).unwrap())
+            .unwrap()
+            .to_le_bytes(),
+    );
+    buf.extend_from_slice(
+        &<u64 as TryInto<u32>>::try_into(timestamp_ns & ((1 << 32) - 1))
+            .unwrap()
+            .to_le_bytes(),
+    );
+    let record_data_len =
+        4 + 8 + 2 + 2 + 4 + <usize as TryInto<u32>>::try_into(record_data.len()).unwrap();
+    buf.extend_from_slice(&record_data_len.to_le_bytes());
+    buf.extend_from_slice(&record_data_len.to_le_bytes());
+
+    // Record metadata
+    buf.extend_from_slice(&record.number.to_le_bytes());
+    buf.extend_from_slice(&record.timestamp_ns.to_le_bytes());
+    buf.extend_from_slice(&record.lfsr.to_le_bytes());
+    let value: u16 = if record.extra_metadata_present {
+        0x8000
+    } else {
+        0
+    } | record.metadata_offset;
+    buf.extend_from_slice(&value.to_le_bytes());
+    buf.extend_from_slice(&record.flags.to_le_bytes());
+
+    // Record data
+    buf.extend_from_slice(record_data);
+    let padding_count = (4 - ((buf.len() - data_start) % 4)) % 4;
+    buf.resize(buf.len() + padding_count, 0);
+
+    if let Some(comment) = comment {
+        let mut options = Vec::new();
+        append_option(&mut options, 1, comment.as_bytes());
+        append_end_of_options(&mut options);
+        buf.append(&mut options);
+    }
+
+    let block_len: u32 = <usize as TryInto<u32>>::try_into(buf.len() - block_start).unwrap() + 4;
+    buf[block_start + 4..block_start + 8].copy_from_slice(&block_len.to_le_bytes());
+    buf.extend_from_slice(&block_len.to_le_bytes());
+}
@@ -0,0 +1,516 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/query.rs - Planning and running record queries.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A query selects the records in a record range and time range that match a
+ * filter. Before any record is read, the candidates are narrowed down in
+ * steps: the time range is found by bisecting the record timestamps, and with
+ * a .padidx index, the filter's constraints are checked against the zone maps,
+ * the Bloom filters, and the address index to drop whole blocks, or single
+ * records, that can't match. The remaining candidates are then checked against
+ * their index entries, and only the records that might still match are read.
+ */
+
+use std::io::Error;
+use std::ops::{Bound, RangeBounds, RangeInclusive};
+
+use crate::bloom::{BloomKey, PAGE_SHIFT};
+use crate::filter::{Constraint, Field, FieldSource, Filter, IndexedRecord};
+use crate::index::PadIndex;
+use crate::zonemap::ZoneMap;
+use crate::{clamp_record_range, MappedPadFile, RecordView};
+
+/* The most IDs or address pages to look up in the Bloom filters for one constraint. */
+const BLOOM_KEY_LIMIT: u64 = 64;
+
+/* The number of records in a list of ranges. */
+fn range_count(ranges: &[RangeInclusive<u32>]) -> u64 {
+    ranges
+        .iter()
+        .filter(|r| !r.is_empty())
+        .map(|r| <u32 as Into<u64>>::into(r.end() - r.start()) + 1)
+        .sum()
+}
+
+/* Intersects two lists of sorted, disjoint ranges. */
+fn intersect(a: &[RangeInclusive<u32>], b: &[RangeInclusive<u32>]) -> Vec<RangeInclusive<u32>> {
+    let mut ranges: Vec<RangeInclusive<u32>> = Vec::new();
+    let (mut i, mut j) = (0, 0);
+    while i < a.len() && j < b.len() {
+        let start = *a[i].start().max(b[j].start());
+        let end = *a[i].end().min(b[j].end());
+        if start <= end {
+            ranges.push(start..=end);
+        }
+        match a[i].end() < b[j].end() {
+            true => i += 1,
+            false => j += 1,
+        }
+    }
+
+    ranges
+}
+
+/* Turns a sorted list of record numbers into ranges, merging consecutive records. */
+fn ranges_from_records(records: &[u32]) -> Vec<RangeInclusive<u32>> {
+    let mut ranges: Vec<RangeInclusive<u32>> = Vec::new();
+    for number in records.iter().copied() {
+        match ranges.last_mut() {
+            Some(last) if last.end().checked_add(1) == Some(number) => {
+                *last = *last.start()..=number
+            }
+            _ => ranges.push(number..=number),
+        }
+    }
+
+    ranges
+}
+
+/* Returns the records in the time range, which is found by bisection. */
+fn time_range_records(
+    pad_file: &MappedPadFile,
+    range: &RangeInclusive<u64>,
+) -> Vec<RangeInclusive<u32>> {
+    let start = match pad_file.seek_to_time(*range.start()) {
+        Some(start) => start,
+        None => return Vec::new(),
+    };
+    let end = match range
+        .end()
+        .checked_add(1)
+        .and_then(|t| pad_file.seek_to_time(t))
+    {
+        Some(after) if after > start => after - 1,
+        Some(_) => return Vec::new(),
+        None => match pad_file.probe_last_record() {
+            Some(last) => last,
+            None => return Vec::new(),
+        },
+    };
+
+    vec![start..=end]
+}
+
+/* False if no record in the block can meet the constraint. */
+fn zone_may_match(zone_map: &ZoneMap, constraint: &Constraint) -> bool {
+    if let Some(class) = constraint.field.index_class() {
+        if !zone_map.has_class(class) {
+            return false;
+        }
+    }
+
+    let any_value = |limit: u64, has: &dyn Fn(u8) -> bool| match constraint.values(limit) {
+        Some(values) => values.into_iter().any(|v| u8::try_from(v).is_ok_and(has)),
+        None => true,
+    };
+    let either = |zero_present: bool, one_present: bool| {
+        (constraint.admits(Some(0)) && zero_present) || (constraint.admits(Some(1)) && one_present)
+    };
+
+    match constraint.field {
+        Field::TlpAddr => constraint
+            .ranges
+            .iter()
+            .any(|r| zone_map.overlaps_address(r)),
+        Field::TlpFmtType => any_value(256, &|t| zone_map.has_tlp_type(t)),
+        Field::DllpType => any_value(256, &|t| zone_map.has_dllp_type(t)),
+        Field::TlpCplStatus => any_value(8, &|s| s < 8 && zone_map.has_completion_status(s)),
+        Field::TlpCplStatusNotSuccessful => (1..8).any(|s| zone_map.has_completion_status(s)),
+        Field::Direction => either(zone_map.downstream() > 0, zone_map.upstream > 0),
+        Field::SymbolError => either(
+            zone_map.symbol_errors < zone_map.record_count,
+            zone_map.symbol_errors > 0,
+        ),
+        Field::DisparityError => either(
+            zone_map.disparity_errors < zone_map.record_count,
+            zone_map.disparity_errors > 0,
+        ),
+        _ => true,
+    }
+}
+
+/* Returns the Bloom filter keys that a record meeting the constraint must have one of. */
+fn bloom_keys(constraint: &Constraint) -> Option<Vec<BloomKey>> {
+    let ids = || {
+        constraint
+            .values(BLOOM_KEY_LIMIT)?
+            .into_iter()
+            .map(|v| u16::try_from(v).ok())
+            .collect::<Option<Vec<u16>>>()
+    };
+
+    match constraint.field {
+        Field::TlpReq => Some(ids()?.into_iter().map(BloomKey::RequesterId).collect()),
+        Field::TlpCpl => Some(ids()?.into_iter().map(BloomKey::CompleterId).collect()),
+        Field::TlpAddr => {
+            let pages = Constraint {
+                field: Field::TlpAddr,
+                ranges: constraint
+                    .ranges
+                    .iter()
+                    .map(|r| r.start() >> PAGE_SHIFT..=r.end() >> PAGE_SHIFT)
+                    .collect(),
+            };
+            Some(
+                pages
+                    .values(BLOOM_KEY_LIMIT)?
+                    .into_iter()
+                    .map(BloomKey::Page)
+                    .collect(),
+            )
+        }
+        _ => None,
+    }
+}
+
+/* The records a query might match, and how they were found. */
+#[derive(Debug, Clone)]
+pub struct QueryPlan {
+    /* Sorted, disjoint ranges of the candidate records */
+    pub candidates: Vec<RangeInclusive<u32>>,
+    /* Each step that narrowed the candidates, and how many were left after it */
+    pub steps: Vec<(&'static str, u64)>,
+}
+
+impl QueryPlan {
+    pub fn new<R, T>(
+        pad_file: &MappedPadFile,
+        index: Option<&PadIndex>,
+        filter: Option<&Filter>,
+        record_range: R,
+        time_range: T,
+    ) -> Self
+    where
+        R: RangeBounds<u32>,
+        T: RangeBounds<u64>,
+    {
+        let constraints = filter.map(|f| f.constraints()).unwrap_or_default();
+        let mut plan = Self {
+            candidates: Vec::new(),
+            steps: Vec::new(),
+        };
+
+        let first = pad_file.header.first_record_number;
+        if let Some(last) = pad_file.probe_last_record() {
+            let range = clamp_record_range(&record_range, first, last);
+            if !range.is_empty() {
+                plan.candidates.push(range);
+            }
+        }
+        for constraint in constraints.iter().filter(|c| c.field == Field::Record) {
+            let ranges: Vec<RangeInclusive<u32>> = constraint
+                .ranges
+                .iter()
+                .filter_map(|r| {
+                    let start = u32::try_from(*r.start()).ok()?;
+                    Some(start..=u32::try_from(*r.end()).unwrap_or(u32::MAX))
+                })
+                .collect();
+            plan.candidates = intersect(&plan.candidates, &ranges);
+        }
+        plan.step("record range");
+
+        /* The time range from the caller and from the filter are both bisected. */
+        let mut time_ranges: Vec<Vec<RangeInclusive<u64>>> = Vec::new();
+        if (time_range.start_bound(), time_range.end_bound())
+            != (Bound::Unbounded, Bound::Unbounded)
+        {
+            let start = crate::time_range_start(&time_range);
+            let end = match time_range.end_bound() {
+                Bound::Included(ns) => Some(*ns),
+                Bound::Excluded(ns) => ns.checked_sub(1),
+                Bound::Unbounded => Some(u64::MAX),
+            };
+            time_ranges.push(end.map(|end| start..=end).into_iter().collect());
+        }
+        for constraint in constraints.iter().filter(|c| c.field == Field::TimestampNs) {
+            time_ranges.push(constraint.ranges.clone());
+        }
+        if !time_ranges.is_empty() {
+            for ranges in time_ranges {
+                let mut records: Vec<RangeInclusive<u32>> = Vec::new();
+                for range in ranges.iter() {
+                    records.extend(time_range_records(pad_file, range));
+                }
+                plan.candidates = intersect(&plan.candidates, &records);
+            }
+            plan.step("time range");
+        }
+
+        let index = match index {
+            Some(index) if !constraints.is_empty() => index,
+            _ => return plan,
+        };
+
+        if let Some(zone_maps) = index.zone_maps() {
+            let ranges =
+                zone_maps.candidate_ranges(|z| constraints.iter().all(|c| zone_may_match(z, c)));
+            plan.candidates = intersect(&plan.candidates, &ranges);
+            plan.step("zone maps");
+        }
+
+        if let Some(bloom_filters) = index.bloom_filters() {
+            let mut used = false;
+            for keys in constraints.iter().filter_map(bloom_keys) {
+                let ranges = bloom_filters.candidate_ranges(&keys);
+                plan.candidates = intersect(&plan.candidates, &ranges);
+                used = true;
+            }
+            if used {
+                plan.step("Bloom filters");
+            }
+        }
+
+        if let Some(page_index) = index.page_index() {
+            let mut used = false;
+            for constraint in constraints
+                .iter()
+                .filter(|c| c.field == Field::TlpAddr && !c.is_presence())
+            {
+                let mut records: Vec<u32> = Vec::new();
+                let mut corrupt = false;
+                for range in constraint.ranges.iter() {
+                    match page_index.records_in_address_range(range.clone()) {
+                        Ok(range_records) => records.extend(range_records),
+                        Err(_) => corrupt = true,
+                    }
+                }
+
+                /* A corrupt record list can't rule anything out. */
+                if corrupt {
+                    continue;
+                }
+
+                records.sort_unstable();
+                records.dedup();
+                plan.candidates = intersect(&plan.candidates, &ranges_from_records(&records));
+                used = true;
+            }
+            if used {
+                plan.step("address index");
+            }
+        }
+
+        plan
+    }
+
+    fn step(&mut self, name: &'static str) {
+        let count = self.candidate_count();
+        self.steps.push((name, count));
+    }
+
+    pub fn candidate_count(&self) -> u64 {
+        range_count(&self.candidates)
+    }
+
+    /*
+     * Calls f with every candidate record that matches the filter, in order.
+     * With an index, each candidate is first checked against its index entry,
+     * and the record is only read if the entry doesn't rule it out. The first
+     * error from reading a record or from f is returned.
+     */
+    pub fn for_each_match<F>(
+        &self,
+        pad_file: &MappedPadFile,
+        index: Option<&PadIndex>,
+        filter: Option<&Filter>,
+        mut f: F,
+    ) -> Result<QueryStats, Error>
+    where
+        F: FnMut(&RecordView) -> Result<(), Error>,
+    {
+        let mut stats = QueryStats::default();
+
+        let mut emit = |stats: &mut QueryStats, record_view: &RecordView| {
+            stats.matches += 1;
+            f(record_view)
+        };
+
+        let indexed_constraints: Vec<&Constraint> = filter
+            .map(|f| f.constraints())
+            .unwrap_or_default()
+            .iter()
+            .filter(|c| c.field.is_indexed())
+            .collect();
+
+        for range in self.candidates.iter() {
+            match (index, filter) {
+                (Some(index), Some(filter)) => {
+                    for (number, entry) in index.entries(range.clone()) {
+                        stats.entries_checked += 1;
+                        let indexed_record = IndexedRecord { number, entry };
+                        let may_match = match filter.is_indexed() {
+                            true => filter.matches(&indexed_record),
+                            false => indexed_constraints
+                                .iter()
+                                .all(|c| c.admits(indexed_record.value(c.field))),
+                        };
+                        if !may_match {
+                            continue;
+                        }
+
+                        let record_view = match pad_file.record(number)? {
+                            Some(record_view) => record_view,
+                            None => continue,
+                        };
+                        stats.records_read += 1;
+                        if filter.is_indexed() || filter.matches(&record_view) {
+                            emit(&mut stats, &record_view)?;
+                        }
+                    }
+                }
+                _ => {
+                    for record_view in pad_file.records(range.clone()) {
+                        let record_view = record_view?;
+                        stats.records_read += 1;
+                        if filter.map_or(true, |f| f.matches(&record_view)) {
+                            emit(&mut stats, &record_view)?;
+                        }
+                    }
+                }
+            }
+        }
+
+        Ok(stats)
+    }
+}
+
+#[derive(Debug, Clone, Default)]
+pub struct QueryStats {
+    pub entries_checked: u64,
+    pub records_read: u64,
+    pub matches: u64,
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::index::IndexOptions;
+    use crate::testutil::*;
+    use crate::zonemap::ZONE_BLOCK_LEN;
+
+    const FILTERS: &[&str] = &[
+        "pcie.tlp.req == 01:00.3",
+        "!pcie.tlp.req == 01:00.3",
+        "pcie.tlp.addr == 0x5040",
+        "pcie.tlp.addr in {0x100003000..0x100008fff}",
+        "pcie.tlp.fmt_type == 0x4a && pcie.tlp.tag == 7",
+        "pcie.dllp.type == 0 && pcie.direction == 1",
+        "pcie.record in {100..200 70000..70010} && pcie.tlp",
+        "pcie.timestamp_ns >= 500000 && pcie.tlp.addr == 0x40",
+        "pcie.tlp.cpl.status_not_successful == 1",
+    ];
+
+    #[test]
+    fn candidates_hold_every_match() {
+        let pad = TempFile::new(&pad_file_bytes(1, &frame_records(ZONE_BLOCK_LEN + 1000)));
+        let pad_file = MappedPadFile::from_filename(pad.path()).unwrap();
+        let index_files: Vec<TempFile> = [
+            IndexOptions::default(),
+            IndexOptions {
+                bloom_filters: true,
+                address_index: true,
+            },
+        ]
+        .iter()
+        .map(|options| index_file(&pad_file, options))
+        .collect();
+        let indexes: Vec<PadIndex> = index_files
+            .iter()
+            .map(|f| PadIndex::from_filename(f.path()).unwrap())
+            .collect();
+
+        let ranges = [
+            (
+                (Bound::Unbounded, Bound::Unbounded),
+                (Bound::Unbounded, Bound::Unbounded),
+            ),
+            (
+                (Bound::Included(50), Bound::Included(66000)),
+                (Bound::Included(2000), Bound::Excluded(600000)),
+            ),
+        ];
+
+        for expression in FILTERS {
+            let filter = Filter::compile(expression).unwrap();
+            for (record_range, time_range) in ranges {
+                let expected: Vec<u32> = pad_file
+                    .records(..)
+                    .map(Result::unwrap)
+                    .filter(|r| {
+                        record_range.contains(&r.record.number)
+                            && time_range.contains(&r.record.timestamp_ns)
+                            && filter.matches(r)
+                    })
+                    .map(|r| r.record.number)
+                    .collect();
+
+                for index in [None].into_iter().chain(indexes.iter().map(Some)) {
+                    let plan =
+                        QueryPlan::new(&pad_file, index, Some(&filter), record_range, time_range);
+                    assert!(
+                        expected
+                            .iter()
+                            .all(|n| plan.candidates.iter().any(|r| r.contains(n))),
+                        "{}",
+                        expression
+                    );
+
+                    let mut matches: Vec<u32> = Vec::new();
+                    let stats = plan
+                        .for_each_match(&pad_file, index, Some(&filter), |record_view| {
+                            matches.push(record_view.record.number);
+                            Ok(())
+                        })
+                        .unwrap();
+                    assert_eq!(matches, expected, "{}", expression);
+                    assert_eq!(stats.matches, u64::try_from(expected.len()).unwrap());
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn match_errors_are_returned() {
+        let pad = TempFile::new(&pad_file_bytes(1, &frame_records(100)));
+        let pad_file = MappedPadFile::from_filename(pad.path()).unwrap();
+        let plan = QueryPlan::new(&pad_file, None, None, .., ..);
+
+        let mut count = 0;
+        let result = plan.for_each_match(&pad_file, None, None, |_| {
+            count += 1;
+            match count {
+                3 => Err(std::io::ErrorKind::WriteZero.into()),
+                _ => Ok(()),
+            }
+        });
+        assert_eq!(result.unwrap_err().kind(), std::io::ErrorKind::WriteZero);
+        assert_eq!(count, 3);
+    }
+
+    #[test]
+    fn consecutive_records_are_merged() {
+        assert_eq!(
+            ranges_from_records(&[1, 2, 3, 5, u32::MAX - 1, u32::MAX]),
+            [1..=3, 5..=5, u32::MAX - 1..=u32::MAX]
+        );
+        assert!(ranges_from_records(&[]).is_empty());
+    }
+}
@@ -0,0 +1,287 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/scan.rs - Vectorized predicate scans over record flags.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A predicate of the form `((flags & mask) == value) != negate`. This covers
+ * single-bit tests, multi-bit field compares (e.g. link width), and, when
+ * negated with a value of zero, "any of these bits set".
+ */
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FlagsPredicate {
+    pub mask: u32,
+    pub value: u32,
+    pub negate: bool,
+}
+
+impl FlagsPredicate {
+    pub fn equals(mask: u32, value: u32) -> Self {
+        Self {
+            mask,
+            value: value & mask,
+            negate: false,
+        }
+    }
+
+    pub fn all_set(mask: u32) -> Self {
+        Self::equals(mask, mask)
+    }
+
+    pub fn all_clear(mask: u32) -> Self {
+        Self::equals(mask, 0)
+    }
+
+    pub fn any_set(mask: u32) -> Self {
+        Self {
+            negate: true,
+            ..Self::all_clear(mask)
+        }
+    }
+
+    pub fn matches(&self, flags: u32) -> bool {
+        ((flags & self.mask) == self.value) != self.negate
+    }
+}
+
+/* One bit per record, packed 64 records to a word. Bits past `len` are always zero. */
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct SelectionBitmap {
+    words: Vec<u64>,
+    len: usize,
+}
+
+impl SelectionBitmap {
+    pub fn new() -> Self {
+        Default::default()
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    pub fn words(&self) -> &[u64] {
+        &self.words
+    }
+
+    pub fn get(&self, index: usize) -> bool {
+        index < self.len && self.words[index / 64] & (1 << (index % 64)) != 0
+    }
+
+    pub fn count_ones(&self) -> usize {
+        self.words
+            .iter()
+            .map(|w| <u32 as TryInto<usize>>::try_into(w.count_ones()).unwrap())
+            .sum()
+    }
+
+    pub fn iter_ones(&self) -> impl Iterator<Item = usize> + '_ {
+        self.words.iter().enumerate().flat_map(|(i, w)| {
+            let mut word = *w;
+            std::iter::from_fn(move || {
+                if word == 0 {
+                    return None;
+                }
+                let bit: usize = word.trailing_zeros().try_into().unwrap();
+                word &= word - 1;
+                Some(i * 64 + bit)
+            })
+        })
+    }
+
+    pub fn and(&mut self, other: &Self) {
+        assert_eq!(self.len, other.len, "bitmap length mismatch");
+        for (a, b) in self.words.iter_mut().zip(other.words.iter()) {
+            *a &= *b;
+        }
+    }
+
+    pub fn or(&mut self, other: &Self) {
+        assert_eq!(self.len, other.len, "bitmap length mismatch");
+        for (a, b) in self.words.iter_mut().zip(other.words.iter()) {
+            *a |= *b;
+        }
+    }
+
+    pub fn and_not(&mut self, other: &Self) {
+        assert_eq!(self.len, other.len, "bitmap length mismatch");
+        for (a, b) in self.words.iter_mut().zip(other.words.iter()) {
+            *a &= !*b;
+        }
+    }
+}
+
+fn low_bits(count: usize) -> u64 {
+    match count {
+        64 => !0,
+        n => (1 << n) - 1,
+    }
+}
+
+/*
+ * Branch-free fallback. Each 64-record chunk is reduced to one bitmap word,
+ * which the compiler can vectorize with whatever SIMD the target has.
+ */
+fn scan_words_portable(flags: &[u32], predicate: &FlagsPredicate, words: &mut [u64]) {
+    for (chunk, word) in flags.chunks(64).zip(words.iter_mut()) {
+        let mut bits: u64 = 0;
+        for (i, f) in chunk.iter().enumerate() {
+            bits |= <bool as Into<u64>>::into((f & predicate.mask) == predicate.value) << i;
+        }
+        if predicate.negate {
+            bits = !bits & low_bits(chunk.len());
+        }
+        *word = bits;
+    }
+}
+
+/* Evaluates eight records per instruction, 64 records per bitmap word. */
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2")]
+unsafe fn scan_words_avx2(flags: &[u32], predicate: &FlagsPredicate, words: &mut [u64]) {
+    use std::arch::x86_64::*;
+
+    let mask = _mm256_set1_epi32(predicate.mask as i32);
+    let value = _mm256_set1_epi32(predicate.value as i32);
+    let invert: u64 = match predicate.negate {
+        true => !0,
+        false => 0,
+    };
+
+    let full_chunks = flags.len() / 64;
+    for (chunk, word) in flags.chunks_exact(64).zip(words.iter_mut()) {
+        let mut bits: u64 = 0;
+        for i in 0..8 {
+            let v = _mm256_loadu_si256(chunk.as_ptr().add(i * 8) as *const __m256i);
+            let eq = _mm256_cmpeq_epi32(_mm256_and_si256(v, mask), value);
+            let lanes = _mm256_movemask_ps(_mm256_castsi256_ps(eq)) as u32;
+            bits |= <u32 as Into<u64>>::into(lanes) << (i * 8);
+        }
+        *word = bits ^ invert;
+    }
+
+    scan_words_portable(
+        &flags[full_chunks * 64..],
+        predicate,
+        &mut words[full_chunks..],
+    );
+}
+
+pub fn scan_flags_into(flags: &[u32], predicate: &FlagsPredicate, bitmap: &mut SelectionBitmap) {
+    bitmap.len = flags.len();
+    bitmap.words.clear();
+    bitmap.words.resize(flags.len().div_ceil(64), 0);
+
+    #[cfg(target_arch = "x86_64")]
+    if is_x86_feature_detected!("avx2") {
+        /* Safety: AVX2 support was just checked for. */
+        unsafe { scan_words_avx2(flags, predicate, &mut bitmap.words) };
+        return;
+    }
+
+    scan_words_portable(flags, predicate, &mut bitmap.words);
+}
+
+pub fn scan_flags(flags: &[u32], predicate: &FlagsPredicate) -> SelectionBitmap {
+    let mut bitmap = SelectionBitmap::new();
+    scan_flags_into(flags, predicate, &mut bitmap);
+
+    bitmap
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn test_flags(len: usize) -> Vec<u32> {
+        let mut state: u32 = 0x2545_f491;
+        (0..len)
+            .map(|_| {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                /* Keep the low bits sparse so that equality tests match sometimes. */
+                state & 0xf000_00ff
+            })
+            .collect()
+    }
+
+    fn test_predicates() -> Vec<FlagsPredicate> {
+        vec![
+            FlagsPredicate::all_set(crate::FLAG_UPSTREAM),
+            FlagsPredicate::all_clear(crate::FLAG_UPSTREAM),
+            FlagsPredicate::any_set(crate::FLAG_SCRAMBLED | crate::FLAG_GAP),
+            FlagsPredicate::equals(crate::FLAGS_LINK_WIDTH_MASK, 3),
+            FlagsPredicate::equals(0, 0),
+            FlagsPredicate::any_set(0),
+        ]
+    }
+
+    #[test]
+    fn scan_matches_the_predicate() {
+        for len in [0, 1, 63, 64, 65, 127, 128, 200, 1000] {
+            let flags = test_flags(len);
+            for predicate in test_predicates() {
+                let bitmap = scan_flags(&flags, &predicate);
+                assert_eq!(bitmap.len(), len);
+                assert_eq!(bitmap.words().len(), len.div_ceil(64));
+                for (i, f) in flags.iter().enumerate() {
+                    assert_eq!(
+                        bitmap.get(i),
+                        predicate.matches(*f),
+                        "{:?} {}",
+                        predicate,
+                        i
+                    );
+                }
+                assert_eq!(
+                    bitmap.count_ones(),
+                    flags.iter().filter(|f| predicate.matches(**f)).count()
+                );
+                /* Bits past the end must stay clear, even for negated predicates. */
+                if len % 64 != 0 {
+                    assert_eq!(bitmap.words().last().unwrap() & !low_bits(len % 64), 0);
+                }
+            }
+        }
+    }
+
+    #[cfg(target_arch = "x86_64")]
+    #[test]
+    fn avx2_scan_matches_portable_scan() {
+        if !is_x86_feature_detected!("avx2") {
+            return;
+        }
+
+        for len in [0, 1, 63, 64, 65, 127, 128, 200, 1000] {
+            let flags = test_flags(len);
+            for predicate in test_predicates() {
+                let mut portable = vec![0; len.div_ceil(64)];
+                let mut avx2 = vec![!0; len.div_ceil(64)];
+                scan_words_portable(&flags, &predicate, &mut portable);
+                /* Safety: AVX2 support was just checked for. */
+                unsafe { scan_words_avx2(&flags, &predicate, &mut avx2) };
+                assert_eq!(avx2, portable, "{:?} {}", predicate, len);
+            }
+        }
+    }
+}
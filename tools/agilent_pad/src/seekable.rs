@@ -0,0 +1,345 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/seekable.rs - Zstandard seekable format support for PAD files.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A seekable Zstandard file is a sequence of independently-compressed frames
+ * followed by a skippable frame holding a seek table, as described in the
+ * Zstandard "Seekable Format" specification. Regular zstd decoders ignore the
+ * seek table, so these files can still be decompressed with `zstd -d`.
+ */
+
+use std::io::prelude::*;
+use std::io::{Error, ErrorKind, SeekFrom};
+
+const SKIPPABLE_MAGIC_NUMBER: u32 = 0x184D2A5E;
+const SEEKABLE_MAGIC_NUMBER: u32 = 0x8F92EAB1;
+const SEEK_TABLE_FOOTER_LEN: u64 = 9;
+const CHECKSUM_FLAG: u8 = 0x80;
+const RESERVED_DESCRIPTOR_BITS: u8 = 0x7C;
+
+pub const DEFAULT_FRAME_SIZE: usize = 1024 * 1024;
+
+#[derive(Debug)]
+struct SeekTableEntry {
+    compressed_offset: u64,
+    decompressed_offset: u64,
+    compressed_size: u32,
+    decompressed_size: u32,
+}
+
+#[derive(Debug, Default)]
+pub struct SeekTable {
+    entries: Vec<SeekTableEntry>,
+}
+
+impl SeekTable {
+    fn push(&mut self, compressed_size: u32, decompressed_size: u32) {
+        let (compressed_offset, decompressed_offset) = match self.entries.last() {
+            Some(e) => (
+                e.compressed_offset + <u32 as Into<u64>>::into(e.compressed_size),
+                e.decompressed_offset + <u32 as Into<u64>>::into(e.decompressed_size),
+            ),
+            None => (0, 0),
+        };
+
+        self.entries.push(SeekTableEntry {
+            compressed_offset,
+            decompressed_offset,
+            compressed_size,
+            decompressed_size,
+        });
+    }
+
+    pub fn from_reader<R>(reader: &mut R) -> Result<Self, Error>
+    where
+        R: Read + Seek,
+    {
+        let mut footer = [0; SEEK_TABLE_FOOTER_LEN as usize];
+        reader.seek(SeekFrom::End(-(SEEK_TABLE_FOOTER_LEN as i64)))?;
+        reader.read_exact(&mut footer)?;
+
+        let frame_count = u32::from_le_bytes(footer[0..4].try_into().unwrap());
+        let descriptor = footer[4];
+        let magic = u32::from_le_bytes(footer[5..9].try_into().unwrap());
+
+        if magic != SEEKABLE_MAGIC_NUMBER || descriptor & RESERVED_DESCRIPTOR_BITS != 0 {
+            return Err(Error::new(ErrorKind::InvalidData, "no zstd seek table"));
+        }
+
+        let entry_len: u64 = if descriptor & CHECKSUM_FLAG != 0 {
+            12
+        } else {
+            8
+        };
+        let table_len = <u32 as Into<u64>>::into(frame_count) * entry_len;
+
+        let mut table: Vec<u8> = vec![0; (8 + table_len).try_into().unwrap()];
+        reader.seek(SeekFrom::End(
+            -<u64 as TryInto<i64>>::try_into(8 + table_len + SEEK_TABLE_FOOTER_LEN).unwrap(),
+        ))?;
+        reader.read_exact(&mut table)?;
+
+        let skippable_magic = u32::from_le_bytes(table[0..4].try_into().unwrap());
+        let frame_size = u32::from_le_bytes(table[4..8].try_into().unwrap());
+
+        if skippable_magic != SKIPPABLE_MAGIC_NUMBER
+            || <u32 as Into<u64>>::into(frame_size) != table_len + SEEK_TABLE_FOOTER_LEN
+        {
+            return Err(Error::new(
+                ErrorKind::InvalidData,
+                "corrupt zstd seek table",
+            ));
+        }
+
+        let mut seek_table = Self::default();
+        for entry in table[8..].chunks_exact(entry_len.try_into().unwrap()) {
+            seek_table.push(
+                u32::from_le_bytes(entry[0..4].try_into().unwrap()),
+                u32::from_le_bytes(entry[4..8].try_into().unwrap()),
+            );
+        }
+
+        Ok(seek_table)
+    }
+
+    pub fn write_to<W>(&self, writer: &mut W) -> Result<(), Error>
+    where
+        W: Write,
+    {
+        let frame_count: u32 = self.entries.len().try_into().unwrap();
+        let frame_size: u32 =
+            frame_count * 8 + <u64 as TryInto<u32>>::try_into(SEEK_TABLE_FOOTER_LEN).unwrap();
+
+        writer.write_all(&SKIPPABLE_MAGIC_NUMBER.to_le_bytes())?;
+        writer.write_all(&frame_size.to_le_bytes())?;
+        for entry in self.entries.iter() {
+            writer.write_all(&entry.compressed_size.to_le_bytes())?;
+            writer.write_all(&entry.decompressed_size.to_le_bytes())?;
+        }
+        writer.write_all(&frame_count.to_le_bytes())?;
+        writer.write_all(&[0])?;
+        writer.write_all(&SEEKABLE_MAGIC_NUMBER.to_le_bytes())?;
+
+        Ok(())
+    }
+
+    pub fn frame_count(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn decompressed_len(&self) -> u64 {
+        match self.entries.last() {
+            Some(e) => e.decompressed_offset + <u32 as Into<u64>>::into(e.decompressed_size),
+            None => 0,
+        }
+    }
+
+    fn find_frame(&self, decompressed_offset: u64) -> Option<usize> {
+        let index = self
+            .entries
+            .partition_point(|e| e.decompressed_offset <= decompressed_offset);
+
+        match index {
+            0 => None,
+            n if decompressed_offset < self.decompressed_len() => Some(n - 1),
+            _ => None,
+        }
+    }
+}
+
+/*
+ * Recompresses a stream into independent frames of `frame_size` decompressed
+ * bytes each, followed by the seek table.
+ */
+pub fn compress<R, W>(
+    reader: &mut R,
+    writer: &mut W,
+    frame_size: usize,
+    level: i32,
+) -> Result<SeekTable, Error>
+where
+    R: Read,
+    W: Write,
+{
+    let mut compressor = zstd::bulk::Compressor::new(level)?;
+    let mut seek_table = SeekTable::default();
+    let mut buffer: Vec<u8> = vec![0; frame_size.max(1)];
+
+    loop {
+        let mut filled = 0;
+        while filled < buffer.len() {
+            match reader.read(&mut buffer[filled..]) {
+                Ok(0) => break,
+                Ok(n) => filled += n,
+                Err(e) if e.kind() == ErrorKind::Interrupted => continue,
+                Err(e) => return Err(e),
+            }
+        }
+
+        if filled == 0 {
+            break;
+        }
+
+        let frame = compressor.compress(&buffer[..filled])?;
+        writer.write_all(&frame)?;
+        seek_table.push(frame.len().try_into().unwrap(), filled.try_into().unwrap());
+
+        if filled < buffer.len() {
+            break;
+        }
+    }
+
+    seek_table.write_to(writer)?;
+
+    Ok(seek_table)
+}
+
+/*
+ * Provides random access to the decompressed contents of a seekable Zstandard
+ * file, decompressing only the frames that are actually read. The most
+ * recently decompressed frame is cached.
+ */
+pub struct SeekableReader<R> {
+    reader: R,
+    seek_table: SeekTable,
+    position: u64,
+    frame_index: Option<usize>,
+    frame: Vec<u8>,
+    compressed: Vec<u8>,
+    decompressor: zstd::bulk::Decompressor<'static>,
+}
+
+/* The decompressor doesn't implement Debug, so it's left out. */
+impl<R> std::fmt::Debug for SeekableReader<R>
+where
+    R: std::fmt::Debug,
+{
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("SeekableReader")
+            .field("reader", &self.reader)
+            .field("seek_table", &self.seek_table)
+            .field("position", &self.position)
+            .field("frame_index", &self.frame_index)
+            .finish_non_exhaustive()
+    }
+}
+
+impl<R> SeekableReader<R>
+where
+    R: Read + Seek,
+{
+    pub fn new(mut reader: R) -> Result<Self, Error> {
+        let seek_table = SeekTable::from_reader(&mut reader)?;
+
+        Ok(Self {
+            reader,
+            seek_table,
+            position: 0,
+            frame_index: None,
+            frame: Vec::new(),
+            compressed: Vec::new(),
+            decompressor: zstd::bulk::Decompressor::new()?,
+        })
+    }
+
+    pub fn seek_table(&self) -> &SeekTable {
+        &self.seek_table
+    }
+
+    fn load_frame(&mut self, index: usize) -> Result<(), Error> {
+        if self.frame_index == Some(index) {
+            return Ok(());
+        }
+
+        let entry = &self.seek_table.entries[index];
+
+        self.compressed
+            .resize(entry.compressed_size.try_into().unwrap(), 0);
+        self.reader.seek(SeekFrom::Start(entry.compressed_offset))?;
+        self.reader.read_exact(&mut self.compressed)?;
+
+        self.frame.clear();
+        self.frame
+            .reserve(entry.decompressed_size.try_into().unwrap());
+        self.decompressor
+            .decompress_to_buffer(&self.compressed, &mut self.frame)?;
+
+        if self.frame.len() != <u32 as TryInto<usize>>::try_into(entry.decompressed_size).unwrap() {
+            return Err(Error::new(ErrorKind::InvalidData, "frame size mismatch"));
+        }
+
+        self.frame_index = Some(index);
+
+        Ok(())
+    }
+}
+
+impl<R> Read for SeekableReader<R>
+where
+    R: Read + Seek,
+{
+    fn read(&mut self, buf: &mut [u8]) -> Result<usize, Error> {
+        let index = match self.seek_table.find_frame(self.position) {
+            Some(index) => index,
+            None => return Ok(0),
+        };
+
+        self.load_frame(index)?;
+
+        let frame_offset: usize = (self.position
+            - self.seek_table.entries[index].decompressed_offset)
+            .try_into()
+            .unwrap();
+        let available = &self.frame[frame_offset..];
+        let len = available.len().min(buf.len());
+
+        buf[..len].copy_from_slice(&available[..len]);
+        self.position += <usize as TryInto<u64>>::try_into(len).unwrap();
+
+        Ok(len)
+    }
+}
+
+impl<R> Seek for SeekableReader<R>
+where
+    R: Read + Seek,
+{
+    fn seek(&mut self, pos: SeekFrom) -> Result<u64, Error> {
+        let position = match pos {
+            SeekFrom::Start(offset) => Some(offset),
+            SeekFrom::End(offset) => self
+                .seek_table
+                .decompressed_len()
+                .checked_add_signed(offset),
+            SeekFrom::Current(offset) => self.position.checked_add_signed(offset),
+        };
+
+        match position {
+            Some(position) => {
+                self.position = position;
+                Ok(position)
+            }
+            None => Err(Error::new(
+                ErrorKind::InvalidInput,
+                "invalid seek to a negative position",
+            )),
+        }
+    }
+}
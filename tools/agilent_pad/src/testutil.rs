@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/testutil.rs - Synthetic PAD files for the unit tests.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+pub(crate) const MODULE_TYPE: &str = "AGT_MODULE_ONEPORT_PCIEXPRESS_X8";
+
+#[derive(Debug, Clone)]
+pub(crate) struct TestRecord {
+    pub(crate) timestamp_ns: u64,
+    pub(crate) flags: u32,
+    pub(crate) data: Vec<u8>,
+}
+
+pub(crate) fn raw_record(
+    number: u32,
+    data_len: u32,
+    timestamp_ns: u64,
+    flags: u32,
+    data_offset: u64,
+) -> [u8; 40] {
+    let mut raw = [0; 40];
+    raw[0..4].copy_from_slice(&number.to_le_bytes());
+    raw[4..8].copy_from_slice(&data_len.to_le_bytes());
+    /* count = 1 */
+    raw[12..16].copy_from_slice(&1_u32.to_le_bytes());
+    raw[16..20].copy_from_slice(&((timestamp_ns >> 32) as u32).to_le_bytes());
+    raw[20..24].copy_from_slice(&(timestamp_ns as u32).to_le_bytes());
+    raw[28..32].copy_from_slice(&flags.to_le_bytes());
+    raw[32..36].copy_from_slice(&((data_offset >> 32) as u32).to_le_bytes());
+    raw[36..40].copy_from_slice(&(data_offset as u32).to_le_bytes());
+
+    raw
+}
+
+fn push_string(header: &mut Vec<u8>, string: &str) {
+    header.extend_from_slice(&u16::try_from(string.len()).unwrap().to_be_bytes());
+    header.extend_from_slice(string.as_bytes());
+}
+
+/* A PAD header laid out the way PadHeader::read_from parses it. */
+pub(crate) fn pad_header(
+    first_record_number: u32,
+    last_record_number: u32,
+    records_offset: u64,
+    record_data_offset: u64,
+) -> Vec<u8> {
+    let mut header: Vec<u8> = Vec::new();
+    for string in [MODULE_TYPE, "1", "Rx", "", "PA1"] {
+        push_string(&mut header, string);
+    }
+    for value in [
+        1_u32,
+        1,
+        0,
+        3,
+        first_record_number,
+        last_record_number,
+        40,
+        8,
+    ] {
+        header.extend_from_slice(&value.to_be_bytes());
+    }
+    for _ in 0..4 {
+        header.extend_from_slice(&0_u64.to_be_bytes());
+    }
+    for string in ["test-guid", "A", "B"] {
+        push_string(&mut header, string);
+    }
+    for _ in 0..6 {
+        header.extend_from_slice(&0_u16.to_be_bytes());
+    }
+    header.extend_from_slice(&records_offset.to_be_bytes());
+    header.extend_from_slice(&record_data_offset.to_be_bytes());
+    push_string(&mut header, "");
+
+    header
+}
+
+/*
+ * A PAD file holding the records, numbered from first_record_number, with
+ * their data laid out in order and the table ended by a null record.
+ */
+pub(crate) fn pad_file_bytes(first_record_number: u32, records: &[TestRecord]) -> Vec<u8> {
+    let count = u32::try_from(records.len()).unwrap();
+    let header_len: u64 = pad_header(0, 0, 0, 0).len().try_into().unwrap();
+    let table_len: u64 = ((records.len() + 1) * 40).try_into().unwrap();
+
+    let mut table: Vec<u8> = Vec::new();
+    let mut data: Vec<u8> = Vec::new();
+    for (record, number) in records.iter().zip(first_record_number..) {
+        table.extend_from_slice(&raw_record(
+            number,
+            record.data.len().try_into().unwrap(),
+            record.timestamp_ns,
+            record.flags,
+            data.len().try_into().unwrap(),
+        ));
+        data.extend_from_slice(&record.data);
+    }
+    table.extend_from_slice(&[0; 40]);
+
+    let mut file = pad_header(
+        first_record_number,
+        first_record_number + count,
+        header_len,
+        header_len + table_len,
+    );
+    file.append(&mut table);
+    file.append(&mut data);
+
+    file
+}
+
+/* count records with increasing timestamps, each with a few bytes of data. */
+pub(crate) fn test_records(count: usize) -> Vec<TestRecord> {
+    (0..count)
+        .map(|i| TestRecord {
+            timestamp_ns: 1000 + 10 * u64::try_from(i).unwrap(),
+            flags: match i % 3 {
+                0 => crate::FLAG_UPSTREAM,
+                _ => 0,
+            },
+            data: vec![u8::try_from(i % 256).unwrap(); 4 + i % 5],
+        })
+        .collect()
+}
+
+/* A TLP framed with STP, a zero sequence number, a dummy LCRC, and END. */
+pub(crate) fn tlp_frame(tlp: &[u8]) -> Vec<u8> {
+    let mut frame = vec![crate::frame::K_27_7, 0, 0];
+    frame.extend_from_slice(tlp);
+    frame.extend_from_slice(&[0; 4]);
+    frame.push(crate::frame::K_29_7);
+
+    frame
+}
+
+/*
+ * count records cycling through memory reads, completions, 64-bit memory
+ * writes, Acks, and SKP ordered sets, from a handful of requesters and to a
+ * spread of addresses.
+ */
+pub(crate) fn frame_records(count: usize) -> Vec<TestRecord> {
+    (0..count)
+        .map(|i| {
+            let requester_id = 0x0100 + u16::try_from(i % 7).unwrap();
+            let tag = u8::try_from(i % 256).unwrap();
+            let address = 0x1000 * u32::try_from(i % 29).unwrap() + 0x40;
+            let [rid_hi, rid_lo] = requester_id.to_be_bytes();
+            let data = match i % 5 {
+                0 => {
+                    let mut tlp = vec![0x00, 0x00, 0x00, 0x01, rid_hi, rid_lo, tag, 0x0f];
+                    tlp.extend_from_slice(&address.to_be_bytes());
+                    tlp_frame(&tlp)
+                }
+                1 => tlp_frame(&[
+                    0x4a, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x04, rid_hi, rid_lo, tag, 0x40,
+                    0xde, 0xad, 0xbe, 0xef,
+                ]),
+                2 => {
+                    let mut tlp = vec![0x60, 0x00, 0x00, 0x01, rid_hi, rid_lo, tag, 0x0f];
+                    tlp.extend_from_slice(&(0x1_0000_0000 + u64::from(address)).to_be_bytes());
+                    tlp.extend_from_slice(&[0x01, 0x02, 0x03, 0x04]);
+                    tlp_frame(&tlp)
+                }
+                3 => vec![0x5c, 0x00, 0x00, 0x00, 0x05, 0x96, 0x17, 0xfd],
+                _ => vec![0xbc, 0x1c, 0x1c, 0x1c],
+            };
+
+            TestRecord {
+                timestamp_ns: 1000 + 10 * u64::try_from(i).unwrap(),
+                flags: match i % 2 {
+                    0 => 0,
+                    _ => crate::FLAG_UPSTREAM,
+                },
+                data,
+            }
+        })
+        .collect()
+}
+
+/* A file in the temporary directory that is deleted when dropped. */
+pub(crate) struct TempFile {
+    path: PathBuf,
+}
+
+impl TempFile {
+    pub(crate) fn new(contents: &[u8]) -> Self {
+        static NEXT: AtomicUsize = AtomicUsize::new(0);
+
+        let path = std::env::temp_dir().join(format!(
+            "agilent_pad-test-{}-{}.pad",
+            std::process::id(),
+            NEXT.fetch_add(1, Ordering::Relaxed)
+        ));
+        std::fs::write(&path, contents).unwrap();
+
+        Self { path }
+    }
+
+    pub(crate) fn path(&self) -> &str {
+        self.path.to_str().unwrap()
+    }
+}
+
+impl Drop for TempFile {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/* Builds the index of a PAD file and writes it to a temporary file. */
+pub(crate) fn index_file(
+    pad_file: &crate::MappedPadFile,
+    options: &crate::index::IndexOptions,
+) -> TempFile {
+    let sections = crate::index::build_sections(pad_file, options).unwrap();
+    let mut bytes: Vec<u8> = Vec::new();
+    crate::index::write_index(&mut bytes, pad_file, &sections).unwrap();
+
+    TempFile::new(&bytes)
+}
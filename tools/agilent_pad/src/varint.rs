@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/varint.rs - LEB128 variable-length integers.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+pub fn write_varint(output: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        output.push((value as u8) | 0x80);
+        value >>= 7;
+    }
+    output.push(value as u8);
+}
+
+/*
+ * Reads a varint at the position and advances the position past it. Returns
+ * None if the input ends in the middle of the varint, or if it doesn't fit in
+ * a u64.
+ */
+pub fn read_varint(input: &[u8], position: &mut usize) -> Option<u64> {
+    let mut value: u64 = 0;
+    let mut shift = 0;
+    loop {
+        let byte = *input.get(*position)?;
+        *position += 1;
+
+        let bits = <u8 as Into<u64>>::into(byte & 0x7F);
+        if shift >= 64 || (bits << shift) >> shift != bits {
+            return None;
+        }
+        value |= bits << shift;
+
+        if byte & 0x80 == 0 {
+            return Some(value);
+        }
+        shift += 7;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn round_trip() {
+        let values = [
+            0,
+            1,
+            0x7F,
+            0x80,
+            0x3FFF,
+            0x4000,
+            u32::MAX.into(),
+            u64::MAX - 1,
+            u64::MAX,
+        ];
+
+        let mut encoded: Vec<u8> = Vec::new();
+        for value in values {
+            write_varint(&mut encoded, value);
+        }
+
+        let mut position = 0;
+        for value in values {
+            assert_eq!(read_varint(&encoded, &mut position), Some(value));
+        }
+        assert_eq!(position, encoded.len());
+        assert_eq!(read_varint(&encoded, &mut position), None);
+    }
+
+    #[test]
+    fn lengths() {
+        for (value, len) in [(0, 1), (0x7F, 1), (0x80, 2), (u64::MAX, 10)] {
+            let mut encoded: Vec<u8> = Vec::new();
+            write_varint(&mut encoded, value);
+            assert_eq!(encoded.len(), len);
+        }
+    }
+
+    #[test]
+    fn rejects_truncated_and_oversized() {
+        let mut position = 0;
+        assert_eq!(read_varint(&[0x80, 0x80], &mut position), None);
+
+        /* u64::MAX is 9 full groups and a final 1; anything more doesn't fit. */
+        let mut position = 0;
+        let mut too_big = vec![0xFF; 9];
+        too_big.push(0x02);
+        assert_eq!(read_varint(&too_big, &mut position), None);
+
+        let mut position = 0;
+        assert_eq!(read_varint(&[0x80; 11], &mut position), None);
+    }
+}
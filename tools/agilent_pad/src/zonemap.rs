@@ -0,0 +1,452 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *  src/zonemap.rs - Per-block summaries of indexed records.
+ *  Copyright (C) 2026  Forest Crossman <cyrozap@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A zone map summarizes a block of consecutive records: their time span, which
+ * TLP, DLLP, and ordered set kinds occur, the direction and error counts, and
+ * the span of request addresses. A query that can't match anything a block
+ * summarizes can skip the whole block without looking at its records. Every
+ * block but the last holds ZONE_BLOCK_LEN records.
+ *
+ * The zone map section starts with the block length (u32) and a reserved u32,
+ * followed by one ZoneMap::LEN-byte zone map per block, all little-endian.
+ */
+
+use std::ops::{RangeBounds, RangeInclusive};
+
+use crate::frame::TlpKind;
+use crate::index::{
+    IndexEntry, CLASS_DLLP, CLASS_ORDERED_SET, CLASS_TLP, ENTRY_DISPARITY_ERROR,
+    ENTRY_SYMBOL_ERROR, ENTRY_UPSTREAM,
+};
+
+pub const ZONE_BLOCK_LEN: usize = 64 * 1024;
+const SECTION_HEADER_LEN: usize = 8;
+
+fn bitmap_set(bitmap: &mut [u8], bit: u8) {
+    bitmap[usize::from(bit / 8)] |= 1 << (bit % 8);
+}
+
+fn bitmap_get(bitmap: &[u8], bit: u8) -> bool {
+    bitmap[usize::from(bit / 8)] & (1 << (bit % 8)) != 0
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct ZoneMap {
+    pub first_record_number: u32,
+    pub record_count: u32,
+    pub min_timestamp_ns: u64,
+    pub max_timestamp_ns: u64,
+    /* Only meaningful if the block has any records with an address */
+    pub min_address: u64,
+    pub max_address: u64,
+    pub upstream: u32,
+    pub symbol_errors: u32,
+    pub disparity_errors: u32,
+    /* Bit n is set if a record of class n occurs */
+    pub classes: u8,
+    /* Bit n is set if an ordered set of kind n occurs */
+    pub ordered_set_kinds: u8,
+    /* Bit n is set if a completion with status n occurs */
+    pub completion_statuses: u8,
+    pub tlp_types: [u8; 32],
+    pub dllp_types: [u8; 32],
+}
+
+impl ZoneMap {
+    pub const LEN: usize = 120;
+
+    pub fn new(first_record_number: u32) -> Self {
+        Self {
+            first_record_number,
+            record_count: 0,
+            min_timestamp_ns: u64::MAX,
+            max_timestamp_ns: 0,
+            min_address: u64::MAX,
+            max_address: 0,
+            upstream: 0,
+            symbol_errors: 0,
+            disparity_errors: 0,
+            classes: 0,
+            ordered_set_kinds: 0,
+            completion_statuses: 0,
+            tlp_types: [0; 32],
+            dllp_types: [0; 32],
+        }
+    }
+
+    /* Adds the next record of the block. */
+    pub fn add(&mut self, timestamp_ns: u64, entry: &IndexEntry) {
+        self.record_count += 1;
+        self.min_timestamp_ns = self.min_timestamp_ns.min(timestamp_ns);
+        self.max_timestamp_ns = self.max_timestamp_ns.max(timestamp_ns);
+
+        self.upstream += u32::from(entry.flags & ENTRY_UPSTREAM != 0);
+        self.symbol_errors += u32::from(entry.flags & ENTRY_SYMBOL_ERROR != 0);
+        self.disparity_errors += u32::from(entry.flags & ENTRY_DISPARITY_ERROR != 0);
+
+        self.classes |= 1 << entry.class;
+        match entry.class {
+            CLASS_TLP => {
+                bitmap_set(&mut self.tlp_types, entry.kind);
+                if let Some(address) = entry.address() {
+                    self.min_address = self.min_address.min(address);
+                    self.max_address = self.max_address.max(address);
+                }
+                if let (true, Some(status)) = (
+                    TlpKind::from_fmt_type(entry.kind).is_completion(),
+                    entry.detail(),
+                ) {
+                    self.completion_statuses |= 1 << status;
+                }
+            }
+            CLASS_DLLP => bitmap_set(&mut self.dllp_types, entry.kind),
+            CLASS_ORDERED_SET => self.ordered_set_kinds |= 1 << entry.kind,
+            _ => (),
+        }
+    }
+
+    pub fn from_bytes(input: &[u8; Self::LEN]) -> Self {
+        let u32_at =
+            |offset: usize| u32::from_le_bytes(input[offset..offset + 4].try_into().unwrap());
+        let u64_at =
+            |offset: usize| u64::from_le_bytes(input[offset..offset + 8].try_into().unwrap());
+
+        Self {
+            first_record_number: u32_at(0),
+            record_count: u32_at(4),
+            min_timestamp_ns: u64_at(8),
+            max_timestamp_ns: u64_at(16),
+            min_address: u64_at(24),
+            max_address: u64_at(32),
+            upstream: u32_at(40),
+            symbol_errors: u32_at(44),
+            disparity_errors: u32_at(48),
+            classes: input[52],
+            ordered_set_kinds: input[53],
+            completion_statuses: input[54],
+            tlp_types: input[56..88].try_into().unwrap(),
+            dllp_types: input[88..120].try_into().unwrap(),
+        }
+    }
+
+    pub fn to_bytes(&self) -> [u8; Self::LEN] {
+        let mut output = [0; Self::LEN];
+        output[0..4].copy_from_slice(&self.first_record_number.to_le_bytes());
+        output[4..8].copy_from_slice(&self.record_count.to_le_bytes());
+        output[8..16].copy_from_slice(&self.min_timestamp_ns.to_le_bytes());
+        output[16..24].copy_from_slice(&self.max_timestamp_ns.to_le_bytes());
+        output[24..32].copy_from_slice(&self.min_address.to_le_bytes());
+        output[32..40].copy_from_slice(&self.max_address.to_le_bytes());
+        output[40..44].copy_from_slice(&self.upstream.to_le_bytes());
+        output[44..48].copy_from_slice(&self.symbol_errors.to_le_bytes());
+        output[48..52].copy_from_slice(&self.disparity_errors.to_le_bytes());
+        output[52] = self.classes;
+        output[53] = self.ordered_set_kinds;
+        output[54] = self.completion_statuses;
+        output[56..88].copy_from_slice(&self.tlp_types);
+        output[88..120].copy_from_slice(&self.dllp_types);
+        output
+    }
+
+    /* Empty if the block has no records. */
+    pub fn record_range(&self) -> RangeInclusive<u32> {
+        match self.record_count {
+            0 => 1..=0,
+            count => self.first_record_number..=self.first_record_number.saturating_add(count - 1),
+        }
+    }
+
+    pub fn downstream(&self) -> u32 {
+        self.record_count.saturating_sub(self.upstream)
+    }
+
+    /* Zone maps read from an index must describe a real block of records. */
+    fn is_valid(&self) -> bool {
+        self.record_count > 0
+            && self.upstream <= self.record_count
+            && self
+                .first_record_number
+                .checked_add(self.record_count - 1)
+                .is_some()
+    }
+
+    pub fn has_class(&self, class: u8) -> bool {
+        self.classes & (1 << class) != 0
+    }
+
+    pub fn has_tlp_type(&self, fmt_type: u8) -> bool {
+        bitmap_get(&self.tlp_types, fmt_type)
+    }
+
+    pub fn has_dllp_type(&self, dllp_type: u8) -> bool {
+        bitmap_get(&self.dllp_types, dllp_type)
+    }
+
+    pub fn has_ordered_set_kind(&self, kind: u8) -> bool {
+        self.ordered_set_kinds & (1 << kind) != 0
+    }
+
+    pub fn has_completion_status(&self, status: u8) -> bool {
+        self.completion_statuses & (1 << status) != 0
+    }
+
+    pub fn overlaps_time<B>(&self, range: &B) -> bool
+    where
+        B: RangeBounds<u64>,
+    {
+        overlaps(range, self.min_timestamp_ns, self.max_timestamp_ns)
+    }
+
+    pub fn overlaps_address<B>(&self, range: &B) -> bool
+    where
+        B: RangeBounds<u64>,
+    {
+        self.min_address <= self.max_address && overlaps(range, self.min_address, self.max_address)
+    }
+}
+
+fn overlaps<B>(range: &B, min: u64, max: u64) -> bool
+where
+    B: RangeBounds<u64>,
+{
+    let below_end = match range.end_bound() {
+        std::ops::Bound::Included(end) => min <= *end,
+        std::ops::Bound::Excluded(end) => min < *end,
+        std::ops::Bound::Unbounded => true,
+    };
+    let above_start = match range.start_bound() {
+        std::ops::Bound::Included(start) => max >= *start,
+        std::ops::Bound::Excluded(start) => max > *start,
+        std::ops::Bound::Unbounded => true,
+    };
+
+    below_end && above_start
+}
+
+pub fn section_from_zone_maps(block_len: usize, zone_maps: &[ZoneMap]) -> Vec<u8> {
+    let mut section: Vec<u8> =
+        Vec::with_capacity(SECTION_HEADER_LEN + zone_maps.len() * ZoneMap::LEN);
+    section.extend_from_slice(
+        &<usize as TryInto<u32>>::try_into(block_len)
+            .unwrap()
+            .to_le_bytes(),
+    );
+    section.extend_from_slice(&0_u32.to_le_bytes());
+    for zone_map in zone_maps {
+        section.extend_from_slice(&zone_map.to_bytes());
+    }
+
+    section
+}
+
+/* A view of the zone map section of a mapped index. */
+#[derive(Debug, Clone, Copy)]
+pub struct ZoneMaps<'a> {
+    block_len: usize,
+    data: &'a [u8],
+}
+
+impl<'a> ZoneMaps<'a> {
+    pub fn from_section(section: &'a [u8]) -> Option<Self> {
+        let block_len = u32::from_le_bytes(section.get(0..4)?.try_into().unwrap());
+        let data = section.get(SECTION_HEADER_LEN..)?;
+        if data.len() % ZoneMap::LEN != 0 {
+            return None;
+        }
+
+        let zone_maps = Self {
+            block_len: block_len.try_into().unwrap(),
+            data,
+        };
+        match zone_maps.iter().all(|z| z.is_valid()) {
+            true => Some(zone_maps),
+            false => None,
+        }
+    }
+
+    pub fn block_len(&self) -> usize {
+        self.block_len
+    }
+
+    pub fn len(&self) -> usize {
+        self.data.len() / ZoneMap::LEN
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.data.is_empty()
+    }
+
+    pub fn get(&self, block: usize) -> Option<ZoneMap> {
+        let raw = self
+            .data
+            .get(block * ZoneMap::LEN..(block + 1) * ZoneMap::LEN)?;
+
+        Some(ZoneMap::from_bytes(raw.try_into().unwrap()))
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = ZoneMap> + 'a {
+        self.data
+            .chunks_exact(ZoneMap::LEN)
+            .map(|raw| ZoneMap::from_bytes(raw.try_into().unwrap()))
+    }
+
+    /* Returns the record ranges of the blocks that may hold a match, merging adjacent blocks. */
+    pub fn candidate_ranges<F>(&self, may_match: F) -> Vec<RangeInclusive<u32>>
+    where
+        F: Fn(&ZoneMap) -> bool,
+    {
+        let mut ranges: Vec<RangeInclusive<u32>> = Vec::new();
+        for zone_map in self.iter().filter(|z| z.record_count > 0 && may_match(z)) {
+            let range = zone_map.record_range();
+            match ranges.last_mut() {
+                Some(last) if last.end().checked_add(1) == Some(*range.start()) => {
+                    *last = *last.start()..=*range.end();
+                }
+                _ => ranges.push(range),
+            }
+        }
+
+        ranges
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::frame::OrderedSetKind;
+    use crate::index::{IndexOptions, PadIndex};
+    use crate::testutil::*;
+    use crate::MappedPadFile;
+
+    fn zone_map(first_record_number: u32, record_count: u32) -> ZoneMap {
+        ZoneMap {
+            record_count,
+            min_timestamp_ns: 0,
+            ..ZoneMap::new(first_record_number)
+        }
+    }
+
+    #[test]
+    fn zone_maps_summarize_their_blocks() {
+        let pad = TempFile::new(&pad_file_bytes(1, &frame_records(1000)));
+        let pad_file = MappedPadFile::from_filename(pad.path()).unwrap();
+        let index_file = index_file(&pad_file, &IndexOptions::default());
+        let index = PadIndex::from_filename(index_file.path()).unwrap();
+        let zone_maps = index.zone_maps().unwrap();
+        assert_eq!(zone_maps.block_len(), ZONE_BLOCK_LEN);
+        assert_eq!(zone_maps.len(), 1);
+
+        let zone_map = zone_maps.get(0).unwrap();
+        assert_eq!(zone_maps.get(1), None);
+        assert_eq!(zone_map.record_range(), 1..=1000);
+        assert_eq!(zone_map.min_timestamp_ns, 1000);
+        assert_eq!(zone_map.max_timestamp_ns, 1000 + 10 * 999);
+        assert_eq!(zone_map.upstream, 500);
+        assert_eq!(zone_map.downstream(), 500);
+        assert_eq!(zone_map.min_address, 0x40);
+        assert_eq!(zone_map.max_address, 0x1_0000_0000 + 0x1000 * 28 + 0x40);
+        assert!(zone_map.has_class(CLASS_TLP));
+        assert!(zone_map.has_class(CLASS_DLLP));
+        assert!(zone_map.has_class(CLASS_ORDERED_SET));
+        assert!(zone_map.has_tlp_type(0x00));
+        assert!(zone_map.has_tlp_type(0x4a));
+        assert!(zone_map.has_tlp_type(0x60));
+        assert!(!zone_map.has_tlp_type(0x40));
+        assert!(zone_map.has_dllp_type(0x00));
+        assert!(!zone_map.has_dllp_type(0x10));
+        assert!(zone_map.has_ordered_set_kind(OrderedSetKind::Skp as u8));
+        assert!(zone_map.has_completion_status(0));
+        assert!(!zone_map.has_completion_status(1));
+
+        assert!(zone_map.overlaps_time(&(..=1000)));
+        assert!(!zone_map.overlaps_time(&(..1000)));
+        assert!(zone_map.overlaps_time(&(10990..)));
+        assert!(!zone_map.overlaps_time(&(10991..)));
+        assert!(zone_map.overlaps_address(&(0x2000..0x2001)));
+        assert!(!zone_map.overlaps_address(&(..0x40)));
+
+        assert_eq!(ZoneMap::from_bytes(&zone_map.to_bytes()), zone_map);
+    }
+
+    #[test]
+    fn blocks_without_addresses_never_overlap_an_address_range() {
+        let zone_map = zone_map(1, 10);
+        assert!(!zone_map.overlaps_address(&(..)));
+    }
+
+    #[test]
+    fn candidate_ranges_merge_adjacent_blocks() {
+        let zone_maps = [
+            zone_map(1, 10),
+            zone_map(11, 10),
+            zone_map(21, 10),
+            zone_map(31, 10),
+            zone_map(u32::MAX - 9, 10),
+        ];
+        let section = section_from_zone_maps(10, &zone_maps);
+        let view = ZoneMaps::from_section(&section).unwrap();
+        assert_eq!(view.len(), 5);
+
+        assert_eq!(
+            view.candidate_ranges(|_| true),
+            vec![1..=40, u32::MAX - 9..=u32::MAX]
+        );
+        assert_eq!(
+            view.candidate_ranges(|z| z.first_record_number != 21),
+            vec![1..=20, 31..=40, u32::MAX - 9..=u32::MAX]
+        );
+        assert_eq!(view.candidate_ranges(|_| false), vec![]);
+    }
+
+    #[test]
+    fn bad_zone_maps_are_rejected() {
+        let good = section_from_zone_maps(10, &[zone_map(1, 10)]);
+        assert!(ZoneMaps::from_section(&good).is_some());
+        assert!(ZoneMaps::from_section(&good[..good.len() - 1]).is_none());
+        assert!(ZoneMaps::from_section(&good[..4]).is_none());
+
+        let empty = section_from_zone_maps(10, &[zone_map(1, 0)]);
+        assert!(ZoneMaps::from_section(&empty).is_none());
+
+        let overflowing = section_from_zone_maps(10, &[zone_map(u32::MAX, 2)]);
+        assert!(ZoneMaps::from_section(&overflowing).is_none());
+
+        let miscounted = section_from_zone_maps(
+            10,
+            &[ZoneMap {
+                upstream: 11,
+                ..zone_map(1, 10)
+            }],
+        );
+        assert!(ZoneMaps::from_section(&miscounted).is_none());
+
+        /* Unchecked zone maps still don't panic. */
+        assert!(zone_map(1, 0).record_range().is_empty());
+        assert_eq!(
+            ZoneMap {
+                upstream: 11,
+                ..zone_map(1, 10)
+            }
+            .downstream(),
+            0
+        );
+    }
+}